@@ -0,0 +1,73 @@
+#ifndef ASSET_BUNDLE_H
+#define ASSET_BUNDLE_H
+
+#include <Arduino.h>
+#include <gfxfont.h>
+
+// Asset bundle: icon atlases and glyph sets packed into one image that lives
+// in its own flash partition (see partitions.csv), so assets can be updated
+// without reflashing the app. The partition is memory-mapped and assets are
+// used in place at flash-cache speed; nothing is copied into RAM. The frame
+// server maps a bundle file instead. tools/build_assets.py builds bundles.
+//
+// Layout (little endian, every entry 4-byte aligned):
+//   header     magic "EAB1", uint16 version, uint16 count, uint32 size
+//   directory  count x {char name[20], uint8 type, 3 pad, uint32 offset, uint32 size}
+//   entries    at their offsets from the start of the bundle
+//
+// Icon atlas: uint16 width, height, count, stride; count 4-byte codes
+//   ("10d"); then count bitmaps of stride bytes (1 bpp, MSB first, rows
+//   padded to a byte, set bits are black, as for Adafruit_GFX::drawBitmap).
+// Glyph set: uint16 first, last; uint8 yAdvance, 3 pad; last - first + 1
+//   GFXglyph records; then the glyph bitmaps.
+
+#define ASSET_BUNDLE_MAGIC 0x31424145 // "EAB1"
+#define ASSET_BUNDLE_VERSION 1
+#define ASSET_NAME_LENGTH 20
+#define ASSET_PARTITION_LABEL "assets"
+#define ASSET_PARTITION_SUBTYPE 0x40
+// Glyph sets turned into GFXfonts when the bundle is opened
+#define ASSET_MAX_FONTS 8
+
+enum AssetType : uint8_t {
+  ASSET_ICON_ATLAS = 1,
+  ASSET_GLYPH_SET = 2
+};
+
+struct AssetBundleHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t count;
+  uint32_t size;
+};
+
+struct AssetDirectoryEntry {
+  char name[ASSET_NAME_LENGTH];
+  uint8_t type;
+  uint8_t reserved[3];
+  uint32_t offset;
+  uint32_t size;
+};
+
+// Icons of one size; codes and bitmaps point into the mapped bundle
+struct IconAtlas {
+  uint16_t width;
+  uint16_t height;
+  uint16_t count;
+  uint16_t stride;
+  const char (*codes)[4];
+  const uint8_t *bitmaps;
+};
+
+static_assert(sizeof(AssetBundleHeader) == 12, "bundle header layout");
+static_assert(sizeof(AssetDirectoryEntry) == 32, "bundle directory layout");
+static_assert(sizeof(GFXglyph) == 8, "glyph records are stored as GFXglyph");
+
+// Function declarations
+bool assetsBegin(const char *source = ASSET_PARTITION_LABEL);
+const uint8_t *findAsset(const char *name, AssetType type, uint32_t &size);
+bool findIconAtlas(const char *name, IconAtlas &atlas);
+const uint8_t *atlasIcon(const IconAtlas &atlas, const char *code);
+const GFXfont *assetFont(const char *name, const GFXfont *fallback);
+
+#endif // ASSET_BUNDLE_H
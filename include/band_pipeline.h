@@ -0,0 +1,42 @@
+#ifndef BAND_PIPELINE_H
+#define BAND_PIPELINE_H
+
+#include <Arduino.h>
+
+// Double-buffered band output to the panel.
+// A frame goes to the controller in bands of rows. The caller fills one band
+// buffer while the other is still being clocked out, so a frame takes about
+// as long as the slower of preparing and transferring it, not the sum.
+
+// Where bands go. write() starts a transfer and may return before it is
+// done; the rows must stay untouched until wait() returns. One transfer is
+// in flight at a time.
+class PanelBus {
+public:
+  virtual ~PanelBus() {}
+  virtual void write(const uint8_t *rows, int16_t y, int16_t count) = 0;
+  virtual void wait() = 0;
+};
+
+class BandPipeline {
+public:
+  BandPipeline(PanelBus &bus, uint8_t *first, uint8_t *second);
+
+  // Buffer to prepare the next band in; never the one on the bus
+  uint8_t *band() { return _buffers[_next]; }
+  // Hand the prepared band to the bus and switch buffers
+  void send(int16_t y, int16_t count);
+  // Wait for the last band to reach the controller
+  void finish();
+  // Time spent waiting on the bus rather than preparing bands (us)
+  uint32_t stallUs() const { return _stallUs; }
+
+private:
+  PanelBus &_bus;
+  uint8_t *_buffers[2];
+  uint8_t _next;
+  bool _inFlight;
+  uint32_t _stallUs;
+};
+
+#endif // BAND_PIPELINE_H
@@ -0,0 +1,105 @@
+#ifndef BATTERY_H
+#define BATTERY_H
+
+#include <Arduino.h>
+#include "scheduler.h"
+#include "refresh_policy.h"
+
+// Battery gauge and low-battery policy.
+// The cell voltage is averaged over a burst of ADC reads and mapped to a
+// charge estimate with a Li-ion discharge curve. One reading an hour goes
+// into a history in RTC memory, and a least-squares fit over it gives the
+// discharge rate. As the charge runs down, the policy stretches the wake
+// interval, fetches the calendar less often, drops the minute ticks and
+// stretches the ghosting budgets so the panel takes partial refreshes. Just
+// before the cell browns out, a "replace battery" screen is left on the panel
+// and the ESP32 sleeps until reset.
+//
+// Only the ADC read (battery_monitor.cpp) touches hardware. The rest works
+// on a BatteryState and a voltage source, so it also runs on the host.
+
+// Battery sense input, behind a divider (the usual 1:2 on ESP32 boards)
+#ifndef BATTERY_ADC_PIN
+#define BATTERY_ADC_PIN 35
+#endif
+#ifndef BATTERY_DIVIDER_RATIO
+#define BATTERY_DIVIDER_RATIO 2
+#endif
+// ADC reads averaged per measurement
+#define BATTERY_ADC_SAMPLES 16
+// Readings below this mean no battery is connected (USB power) (mV)
+#define BATTERY_ABSENT_MV 2500
+
+// Readings kept for the discharge rate, one per interval
+#define BATTERY_HISTORY_SIZE 24
+#define BATTERY_HISTORY_INTERVAL_S (60 * 60)
+// Span the history must cover before its rate is used (s)
+#define BATTERY_RATE_MIN_SPAN_S (3 * 60 * 60)
+
+// Charge below which each level starts (percent); a level is only left
+// again once the charge is this far clear of its threshold
+#define BATTERY_LOW_PERCENT 25
+#define BATTERY_CRITICAL_PERCENT 10
+#define BATTERY_HYSTERESIS_PERCENT 5
+// Low is also entered when the battery is predicted to run out sooner (h)
+#define BATTERY_LOW_HOURS_LEFT (3 * 24)
+// Below this the regulator is about to brown out; recovered only after a
+// rise by the margin, e.g. after charging (mV)
+#define BATTERY_EMPTY_MV 3450
+#define BATTERY_RECOVERY_MV 150
+
+// Levels, fullest first
+enum BatteryLevel {
+  BATTERY_NORMAL,
+  BATTERY_LOW,
+  BATTERY_CRITICAL,
+  BATTERY_EMPTY
+};
+
+struct BatteryHistory {
+  uint32_t times[BATTERY_HISTORY_SIZE];
+  uint16_t millivolts[BATTERY_HISTORY_SIZE];
+  uint8_t count;
+  uint8_t next;
+};
+
+struct BatteryState {
+  // Latest averaged reading, 0 when no battery is connected
+  uint16_t millivolts;
+  uint8_t percent;
+  BatteryLevel level;
+  BatteryHistory history;
+};
+
+// What the wake does at a battery level
+struct PowerPolicy {
+  uint32_t dataIntervalS;
+  // Shortest time between calendar fetches, 0 for every data wake
+  uint32_t calendarIntervalS;
+  bool ticksAllowed;
+  // Multiplies the refresh policy's partial and fast-full budgets
+  uint8_t refreshBudgetFactor;
+  // Clean the panel with a full refresh in quiet hours
+  bool quietCleaning;
+  bool replaceBattery;
+};
+
+// Millivolts at the battery, 0 if there is none
+typedef uint16_t (*VoltageSource)();
+
+// Function declarations
+uint8_t batteryPercentFor(uint16_t millivolts);
+void batteryUpdate(BatteryState &state, VoltageSource source, time_t now);
+float batteryDischargeRate(const BatteryState &state);
+float batteryHoursLeft(const BatteryState &state);
+PowerPolicy powerPolicyFor(BatteryLevel level);
+RefreshPolicyConfig refreshConfigFor(const PowerPolicy &policy, const RefreshPolicyConfig &base);
+const char *batteryLevelName(BatteryLevel level);
+
+// Firmware only (battery_monitor.cpp)
+uint16_t readBatteryMillivolts();
+const PowerPolicy &batteryCheck(time_t now);
+const PowerPolicy &currentPowerPolicy();
+int batteryGaugePercent();
+
+#endif // BATTERY_H
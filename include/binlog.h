@@ -0,0 +1,89 @@
+#ifndef BINLOG_H
+#define BINLOG_H
+
+#include <Arduino.h>
+#include <initializer_list>
+
+// Binary log ring.
+// LOG(NAME, args...) writes a message ID from include/log_messages.h and its
+// arguments as raw 32-bit words into a ring in RTC memory. Nothing is
+// formatted on the device, so a log call costs a few microseconds instead of
+// the milliseconds a 115200 baud Serial.printf blocks for. The ring survives
+// deep sleep and crash resets; it is dumped over Serial after a crash (or on
+// request) and decoded on the host with tools/decode_log.py.
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_NONE 4
+
+// Messages below this level are compiled out (-D LOG_LEVEL=LOG_LEVEL_DEBUG)
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// Also print every message as text (always on for the frame server)
+#ifndef LOG_ECHO_SERIAL
+#ifdef SERVER_BUILD
+#define LOG_ECHO_SERIAL 1
+#else
+#define LOG_ECHO_SERIAL 0
+#endif
+#endif
+
+// Ring size in 32-bit words (power of two)
+#define LOG_RING_WORDS 512
+// Longest string argument kept, in bytes
+#define LOG_STRING_MAX 32
+
+enum LogId {
+#define LOG_MESSAGE(name, level, format) LOG_ID_##name,
+#include "log_messages.h"
+#undef LOG_MESSAGE
+  LOG_MESSAGE_COUNT
+};
+
+enum LogMessageLevel {
+#define LOG_MESSAGE(name, level, format) LOG_LEVEL_OF_##name = LOG_LEVEL_##level,
+#include "log_messages.h"
+#undef LOG_MESSAGE
+};
+
+// One argument, reduced to a 32-bit word or a string
+struct LogArg {
+  LogArg(int value) : word(value), str(nullptr) {}
+  LogArg(unsigned value) : word(value), str(nullptr) {}
+  LogArg(long value) : word(value), str(nullptr) {}
+  LogArg(unsigned long value) : word(value), str(nullptr) {}
+  LogArg(long long value) : word(value), str(nullptr) {}
+  LogArg(unsigned long long value) : word(value), str(nullptr) {}
+  LogArg(double value) : word(floatBits(value)), str(nullptr) {}
+  LogArg(const char *value) : word(0), str(value != nullptr ? value : "") {}
+  LogArg(const String &value) : word(0), str(value.c_str()) {}
+
+  static uint32_t floatBits(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+  }
+
+  uint32_t word;
+  const char *str;
+};
+
+// The level test is a constant expression, so stripped messages and their
+// arguments generate no code
+#define LOG(name, ...)                                   \
+  do {                                                   \
+    if (LOG_LEVEL_OF_##name >= LOG_LEVEL) {              \
+      logWrite(LOG_ID_##name, {__VA_ARGS__});            \
+    }                                                    \
+  } while (0)
+
+// Function declarations
+void logBegin();
+void logWrite(LogId id, std::initializer_list<LogArg> args);
+void logDump();
+
+#endif // BINLOG_H
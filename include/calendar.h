@@ -4,6 +4,17 @@
 #include <Arduino.h>
 #include <vector>
 
+// Events asked for per Graph calendarView page. Each page is parsed into a
+// document of fixed size, keeping only the fields below, so memory does not
+// grow with the number of events in the window.
+#define CALENDAR_PAGE_SIZE 10
+#define CALENDAR_PAGE_DOC_BYTES 8192
+// Events kept: more than the event pane of any panel has room for, so it
+// still ends in "+ more events". No further pages are fetched once full.
+#define CALENDAR_MAX_EVENTS 12
+// Pages followed at most, should a server keep handing out next links
+#define CALENDAR_MAX_PAGES 20
+
 // Calendar data structures
 struct CalendarEvent {
   String title;
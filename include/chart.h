@@ -0,0 +1,67 @@
+#ifndef CHART_H
+#define CHART_H
+
+#include <Arduino.h>
+#include "weather.h"
+
+// Forecast chart rasterizer.
+//
+// Draws straight into a 1bpp bitmap (MSB first, rows padded to a byte,
+// 1 = ink, the Adafruit_GFX::drawBitmap format) with integer code only:
+// Bresenham lines, and fills made of horizontal spans that set whole bytes
+// at a time. The renderer blits the result and prints the axis labels, so
+// the chart itself needs no fonts.
+
+// Most ticks on either axis
+#define CHART_MAX_TICKS 10
+// Hours between time ticks
+#define CHART_TIME_TICK_HOURS 6
+// Share of the plot height given to the precipitation bars (1/n)
+#define CHART_PRECIPITATION_SHARE 4
+
+struct ChartBitmap {
+  uint8_t *bits;
+  int16_t width;
+  int16_t height;
+  int16_t stride;
+};
+
+// Fill patterns; dithers are aligned to the bitmap, so touching spans join up
+enum ChartFill {
+  CHART_FILL_SOLID,
+  CHART_FILL_HALF,
+  CHART_FILL_QUARTER,
+  CHART_FILL_DOTTED
+};
+
+// Value axis rounded out to "nice" steps (1, 2 or 5 times a power of ten)
+struct ChartAxis {
+  float min;
+  float max;
+  float step;
+  uint8_t tickCount;
+  float ticks[CHART_MAX_TICKS];
+};
+
+// Where things ended up in a forecast chart, for labelling it
+struct ForecastChart {
+  ChartAxis temperature;
+  uint8_t hourCount;
+  uint8_t timeTickCount;
+  int16_t tickX[CHART_MAX_TICKS];
+  int16_t tickY[CHART_MAX_TICKS];
+  time_t timeTicks[CHART_MAX_TICKS];
+};
+
+// Function declarations
+void chartBegin(ChartBitmap &bitmap, uint8_t *bits, int16_t width, int16_t height);
+bool chartAxis(const float *values, int count, float minSpan, uint8_t maxTicks, ChartAxis &axis);
+int16_t chartScaleY(const ChartAxis &axis, float value, int16_t top, int16_t height);
+void chartSpan(ChartBitmap &bitmap, int16_t y, int16_t x0, int16_t x1, ChartFill fill);
+void chartFillRect(ChartBitmap &bitmap, int16_t x, int16_t y, int16_t w, int16_t h, ChartFill fill);
+void chartLine(ChartBitmap &bitmap, int16_t x0, int16_t y0, int16_t x1, int16_t y1);
+void chartPolyline(ChartBitmap &bitmap, const int16_t *xs, const int16_t *ys, int count);
+void chartArea(ChartBitmap &bitmap, const int16_t *xs, const int16_t *ys, int count, int16_t baseline, ChartFill fill);
+bool drawForecastChart(ChartBitmap &bitmap, const HourlyForecast hourlyForecast[], int first, ForecastChart &chart);
+
+#endif // CHART_H
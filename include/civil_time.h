@@ -0,0 +1,45 @@
+#ifndef CIVIL_TIME_H
+#define CIVIL_TIME_H
+
+#include <Arduino.h>
+#include <time.h>
+
+// Civil (local) time without the libc time zone machinery.
+// A POSIX TZ rule such as "CET-1CEST,M3.5.0,M10.5.0/3" is expanded once into
+// the UTC instants of its DST transitions for this year and the next. After
+// that, converting an epoch to local time is a lookup in that short table plus
+// integer date arithmetic, and so are day, hour and week boundaries.
+
+// Anything earlier than this means the clock has never been set
+#define MIN_VALID_EPOCH 1700000000
+
+// DST start and end for the two years covered
+#define TZ_MAX_TRANSITIONS 4
+#define TZ_RULE_LENGTH 48
+
+struct TimeZone {
+  char rule[TZ_RULE_LENGTH];               // POSIX TZ rule the table was built from
+  int32_t standardOffset;                  // seconds east of UTC outside DST
+  int32_t initialOffset;                   // offset before the first transition
+  uint8_t transitionCount;
+  time_t transitions[TZ_MAX_TRANSITIONS];  // UTC instants, ascending
+  int32_t offsets[TZ_MAX_TRANSITIONS];     // offset in effect from the matching transition on
+  time_t validUntil;                       // rebuild the table from here on
+};
+
+// Function declarations
+bool buildTimeZone(const char *rule, time_t now, TimeZone &zone);
+void useTimeZone(const TimeZone *zone);
+void timeZoneBegin();
+bool timeZoneConfigure(const char *rule, time_t now);
+void posixTimeZoneFor(const char *ianaName, int32_t utcOffset, char *rule, size_t size);
+int32_t utcOffsetAt(time_t t);
+void localTime(time_t t, struct tm &civil);
+void utcTime(time_t t, struct tm &civil);
+time_t utcEpoch(int32_t year, uint32_t month, uint32_t day, int32_t secondOfDay);
+time_t startOfHour(time_t t);
+time_t startOfDay(time_t t);
+time_t startOfWeek(time_t t);
+time_t addLocalDays(time_t dayStart, int days);
+
+#endif // CIVIL_TIME_H
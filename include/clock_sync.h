@@ -0,0 +1,40 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <Arduino.h>
+
+// System clock kept right across deep sleep without an NTP sync per wake.
+// The RTC that keeps time while asleep runs off an RC oscillator and drifts.
+// Each sync measures that drift, the estimate is kept in RTC memory, and
+// every wake corrects the clock for the time slept. NTP is only asked again
+// once the error predicted for the uncorrected remainder gets too large. The
+// sync then runs in the background while the wake fetches, and the wake
+// only waits for it when the clock is not known at all.
+
+// Largest predicted error before NTP is asked again (ms)
+#define CLOCK_MAX_ERROR_MS 2000
+// Predicted error beyond which the clock counts as unknown and the wake
+// waits for NTP before using it (ms)
+#define CLOCK_USABLE_ERROR_MS 60000
+// Rate uncertainty before the drift has been measured, and what is left of
+// it after correcting for the measured drift (ppm)
+#define CLOCK_UNKNOWN_DRIFT_PPM 50000
+#define CLOCK_RESIDUAL_DRIFT_PPM 500
+// Larger measured drifts mean the clock was set by something else (ppm)
+#define CLOCK_MAX_DRIFT_PPM 100000
+// Shortest interval between syncs that the drift is measured over (s)
+#define CLOCK_MIN_DRIFT_SAMPLE_S (20 * 60)
+// Sync at least this often, however good the model looks (s)
+#define CLOCK_MAX_SYNC_INTERVAL_S (24 * 60 * 60)
+// How long a wake with an unknown clock waits for NTP (ms)
+#define CLOCK_SYNC_TIMEOUT_MS 10000
+
+// Function declarations
+void clockBegin();
+bool clockKnown();
+bool clockSyncDue();
+void clockStartSync();
+bool clockWaitKnown();
+void clockFinishSync();
+
+#endif // CLOCK_SYNC_H
@@ -3,18 +3,66 @@
 
 #include <Arduino.h>
 #include <Preferences.h>
+#include <type_traits>
+#include "civil_time.h"
+#include "binlog.h"
 
-// Configuration structure
+// Bump when the layout of Config changes. Fields are appended, so an older
+// blob is a prefix of the current struct and is zero-extended. The one
+// exception is v4, which moved the refresh token out (see config.cpp).
+#define CONFIG_VERSION 4
+
+// Microsoft refresh tokens have no fixed length and can outgrow any field
+// that fits in RTC memory, so the token has its own NVS key and is only read
+// on wakes that fetch the calendar. Longest token, NUL included (the NVS
+// string limit).
+#define REFRESH_TOKEN_MAX 4000
+
+// Configuration structure.
+// Fixed-size, NUL-terminated fields so the whole struct is trivially copyable:
+// it is persisted as a single NVS blob and kept in RTC memory across deep sleep.
 struct Config {
-  String location;
-  String weatherApiKey;
-  String msftClientId;
-  String msftClientSecret;
-  String msftRefreshToken;
+  char location[64];
+  char weatherApiKey[48];
+  char msftClientId[48];
+  char msftClientSecret[64];
+  char frameServerUrl[96];     // v2: thin-client mode when set
+  char timeZone[TZ_RULE_LENGTH]; // v3: POSIX TZ rule, looked up from the IP when empty
 };
 
+static_assert(std::is_trivially_copyable<Config>::value, "Config must be trivially copyable");
+
+// Global configuration, valid after loadConfig(). The frame server fetches
+// for many devices on parallel threads, each with its device's config.
+#ifdef SERVER_BUILD
+extern thread_local Config config;
+#else
+extern Config config;
+#endif
+
+// Copy a value into a config field; returns true if the field changed.
+// A value that does not fit is rejected rather than cut short.
+template <size_t N>
+bool setConfigField(char (&field)[N], const char *value) {
+  if (value == nullptr) {
+    value = "";
+  }
+  size_t length = strnlen(value, N);
+  if (length == N) {
+    LOG(CONFIG_VALUE_TOO_LONG, (unsigned)strlen(value), (unsigned)(N - 1));
+    return false;
+  }
+  if (strcmp(field, value) == 0) {
+    return false;
+  }
+  memcpy(field, value, length + 1);
+  return true;
+}
+
 // Function declarations
 bool loadConfig();
 bool saveConfig();
+String loadRefreshToken();
+bool saveRefreshToken(const String &token);
 
 #endif // CONFIG_H
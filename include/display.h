@@ -2,23 +2,54 @@
 #define DISPLAY_H
 
 #include <Arduino.h>
+#include "panel.h"
 #include "weather.h"
 #include "calendar.h"
+#include "model_cache.h"
+#include "refresh_policy.h"
+#include "layout.h"
+#include "band_pipeline.h"
 
-// Display dimensions for Waveshare 7.5inch E-Paper HAT (H)
-// Resolution: 880×528 pixels
-#define DISPLAY_WIDTH 880
-#define DISPLAY_HEIGHT 528
-#define SPLIT_POSITION (DISPLAY_WIDTH / 2)
+// Display geometry of the panel selected at build time
+constexpr int16_t DISPLAY_WIDTH = ActivePanel::WIDTH;
+constexpr int16_t DISPLAY_HEIGHT = ActivePanel::HEIGHT;
+constexpr int16_t SPLIT_POSITION = DISPLAY_WIDTH / 2;
+constexpr int16_t FRAME_STRIDE = (DISPLAY_WIDTH + 7) / 8;
+
+// Band writer task (see panelBus())
+#define PANEL_BUS_STACK 3072
+#define PANEL_BUS_PRIORITY 2
+// Rows per band of a locally rendered frame (see nextFrameBand())
+#define RENDER_BAND_ROWS (DISPLAY_HEIGHT / 4)
+
+// Display instance (defined in display.cpp)
+extern ActiveDisplay display;
 
 // Function declarations
-void initDisplay();
+void initDisplay(bool initial = true);
+void hibernateDisplay();
 void displayStartupScreen();
 void displayWiFiSetupScreen();
+void displayReplaceBattery();
 void drawSplitScreenLayout();
-void drawWeatherData(const WeatherData &currentWeather, const HourlyForecast hourlyForecast[]);
+bool prepareWeatherPane(const HourlyForecast hourlyForecast[], time_t now);
+void drawWeatherData(const WeatherData &currentWeather);
 void drawCalendarEvents(const CalendarEvents &events);
 void drawWeatherIcon(int x, int y, int size, const String &iconCode);
 void drawBatteryStatus(int x, int y);
+void drawStaleMarkers(time_t now, time_t weatherAsOf, time_t calendarAsOf);
+void drawClockWidget(time_t now, const WidgetModel &model);
+void refreshClockWidget(time_t now, const WidgetModel &model);
+RegionKeys contentKeys(const WeatherData &currentWeather, const HourlyForecast hourlyForecast[], const CalendarEvents &events,
+                       const WidgetModel &model, time_t now, time_t weatherAsOf, time_t calendarAsOf);
+bool changedWindow(const RegionKeys &keys, Rect &window);
+void markRegionsShown(const RegionKeys &keys);
+void forgetShownRegions();
+void markFrameShown(uint32_t etag);
+uint32_t shownFrame();
+void beginFrame(RefreshMode mode, const Rect &window);
+bool nextFrameBand();
+PanelBus &panelBus(bool previousImage = false);
+void refreshFrameRows(RefreshMode mode, int16_t y, int16_t count);
 
 #endif // DISPLAY_H
@@ -0,0 +1,35 @@
+#ifndef ENDPOINT_HEALTH_H
+#define ENDPOINT_HEALTH_H
+
+#include <Arduino.h>
+
+// Retry delay after the first failure, doubled on every further failure
+#define HEALTH_BACKOFF_BASE_S (5 * 60)
+// Consecutive failures that open the circuit breaker
+#define HEALTH_BREAKER_THRESHOLD 4
+// How long an open breaker waits before letting one probe through (doubled
+// each time the probe fails, up to the maximum)
+#define HEALTH_BREAKER_COOLDOWN_S (2 * 60 * 60)
+#define HEALTH_BACKOFF_MAX_S (8 * 60 * 60)
+
+// Remote endpoints tracked separately
+enum Endpoint {
+  ENDPOINT_WEATHER,
+  ENDPOINT_CALENDAR,
+  ENDPOINT_FRAME_SERVER,
+  ENDPOINT_COUNT
+};
+
+// Circuit breaker states
+enum BreakerState {
+  BREAKER_CLOSED,    // healthy or backing off after a few failures
+  BREAKER_OPEN,      // failing; skipped until the cooldown ends
+  BREAKER_HALF_OPEN  // cooldown over; the next request is a probe
+};
+
+// Function declarations
+bool endpointAllowed(Endpoint endpoint, time_t now);
+void recordEndpointResult(Endpoint endpoint, bool ok, time_t now);
+BreakerState endpointState(Endpoint endpoint, time_t now);
+
+#endif // ENDPOINT_HEALTH_H
@@ -0,0 +1,13 @@
+#ifndef FRAME_CLIENT_H
+#define FRAME_CLIENT_H
+
+#include <Arduino.h>
+
+// Rows buffered per write to the panel in thin-client mode
+#define FRAME_BAND_ROWS 16
+
+// Function declarations
+String deviceId();
+bool updateFromFrameServer();
+
+#endif // FRAME_CLIENT_H
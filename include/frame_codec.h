@@ -0,0 +1,72 @@
+#ifndef FRAME_CODEC_H
+#define FRAME_CODEC_H
+
+#include <Arduino.h>
+#include <vector>
+
+// Delta-compressed frame transfer format.
+//
+// A frame is 1bpp, row-major, MSB first, 1 = white. A delta describes how to
+// turn a base frame (identified by its ETag) into a new one:
+//
+//   header   "EFD1", width, height, baseEtag, etag, rangeCount   (18 bytes, LE)
+//   ranges   rangeCount x {firstRow, rowCount}                   (4 bytes each)
+//   rows     every row of every range, coded as below
+//
+// Each coded row is the XOR of the new row against the base row, written as
+// tokens until the row stride is covered:
+//   0x00-0x7F  run of (n + 1) zero bytes (unchanged)
+//   0x80-0xFF  (n - 0x7F) literal XOR bytes follow
+//
+// Rows outside the ranges are unchanged. baseEtag 0 marks a keyframe, whose
+// base is an all-white frame. The ranges double as the dirty region for a
+// partial refresh.
+
+#define FRAME_DELTA_MAGIC "EFD1"
+#define FRAME_DELTA_HEADER_SIZE 18
+#define FRAME_DELTA_MAX_RANGES 32
+#define FRAME_DELTA_CONTENT_TYPE "application/x-frame-delta"
+
+struct FrameRowRange {
+  uint16_t firstRow;
+  uint16_t rowCount;
+};
+
+struct FrameDeltaHeader {
+  uint16_t width;
+  uint16_t height;
+  uint32_t baseEtag;
+  uint32_t etag;
+  uint16_t rangeCount;
+  FrameRowRange ranges[FRAME_DELTA_MAX_RANGES];
+};
+
+// Where the decoder reads base rows from and writes patched rows to
+class FrameRowStore {
+public:
+  virtual ~FrameRowStore() {}
+  virtual bool readRow(uint16_t row, uint8_t *data) = 0;
+  virtual bool writeRow(uint16_t row, const uint8_t *data) = 0;
+};
+
+// Streaming decoder: pulls the delta from a Stream and patches the store one
+// row at a time, so it only ever holds a single row in memory.
+class FrameDeltaDecoder {
+public:
+  explicit FrameDeltaDecoder(Stream &source) : _source(source) {}
+
+  bool readHeader(FrameDeltaHeader &header);
+  bool applyRows(const FrameDeltaHeader &header, FrameRowStore &store);
+
+private:
+  bool readExact(uint8_t *data, size_t length);
+  bool decodeRow(uint8_t *row, size_t stride);
+
+  Stream &_source;
+};
+
+// Function declarations
+void encodeFrameDelta(const uint8_t *base, const uint8_t *frame, uint16_t width, uint16_t height,
+                      uint32_t baseEtag, uint32_t etag, std::vector<uint8_t> &out);
+
+#endif // FRAME_CODEC_H
@@ -0,0 +1,101 @@
+#ifndef HTTP_STREAM_H
+#define HTTP_STREAM_H
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include <ArduinoJson.h>
+
+// Content encodings the API clients understand
+enum ContentEncoding {
+  ENCODING_IDENTITY,
+  ENCODING_GZIP,
+  ENCODING_DEFLATE
+};
+
+// Streaming inflater for gzip/deflate response bodies.
+// Reads compressed bytes from the source stream in small chunks and hands out
+// decompressed bytes one at a time, so the JSON parser never sees the whole
+// body. The only large buffer is the 32 KB deflate window, which is the
+// maximum back-reference distance the format allows.
+class InflateStream : public Stream {
+public:
+  InflateStream(Stream &source, ContentEncoding encoding);
+  ~InflateStream();
+
+  bool ok() const { return _state != STATE_ERROR; }
+  size_t compressedBytes() const { return _compressedBytes; }
+  size_t inflatedBytes() const { return _inflatedBytes; }
+
+  // Stream interface
+  int available() override;
+  int read() override;
+  int peek() override;
+  void flush() override {}
+  size_t write(uint8_t) override { return 0; }
+
+private:
+  enum State {
+    STATE_HEADER,
+    STATE_BODY,
+    STATE_DONE,
+    STATE_ERROR
+  };
+
+  bool fill();
+  bool refillInput();
+  int readInputByte();
+  bool skipGzipHeader();
+  bool skipZlibHeader();
+
+  Stream &_source;
+  ContentEncoding _encoding;
+  State _state;
+  void *_decompressor;
+  uint8_t *_window;
+  uint8_t _input[512];
+  size_t _inputPos;
+  size_t _inputLen;
+  bool _inputEnded;
+  size_t _windowOfs;
+  size_t _outPos;
+  size_t _outEnd;
+  size_t _compressedBytes;
+  size_t _inflatedBytes;
+};
+
+// Pass-through stream that ends the body once the wake budget is spent, so
+// a slow server cannot hold the radio on (see wake_budget.h). The source's
+// read timeout is kept within the remaining budget. A body of known length
+// also ends there, rather than waiting on a connection kept alive.
+class DeadlineStream : public Stream {
+public:
+  // length is the Content-Length, or -1 if the body runs until the server closes
+  explicit DeadlineStream(Stream &source, int32_t length = -1) : _source(source), _remaining(length), _expired(false) {}
+
+  bool expired() const { return _expired; }
+  bool finish();
+
+  // Stream interface
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t readBytes(char *buffer, size_t length) override;
+  void flush() override {}
+  size_t write(uint8_t) override { return 0; }
+
+private:
+  bool checkDeadline();
+
+  Stream &_source;
+  int32_t _remaining;
+  bool _expired;
+};
+
+// Function declarations
+void prepareCompressedRequest(HTTPClient &http);
+void applyRequestDeadline(HTTPClient &http);
+ContentEncoding responseEncoding(HTTPClient &http);
+DeserializationError deserializeResponse(HTTPClient &http, JsonDocument &doc);
+DeserializationError deserializeResponse(HTTPClient &http, JsonDocument &doc, DeserializationOption::Filter filter);
+
+#endif // HTTP_STREAM_H
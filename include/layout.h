@@ -0,0 +1,196 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <Arduino.h>
+
+// Screen layout, resolved at compile time.
+// Regions, rows and columns are described relative to each other and to the
+// panel size and font metrics, and come out as constant rectangles and
+// baselines. The renderer draws at these constants, so no geometry is worked
+// out at runtime, and each region's bounds are known exactly for partial
+// refreshes.
+
+struct Rect {
+  int16_t x;
+  int16_t y;
+  int16_t w;
+  int16_t h;
+
+  constexpr int16_t right() const { return x + w; }
+  constexpr int16_t bottom() const { return y + h; }
+
+  // Band of the given height, offset from the top (negative: from the bottom)
+  constexpr Rect row(int16_t offset, int16_t height) const {
+    return Rect{x, (int16_t)(offset >= 0 ? y + offset : bottom() + offset - height), w, height};
+  }
+  // Column index of count equal columns
+  constexpr Rect column(int16_t index, int16_t count) const {
+    return Rect{(int16_t)(x + index * (w / count)), y, (int16_t)(w / count), h};
+  }
+  // Everything below the given edge
+  constexpr Rect below(int16_t edge) const { return Rect{x, edge, w, (int16_t)(bottom() - edge)}; }
+  constexpr Rect inset(int16_t dx, int16_t dy) const {
+    return Rect{(int16_t)(x + dx), (int16_t)(y + dy), (int16_t)(w - 2 * dx), (int16_t)(h - 2 * dy)};
+  }
+  constexpr bool contains(const Rect &other) const {
+    return other.x >= x && other.y >= y && other.right() <= right() && other.bottom() <= bottom();
+  }
+  constexpr bool empty() const { return w <= 0 || h <= 0; }
+};
+
+// Smallest rectangle covering both; an empty rectangle covers nothing
+inline Rect unionRect(const Rect &a, const Rect &b) {
+  if (a.empty()) {
+    return b;
+  }
+  if (b.empty()) {
+    return a;
+  }
+  int16_t x = min(a.x, b.x);
+  int16_t y = min(a.y, b.y);
+  return Rect{x, y, (int16_t)(max(a.right(), b.right()) - x), (int16_t)(max(a.bottom(), b.bottom()) - y)};
+}
+
+// Metrics of the monospaced GFX fonts the renderer uses: line advance,
+// height of capitals above the baseline and character advance
+struct FontMetrics {
+  int16_t lineHeight;
+  int16_t ascent;
+  int16_t advance;
+};
+
+constexpr FontMetrics FONT_SMALL = {18, 12, 11};  // FreeMonoBold9pt7b
+constexpr FontMetrics FONT_MEDIUM = {24, 16, 14}; // FreeMonoBold12pt7b
+constexpr FontMetrics FONT_HUGE = {47, 32, 28};   // FreeMonoBold24pt7b
+
+// Regions with their own dirty tracking
+enum LayoutRegion {
+  LAYOUT_HEADER,
+  LAYOUT_WEATHER_NOW,
+  LAYOUT_HOURLY,
+  LAYOUT_CLOCK,
+  LAYOUT_EVENTS,
+  LAYOUT_REGION_COUNT
+};
+
+template <int16_t WIDTH, int16_t HEIGHT>
+struct Layout {
+  static constexpr int16_t MARGIN = 10;
+  static constexpr int16_t PAD = 20;
+  static constexpr int16_t SPLIT = WIDTH / 2;
+
+  static constexpr Rect SCREEN = {0, 0, WIDTH, HEIGHT};
+
+  // Pane titles, their rules and the battery gauge across the top
+  static constexpr Rect HEADER = SCREEN.row(0, 40);
+  static constexpr int16_t TITLE_BASELINE = HEADER.bottom() - MARGIN;
+  static constexpr int16_t WEATHER_TITLE_X = MARGIN;
+  static constexpr int16_t CALENDAR_TITLE_X = SPLIT + MARGIN;
+  // "as of" markers one character after "Weather" and "Calendar"
+  static constexpr int16_t WEATHER_STALE_X = WEATHER_TITLE_X + 8 * FONT_MEDIUM.advance;
+  static constexpr int16_t CALENDAR_STALE_X = CALENDAR_TITLE_X + 9 * FONT_MEDIUM.advance;
+  static constexpr int16_t BATTERY_X = WIDTH - 50;
+  static constexpr int16_t BATTERY_BASELINE = TITLE_BASELINE - 5;
+
+  static constexpr Rect WEATHER_PANE = Rect{0, 0, SPLIT, HEIGHT}.below(HEADER.bottom());
+  static constexpr Rect CALENDAR_PANE = Rect{SPLIT, 0, (int16_t)(WIDTH - SPLIT), HEIGHT}.below(HEADER.bottom());
+
+  // Location and current conditions: big icon on the left, readings on the right
+  static constexpr Rect WEATHER_NOW = WEATHER_PANE.inset(PAD, 0).row(MARGIN, 210);
+  static constexpr int16_t LOCATION_BASELINE = WEATHER_NOW.y + PAD;
+  static constexpr int16_t READINGS_X = WEATHER_NOW.column(1, 2).x;
+  static constexpr int16_t TEMPERATURE_BASELINE = LOCATION_BASELINE + 80;
+  static constexpr Rect NOW_ICON = {(int16_t)(READINGS_X - 120), TEMPERATURE_BASELINE, 100, 100};
+  static constexpr int16_t READING_PITCH = FONT_SMALL.lineHeight + 7;
+  static constexpr int16_t FIRST_READING_BASELINE = TEMPERATURE_BASELINE + 30;
+
+  // Forecast chart under a title, with the temperature scale to its left
+  // and the time labels below it
+  static constexpr Rect HOURLY = WEATHER_PANE.inset(PAD, 0).below(WEATHER_NOW.bottom());
+  static constexpr int16_t HOURLY_TITLE_BASELINE = HOURLY.y + PAD;
+  static constexpr int16_t HOURLY_RULE_Y = HOURLY_TITLE_BASELINE + MARGIN;
+  static constexpr int16_t CHART_SCALE_WIDTH = 4 * FONT_SMALL.advance;
+  static constexpr Rect CHART = Rect{(int16_t)(HOURLY.x + CHART_SCALE_WIDTH), (int16_t)(HOURLY_RULE_Y + FONT_SMALL.ascent + 2),
+                                     (int16_t)(HOURLY.w - CHART_SCALE_WIDTH), 150};
+  static constexpr int16_t CHART_LABEL_BASELINE = CHART.bottom() + FONT_SMALL.ascent + 4;
+
+  // Date/time line and next-meeting countdown, refreshed on minute ticks
+  static constexpr Rect CLOCK = CALENDAR_PANE.inset(MARGIN, 0)
+                                    .row(4, FONT_MEDIUM.lineHeight + FONT_SMALL.lineHeight + 16);
+  static constexpr int16_t CLOCK_TEXT_X = CLOCK.x + MARGIN;
+  static constexpr int16_t DATE_BASELINE = CLOCK.y + FONT_MEDIUM.lineHeight;
+  static constexpr int16_t COUNTDOWN_BASELINE = DATE_BASELINE + FONT_SMALL.lineHeight + 6;
+
+  // Event list; entries flow down at fixed pitches
+  static constexpr Rect EVENTS = CALENDAR_PANE.inset(MARGIN, 0).below(CLOCK.bottom());
+  static constexpr int16_t EVENT_TIME_X = EVENTS.x + MARGIN;
+  static constexpr int16_t EVENT_TEXT_X = EVENT_TIME_X + MARGIN;
+  static constexpr int16_t FIRST_EVENT_BASELINE = EVENTS.y + 22;
+  static constexpr int16_t EVENT_TITLE_PITCH = FONT_SMALL.lineHeight + 7;
+  static constexpr int16_t EVENT_LOCATION_PITCH = FONT_SMALL.lineHeight + 2;
+  static constexpr int16_t EVENT_RULE_OFFSET = 15;
+  static constexpr int16_t EVENT_GAP = 20;
+  static constexpr int16_t LAST_EVENT_BASELINE = EVENTS.bottom() - 30;
+  // Highlight bar behind a title, relative to its baseline
+  static constexpr Rect highlight(int16_t baseline) {
+    return Rect{(int16_t)(EVENT_TEXT_X - 5), (int16_t)(baseline - 15), (int16_t)(EVENTS.right() - EVENT_TEXT_X - 5), 20};
+  }
+  // Characters of title or location that fit next to the list's right edge
+  static constexpr int16_t EVENT_TEXT_CHARS = (EVENTS.right() - EVENT_TEXT_X - MARGIN) / FONT_SMALL.advance;
+
+  static constexpr Rect region(LayoutRegion region) {
+    return region == LAYOUT_HEADER ? HEADER
+         : region == LAYOUT_WEATHER_NOW ? WEATHER_NOW
+         : region == LAYOUT_HOURLY ? HOURLY
+         : region == LAYOUT_CLOCK ? CLOCK
+         : EVENTS;
+  }
+
+  static_assert(SCREEN.contains(WEATHER_NOW) && SCREEN.contains(CHART) && SCREEN.contains(CLOCK) &&
+                SCREEN.contains(EVENTS), "layout does not fit the panel");
+  static_assert(WEATHER_NOW.contains(NOW_ICON), "current conditions icon overflows its region");
+  static_assert(READINGS_X + 6 * FONT_HUGE.advance <= WEATHER_NOW.right(), "temperature does not fit next to the icon");
+  static_assert(HOURLY.contains(CHART) && CHART_LABEL_BASELINE <= HOURLY.bottom(), "forecast chart overflows the weather pane");
+  static_assert(EVENT_TEXT_CHARS >= 10, "calendar pane too narrow for event titles");
+};
+
+// Out-of-class definitions, needed when a rectangle is bound to a reference
+template <int16_t W, int16_t H> constexpr Rect Layout<W, H>::SCREEN;
+template <int16_t W, int16_t H> constexpr Rect Layout<W, H>::HEADER;
+template <int16_t W, int16_t H> constexpr Rect Layout<W, H>::WEATHER_PANE;
+template <int16_t W, int16_t H> constexpr Rect Layout<W, H>::CALENDAR_PANE;
+template <int16_t W, int16_t H> constexpr Rect Layout<W, H>::WEATHER_NOW;
+template <int16_t W, int16_t H> constexpr Rect Layout<W, H>::NOW_ICON;
+template <int16_t W, int16_t H> constexpr Rect Layout<W, H>::HOURLY;
+template <int16_t W, int16_t H> constexpr Rect Layout<W, H>::CHART;
+template <int16_t W, int16_t H> constexpr Rect Layout<W, H>::CLOCK;
+template <int16_t W, int16_t H> constexpr Rect Layout<W, H>::EVENTS;
+
+// Regions whose content changed since the panel last showed them. Each
+// region is summarised by a content key; a region is dirty when its key
+// differs from the one it was last drawn with.
+struct RegionKeys {
+  uint32_t keys[LAYOUT_REGION_COUNT];
+};
+
+// FNV-1a, for building content keys
+inline uint32_t contentHash(uint32_t hash, const void *data, size_t length) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  return hash;
+}
+
+template <typename T>
+inline uint32_t contentHash(uint32_t hash, const T &value) {
+  return contentHash(hash, &value, sizeof(value));
+}
+
+inline uint32_t contentHash(uint32_t hash, const String &value) {
+  return contentHash(hash, value.c_str(), value.length() + 1);
+}
+
+#define CONTENT_HASH_SEED 2166136261u
+
+#endif // LAYOUT_H
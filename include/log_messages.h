@@ -0,0 +1,100 @@
+// Binary log message table: LOG_MESSAGE(name, level, format).
+// A message's ID is its position in this list, and tools/decode_log.py reads
+// this file to turn a dumped ring back into text. Only ever append, so rings
+// written by older firmware still decode.
+//
+// Formats take %d %i %u %x %X %c %f %s with the usual flags, width and
+// precision; strings are stored truncated to LOG_STRING_MAX bytes.
+
+LOG_MESSAGE(WAKE, INFO, "--- wake: reset reason %u, time %u ---")
+LOG_MESSAGE(BOOT, INFO, "E-Ink Weather and Calendar Display")
+LOG_MESSAGE(OFFLINE_WAKE, INFO, "All endpoints backing off, rendering from cache")
+LOG_MESSAGE(SLEEP, INFO, "Going to deep sleep for %u s...")
+LOG_MESSAGE(WIFI_PORTAL, INFO, "Starting WiFi setup portal...")
+LOG_MESSAGE(WIFI_CONNECT_FAILED, WARN, "WiFi connect failed, using cached data")
+LOG_MESSAGE(WIFI_PORTAL_TIMEOUT, ERROR, "Failed to connect and hit timeout")
+LOG_MESSAGE(WIFI_CONNECTED, INFO, "WiFi connected, IP address: %u.%u.%u.%u")
+LOG_MESSAGE(WEATHER_UPDATED, INFO, "Weather data updated successfully")
+LOG_MESSAGE(WEATHER_FAILED, WARN, "Failed to update weather data")
+LOG_MESSAGE(CALENDAR_UPDATED, INFO, "Calendar data updated successfully")
+LOG_MESSAGE(CALENDAR_FAILED, WARN, "Failed to update calendar data")
+LOG_MESSAGE(GEOLOCATION_HTTP_FAILED, WARN, "IP Geolocation API failed, error: %d")
+LOG_MESSAGE(GEOLOCATION_PARSE_FAILED, WARN, "JSON parsing failed: %s")
+LOG_MESSAGE(LOCATION_DETECTED, INFO, "Location detected: %s, %s")
+LOG_MESSAGE(LOCATION_FAILED, WARN, "Failed to get location from IP")
+LOG_MESSAGE(WEATHER_HTTP_FAILED, WARN, "Weather API request failed, error: %d")
+LOG_MESSAGE(WEATHER_PARSE_FAILED, WARN, "Weather JSON parsing failed: %s")
+LOG_MESSAGE(MSFT_AUTH_STUB, DEBUG, "Microsoft authentication not fully implemented")
+LOG_MESSAGE(MSFT_NO_REFRESH_TOKEN, WARN, "No refresh token available")
+LOG_MESSAGE(TOKEN_HTTP_FAILED, WARN, "Token refresh failed, error: %d")
+LOG_MESSAGE(TOKEN_PARSE_FAILED, WARN, "Token JSON parsing failed: %s")
+LOG_MESSAGE(MSFT_AUTH_FAILED, ERROR, "Microsoft authentication failed")
+LOG_MESSAGE(MSFT_TOKEN_FAILED, ERROR, "Microsoft token refresh failed")
+LOG_MESSAGE(CALENDAR_STUB, DEBUG, "Calendar API request not fully implemented")
+LOG_MESSAGE(INFLATE_NO_MEMORY, ERROR, "Inflate buffers allocation failed")
+LOG_MESSAGE(INFLATE_BAD_GZIP, WARN, "Invalid gzip header")
+LOG_MESSAGE(INFLATE_FAILED, WARN, "Inflate failed, status: %d")
+LOG_MESSAGE(RESPONSE_CUT_OFF, WARN, "Response cut off by wake budget")
+LOG_MESSAGE(INFLATED, DEBUG, "Inflated %u -> %u bytes")
+LOG_MESSAGE(ENDPOINT_SKIPPED, INFO, "Skipping %s (breaker %s, %u failures, retry in %d s)")
+LOG_MESSAGE(ENDPOINT_RECOVERED, INFO, "%s recovered, closing breaker")
+LOG_MESSAGE(ENDPOINT_FAILED, WARN, "%s failed %u times, breaker %s, retry in %u s")
+LOG_MESSAGE(BUDGET_OVERRUN, WARN, "Budget overrun: %s took %u ms, %u ms over")
+LOG_MESSAGE(BUDGET_SPENT, WARN, "Wake budget spent, skipping %s")
+LOG_MESSAGE(FRAME_STORE_MOUNT_FAILED, ERROR, "Failed to mount frame store")
+LOG_MESSAGE(FRAME_UNCHANGED, INFO, "Frame unchanged, skipping refresh")
+LOG_MESSAGE(FRAME_HTTP_FAILED, WARN, "Frame server request failed, error: %d")
+LOG_MESSAGE(FRAME_NO_DELTAS, WARN, "Frame server does not support deltas")
+LOG_MESSAGE(FRAME_TRUNCATED, WARN, "Frame download truncated")
+LOG_MESSAGE(FRAME_SIZE_MISMATCH, ERROR, "Frame size does not match this panel")
+LOG_MESSAGE(FRAME_WRONG_BASE, WARN, "Frame delta is for a different base")
+LOG_MESSAGE(FRAME_APPLY_FAILED, WARN, "Frame delta could not be applied")
+LOG_MESSAGE(FRAME_DELTA, INFO, "Frame delta: %u ranges, rows %d-%d")
+LOG_MESSAGE(TIMEZONE_DETECTED, INFO, "Time zone detected: %s, rule %s")
+LOG_MESSAGE(TIMEZONE_FAILED, WARN, "Failed to get time zone from IP, staying on UTC")
+LOG_MESSAGE(ASSETS_MISSING, INFO, "No asset bundle at %s, using built-in assets")
+LOG_MESSAGE(ASSETS_INVALID, WARN, "Asset bundle is invalid, using built-in assets")
+LOG_MESSAGE(ASSETS_MAPPED, INFO, "Asset bundle mapped: %u assets, %u bytes, %u fonts")
+LOG_MESSAGE(ASSET_INVALID, WARN, "Asset %s is invalid, skipping it")
+LOG_MESSAGE(DISPLAY_UNCHANGED, INFO, "Display content unchanged, skipping refresh")
+LOG_MESSAGE(DISPLAY_WINDOW, DEBUG, "Partial refresh window: %d,%d %dx%d")
+LOG_MESSAGE(DNS_RESOLVED, DEBUG, "Resolved %s, TTL %u s")
+LOG_MESSAGE(DNS_FAILED, WARN, "Failed to resolve %s")
+LOG_MESSAGE(TLS_CONNECT_FAILED, WARN, "Failed to connect to %s")
+LOG_MESSAGE(TLS_HANDSHAKE_FAILED, WARN, "TLS handshake with %s failed: %d")
+LOG_MESSAGE(TLS_HANDSHAKE, INFO, "TLS handshake with %s (%s) took %u ms")
+LOG_MESSAGE(TLS_SESSION_TOO_LARGE, DEBUG, "TLS session for %s too large to keep")
+LOG_MESSAGE(CONNECTIONS_CLOSED, DEBUG, "Closed %u kept-alive connections")
+LOG_MESSAGE(CLOCK_CORRECTED, DEBUG, "Clock corrected by %d ms for %d ppm drift")
+LOG_MESSAGE(CLOCK_SYNC_SKIPPED, INFO, "Clock within %u ms, NTP sync skipped")
+LOG_MESSAGE(CLOCK_UNKNOWN, WARN, "Clock not set, waiting for NTP")
+LOG_MESSAGE(CLOCK_SYNCED, INFO, "NTP sync: clock was %d ms behind, drift %d ppm")
+LOG_MESSAGE(BATTERY_READING, DEBUG, "Battery: %u mV, %u%%")
+LOG_MESSAGE(BATTERY_LEVEL, WARN, "Battery level %s at %u%%, falling %.1f%%/day")
+LOG_MESSAGE(BATTERY_EMPTY_SLEEP, ERROR, "Battery empty, sleeping until it is replaced")
+LOG_MESSAGE(PANE_RENDERED, DEBUG, "Weather pane rendered in %u ms, %d ms before the composite")
+LOG_MESSAGE(FRAME_WRITTEN, DEBUG, "Wrote %d rows to the panel, %u ms waiting on SPI")
+LOG_MESSAGE(CALENDAR_HTTP_FAILED, WARN, "Calendar page %u failed, error: %d")
+LOG_MESSAGE(CALENDAR_PARSE_FAILED, WARN, "Calendar page %u parsing failed: %s")
+LOG_MESSAGE(CALENDAR_PAGES, DEBUG, "Calendar: %u events from %u pages, %s")
+LOG_MESSAGE(WAKE_METRICS, INFO, "Wake (%s, %s): awake %u ms, ~%.1f mAs (%.2f uAh)")
+LOG_MESSAGE(WAKE_PHASES, INFO, "Phases: boot %u, wifi %u, fetch %u, render %u, refresh %u ms")
+LOG_MESSAGE(WAKE_OVERRUNS, WARN, "%u budget overruns, %u ms over")
+LOG_MESSAGE(WAKE_AVERAGE, DEBUG, "Average %s wake: %u ms, %.1f mAs over %u wakes, %u over budget")
+LOG_MESSAGE(REFRESH_CHOSEN, DEBUG, "Refresh policy: %s -> %s (%s, debt %u/%u, fast-full %u/%u)")
+LOG_MESSAGE(CONFIG_WRITE_FAILED, ERROR, "Failed to write config blob")
+LOG_MESSAGE(CONFIG_INVALID, WARN, "Stored config blob is invalid, ignoring it")
+LOG_MESSAGE(CONFIG_UPGRADED, INFO, "Upgrading config blob from v%u to v%u")
+LOG_MESSAGE(CONFIG_LEGACY, INFO, "Migrating legacy config keys")
+LOG_MESSAGE(FRAME_DELTA_INVALID, WARN, "Invalid frame delta header")
+LOG_MESSAGE(FRAME_DELTA_RANGES, WARN, "Frame delta has too many ranges: %u")
+LOG_MESSAGE(FRAME_DELTA_RANGE_BOUNDS, WARN, "Frame delta range out of bounds")
+LOG_MESSAGE(FRAME_DELTA_ROW_OVERFLOW, WARN, "Frame delta row overflows")
+LOG_MESSAGE(WAKE_HTTP, INFO, "HTTP: %u requests, %u on kept-alive connections")
+LOG_MESSAGE(WAKE_DNS, INFO, "DNS: %u cached, %u looked up")
+LOG_MESSAGE(WAKE_TLS, INFO, "TLS: %u handshakes (%u resumed), %u ms, ~%u ms saved")
+LOG_MESSAGE(WEATHER_MODEL_WRITE_FAILED, WARN, "Failed to write weather model")
+LOG_MESSAGE(TIMEZONE_RULE_INVALID, WARN, "Invalid or unsupported time zone rule: %s")
+LOG_MESSAGE(CONFIG_VALUE_TOO_LONG, WARN, "Config value of %u bytes rejected, the field holds %u")
+LOG_MESSAGE(REFRESH_TOKEN_TOO_LONG, ERROR, "Refresh token of %u bytes rejected, at most %u are kept")
+LOG_MESSAGE(REFRESH_TOKEN_WRITE_FAILED, ERROR, "Failed to write refresh token")
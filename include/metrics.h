@@ -0,0 +1,48 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+
+// Wake-cycle instrumentation.
+// Each wake is split into phases timed with esp_timer. At the end of the wake
+// the phase times are converted to an energy estimate with the current-draw
+// model below and printed with the wake-to-sleep time, and per-kind running
+// totals are kept in RTC memory. Cold boots (power-on, reset) are marked, as
+// they take the longer path with the splash screen and setup portal.
+// Deadline budget overruns (see wake_budget.h), and HTTP requests, DNS
+// lookups and TLS handshakes (see net_session.h), are counted alongside.
+
+// Approximate supply current per activity (mA)
+#define CURRENT_CPU_ACTIVE_MA 40.0f
+#define CURRENT_WIFI_EXTRA_MA 90.0f
+#define CURRENT_PANEL_REFRESH_EXTRA_MA 8.0f
+#define CURRENT_DEEP_SLEEP_MA 0.15f
+
+enum WakePhase {
+  PHASE_BOOT,
+  PHASE_WIFI,
+  PHASE_FETCH,
+  PHASE_RENDER,
+  PHASE_REFRESH,
+  PHASE_COUNT
+};
+
+enum WakeKind {
+  WAKE_DATA,
+  WAKE_TICK,
+  WAKE_KIND_COUNT
+};
+
+// Function declarations
+void metricsBeginWake(WakeKind kind, bool coldBoot);
+void metricsStart(WakePhase phase);
+void metricsStop(WakePhase phase);
+void metricsOverrun(uint32_t overMs);
+void metricsRequest(bool reused);
+void metricsDnsLookup(bool cached);
+void metricsHandshake(bool resumed, uint32_t ms, uint32_t savedMs);
+uint32_t metricsPhaseMs(WakePhase phase);
+float metricsWakeEnergyMas();
+void metricsReport();
+
+#endif // METRICS_H
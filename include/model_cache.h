@@ -0,0 +1,85 @@
+#ifndef MODEL_CACHE_H
+#define MODEL_CACHE_H
+
+#include <Arduino.h>
+#include "weather.h"
+#include "calendar.h"
+#include "civil_time.h"
+
+// Number of upcoming events kept for the clock widget
+#define CACHED_EVENT_COUNT 8
+#define CACHED_TITLE_LENGTH 40
+#define CACHED_LOCATION_LENGTH 32
+// Data older than this is drawn with an "as of" marker
+#define MODEL_STALE_AFTER_S (45 * 60)
+
+// Weather is refetched once the cached model is this old, or once it covers
+// fewer hours ahead than the horizon. In between, the forecast window slides
+// along the cached hours.
+#ifndef WEATHER_MAX_AGE_S
+#define WEATHER_MAX_AGE_S (3 * 60 * 60)
+#endif
+#ifndef FORECAST_MIN_HORIZON_S
+#define FORECAST_MIN_HORIZON_S (12 * 60 * 60)
+#endif
+// Weather only counts as stale once a due refetch has been missed
+#define WEATHER_STALE_AFTER_S (WEATHER_MAX_AGE_S + MODEL_STALE_AFTER_S)
+// Likewise the calendar, whose fetches the battery policy may space hours
+// apart (calendarIntervalS, 0 for every data wake)
+#define CALENDAR_STALE_AFTER_S(intervalS) ((time_t)(intervalS) + MODEL_STALE_AFTER_S)
+
+// Compact copy of an event that fits in RTC memory
+struct CachedEvent {
+  time_t startTime;
+  time_t endTime;
+  bool isAllDay;
+  char title[CACHED_TITLE_LENGTH];
+  char location[CACHED_LOCATION_LENGTH];
+};
+
+// What the clock widget needs between data wakes
+struct WidgetModel {
+  time_t fetchedAt;
+  uint8_t eventCount;
+  CachedEvent events[CACHED_EVENT_COUNT];
+};
+
+// One forecast hour in four bytes
+struct PackedHour {
+  int16_t temperature;    // tenths of a degree
+  uint8_t precipitation;  // percent
+  uint8_t icon;           // icon number * 2, +1 for night; 0 = none
+};
+
+// Last good weather, kept in flash. Rendered between fetches and while the
+// weather endpoint is failing.
+struct WeatherModel {
+  time_t fetchedAt;
+  time_t timestamp;
+  char location[32];
+  char description[32];
+  char iconCode[4];
+  char windDirection[4];
+  float temperature;
+  float feelsLike;
+  float windSpeed;
+  int16_t humidity;
+  int16_t pressure;
+  int16_t uvIndex;
+  time_t firstHour;       // timestamp of hourly[0]; entries are an hour apart
+  uint8_t hourCount;
+  PackedHour hourly[HOURLY_FORECAST_COUNT];
+};
+
+// Function declarations
+void buildWidgetModel(const CalendarEvents &events, time_t now, WidgetModel &model);
+void cacheWidgetModel(const CalendarEvents &events, time_t now);
+bool loadWidgetModel(WidgetModel &model);
+time_t loadCachedEvents(CalendarEvents &events);
+void cacheWeatherModel(const WeatherData &currentWeather, const HourlyForecast hourlyForecast[], time_t now);
+time_t loadWeatherModel(WeatherData &currentWeather, HourlyForecast hourlyForecast[], time_t now);
+bool weatherRefreshDue(time_t now);
+bool calendarRefreshDue(time_t now, uint32_t interval);
+int forecastHourAt(const HourlyForecast hourlyForecast[], time_t now);
+
+#endif // MODEL_CACHE_H
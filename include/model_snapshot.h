@@ -0,0 +1,46 @@
+#ifndef MODEL_SNAPSHOT_H
+#define MODEL_SNAPSHOT_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "weather.h"
+#include "calendar.h"
+
+// Everything the weather pane is drawn from
+struct WeatherSnapshot {
+  WeatherData current;
+  HourlyForecast hourly[HOURLY_FORECAST_COUNT];
+  time_t fetchedAt;
+  bool valid;
+};
+
+// Double-buffered model. The producer fills the back copy in place, e.g.
+// while parsing a response, and publish() swaps it to the front with one
+// atomic store, so a reader on another task only ever sees a complete
+// snapshot. Each copy is written at most once per publish: a producer must
+// not start on the back copy again while a reader may still hold it.
+template <typename T>
+class SnapshotBuffer {
+public:
+  SnapshotBuffer() : _front(-1) {}
+
+  T &back() {
+    return _slots[_front.load(std::memory_order_relaxed) == 0 ? 1 : 0];
+  }
+
+  void publish() {
+    _front.store(_front.load(std::memory_order_relaxed) == 0 ? 1 : 0, std::memory_order_release);
+  }
+
+  // The last published snapshot, nullptr before the first publish
+  const T *front() const {
+    int8_t front = _front.load(std::memory_order_acquire);
+    return front >= 0 ? &_slots[front] : nullptr;
+  }
+
+private:
+  T _slots[2];
+  std::atomic<int8_t> _front;
+};
+
+#endif // MODEL_SNAPSHOT_H
@@ -0,0 +1,47 @@
+#ifndef NET_SESSION_H
+#define NET_SESSION_H
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+
+// Connection state kept across deep sleep.
+// Resolved addresses (for their DNS TTL) and TLS sessions (for an
+// abbreviated handshake) are kept per host in RTC memory, so a wake that
+// talks to the same APIs as the last one skips the DNS round trip and most
+// of the TLS handshake. Whenever a cached entry does not work out, the
+// connection is retried the full way and the entry is dropped. Handshake
+// counts and the time saved are reported with the wake metrics.
+//
+// Within a wake, connections are pooled per host and kept alive between
+// requests, so a run of requests to one API shares a socket and TLS
+// context. A connection is only handed on once its last response has been
+// read to the end (keepConnection()); the pool is closed before sleep.
+
+// Hosts with a cached address
+#define DNS_CACHE_HOSTS 4
+// Longest host name cached; longer names are always looked up
+#define NET_HOST_LENGTH 40
+// Cap on a DNS record's TTL, and the TTL assumed when none is known (s)
+#define DNS_MAX_TTL_S (24 * 60 * 60)
+#define DNS_DEFAULT_TTL_S (10 * 60)
+// Time to wait for the DNS server before falling back to the system resolver (ms)
+#define DNS_QUERY_TIMEOUT_MS 1500
+
+// Hosts with a cached TLS session
+#define TLS_SESSION_SLOTS 3
+// Serialized session size (session ID, master secret and ticket); sessions
+// that do not fit are not kept
+#define TLS_SESSION_BYTES 384
+// Sessions older than this are not offered; servers expire them anyway (s)
+#define TLS_SESSION_MAX_AGE_S (12 * 60 * 60)
+
+// Connections kept open within a wake. Each idle TLS connection holds its
+// mbedtls buffers, so the least recently used one is closed beyond this.
+#define NET_POOL_CONNECTIONS 2
+
+// Function declarations
+HTTPClient &beginRequest(const String &url);
+void keepConnection(HTTPClient &http);
+void closeConnections();
+
+#endif // NET_SESSION_H
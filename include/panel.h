@@ -0,0 +1,102 @@
+#ifndef PANEL_H
+#define PANEL_H
+
+#include <Arduino.h>
+#include <type_traits>
+#include <GxEPD2_BW.h>
+#include <GxEPD2_3C.h>
+
+// Panel wiring on the ESP32 e-Paper driver board
+#define EPD_PIN_CS 15
+#define EPD_PIN_DC 27
+#define EPD_PIN_RST 26
+#define EPD_PIN_BUSY 25
+
+// Panel traits.
+// Each supported e-paper module gets one traits struct describing its driver
+// and geometry. Everything is constexpr so the renderer, which is templated on
+// the traits, compiles to straight-line code for the selected panel.
+//
+//   Driver          GxEPD2 driver class
+//   WIDTH/HEIGHT    native resolution in landscape orientation
+//   COLOR_PLANES    1 = black/white, 2 = black/white + red
+//   PARTIAL_REFRESH panel supports fast partial window updates
+//   FAST_FULL_REFRESH driver has selectFastFullUpdate() for a quicker full refresh
+//   PAGE_HEIGHT     rows buffered per page (== HEIGHT means a full frame buffer)
+//   ROTATION        GFX rotation that puts the panel in landscape
+
+// Waveshare 7.5" V2, 800x480 black/white
+struct Panel750T7 {
+  typedef GxEPD2_750_T7 Driver;
+  static constexpr int16_t WIDTH = 800;
+  static constexpr int16_t HEIGHT = 480;
+  static constexpr uint8_t COLOR_PLANES = 1;
+  static constexpr bool PARTIAL_REFRESH = Driver::hasFastPartialUpdate;
+  static constexpr bool FAST_FULL_REFRESH = false;
+  static constexpr uint16_t PAGE_HEIGHT = HEIGHT;
+  static constexpr uint8_t ROTATION = 0;
+};
+
+// Good Display GDEY075T7, 800x480 black/white
+struct Panel750GDEY075T7 {
+  typedef GxEPD2_750_GDEY075T7 Driver;
+  static constexpr int16_t WIDTH = 800;
+  static constexpr int16_t HEIGHT = 480;
+  static constexpr uint8_t COLOR_PLANES = 1;
+  static constexpr bool PARTIAL_REFRESH = Driver::hasFastPartialUpdate;
+  static constexpr bool FAST_FULL_REFRESH = true;
+  static constexpr uint16_t PAGE_HEIGHT = HEIGHT;
+  static constexpr uint8_t ROTATION = 0;
+};
+
+// Waveshare 7.5" (B) V2, 800x480 black/white/red
+struct Panel750Z08 {
+  typedef GxEPD2_750c_Z08 Driver;
+  static constexpr int16_t WIDTH = 800;
+  static constexpr int16_t HEIGHT = 480;
+  static constexpr uint8_t COLOR_PLANES = 2;
+  static constexpr bool PARTIAL_REFRESH = Driver::hasFastPartialUpdate;
+  static constexpr bool FAST_FULL_REFRESH = false;
+  static constexpr uint16_t PAGE_HEIGHT = HEIGHT / 3;
+  static constexpr uint8_t ROTATION = 0;
+};
+
+// Waveshare 7.5" HD (B), 880x528 black/white/red
+struct Panel750Z90 {
+  typedef GxEPD2_750c_Z90 Driver;
+  static constexpr int16_t WIDTH = 880;
+  static constexpr int16_t HEIGHT = 528;
+  static constexpr uint8_t COLOR_PLANES = 2;
+  static constexpr bool PARTIAL_REFRESH = Driver::hasFastPartialUpdate;
+  static constexpr bool FAST_FULL_REFRESH = false;
+  static constexpr uint16_t PAGE_HEIGHT = HEIGHT / 3;
+  static constexpr uint8_t ROTATION = 0;
+};
+
+// GxEPD2 display class for a panel: GxEPD2_3C when it has a red plane
+template <typename Panel>
+using PanelDisplay = typename std::conditional<
+    (Panel::COLOR_PLANES > 1),
+    GxEPD2_3C<typename Panel::Driver, Panel::PAGE_HEIGHT>,
+    GxEPD2_BW<typename Panel::Driver, Panel::PAGE_HEIGHT>>::type;
+
+// Accent color: red where the panel has a red plane, black otherwise
+template <typename Panel>
+constexpr uint16_t panelAccentColor() {
+  return Panel::COLOR_PLANES > 1 ? GxEPD_RED : GxEPD_BLACK;
+}
+
+// Panel selected at build time (see build_flags in platformio.ini)
+#if defined(PANEL_750C_Z90)
+typedef Panel750Z90 ActivePanel;
+#elif defined(PANEL_750_GDEY075T7)
+typedef Panel750GDEY075T7 ActivePanel;
+#elif defined(PANEL_750C_Z08)
+typedef Panel750Z08 ActivePanel;
+#else
+typedef Panel750T7 ActivePanel;
+#endif
+
+typedef PanelDisplay<ActivePanel> ActiveDisplay;
+
+#endif // PANEL_H
@@ -0,0 +1,50 @@
+#ifndef REFRESH_POLICY_H
+#define REFRESH_POLICY_H
+
+#include <Arduino.h>
+
+// Partial updates a region may take before it needs a cleaning refresh
+#define REFRESH_PARTIAL_BUDGET 45
+// Fast full refreshes allowed between two real full refreshes
+#define REFRESH_FAST_FULL_BUDGET 3
+// Quiet hours (local time): clean the panel with a real full refresh
+// whenever it has any ghosting debt, since nobody is watching it flash
+#define REFRESH_QUIET_START_HOUR 1
+#define REFRESH_QUIET_END_HOUR 5
+
+// Screen regions tracked separately by the policy
+enum RefreshRegion {
+  REGION_SCREEN,
+  REGION_CLOCK,
+  REGION_COUNT
+};
+
+// Refresh modes, cheapest first
+enum RefreshMode {
+  REFRESH_PARTIAL,
+  REFRESH_FAST_FULL,
+  REFRESH_FULL
+};
+
+// Tunable thresholds, defaulting to the values above
+struct RefreshPolicyConfig {
+  uint16_t partialBudget;
+  uint8_t fastFullBudget;
+  uint8_t quietStartHour;
+  uint8_t quietEndHour;
+};
+
+const RefreshPolicyConfig DEFAULT_REFRESH_POLICY = {
+  REFRESH_PARTIAL_BUDGET,
+  REFRESH_FAST_FULL_BUDGET,
+  REFRESH_QUIET_START_HOUR,
+  REFRESH_QUIET_END_HOUR
+};
+
+// Function declarations
+void setRefreshPolicyConfig(const RefreshPolicyConfig &policyConfig);
+RefreshMode chooseRefresh(RefreshRegion region, time_t now);
+void recordRefresh(RefreshRegion region, RefreshMode mode);
+const char *refreshModeName(RefreshMode mode);
+
+#endif // REFRESH_POLICY_H
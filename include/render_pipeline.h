@@ -0,0 +1,31 @@
+#ifndef RENDER_PIPELINE_H
+#define RENDER_PIPELINE_H
+
+#include <Arduino.h>
+#include "model_snapshot.h"
+
+// Fetch/render pipeline.
+// Each data source fills the back copy of its double-buffered snapshot and
+// publishes it when done, whether from the network or the cache. Publishing
+// the weather starts its pane stage, rasterizing the forecast chart, on a
+// task of its own, so the chart is drawn while the calendar request is
+// still waiting on the network. The calendar pane is plain text and has no
+// stage of its own. updateDisplay() joins the stages and composites both
+// panes into the frame that goes to the panel. The stages read the time
+// zone table, so it must not be rebuilt while one is running.
+
+// Pane stage task; the chart rasterizer needs well under 2 KB of stack
+#define PANE_TASK_STACK 4096
+#define PANE_TASK_PRIORITY 1
+
+// Function declarations
+WeatherSnapshot &beginWeatherSnapshot();
+void publishWeatherSnapshot();
+CalendarEvents &beginCalendarSnapshot();
+void publishCalendarSnapshot();
+void waitForPanes();
+void finishPanes(time_t now, bool redraw);
+const WeatherSnapshot &weatherSnapshot();
+const CalendarEvents &calendarSnapshot();
+
+#endif // RENDER_PIPELINE_H
@@ -0,0 +1,634 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <Arduino.h>
+#include <type_traits>
+#include "panel.h"
+#include <Fonts/FreeMonoBold9pt7b.h>
+#include <Fonts/FreeMonoBold12pt7b.h>
+#include <Fonts/FreeMonoBold18pt7b.h>
+#include <Fonts/FreeMonoBold24pt7b.h>
+#include "weather.h"
+#include "calendar.h"
+#include "model_cache.h"
+#include "refresh_policy.h"
+#include "civil_time.h"
+#include "asset_bundle.h"
+#include "layout.h"
+#include "chart.h"
+
+// A font from the asset bundle, falling back to the compiled-in one
+#define BUNDLED_FONT(font) assetFont(#font, &font)
+
+// Renderer specialised for one panel type.
+// Geometry comes from the layout resolved for the panel size, and colors from
+// the panel traits, all as compile-time constants, so each build contains
+// only the drawing code for its own panel. The
+// renderer only holds a reference to the display it draws on, so several
+// instances can render concurrently (see server/).
+template <typename Panel>
+struct Renderer {
+  typedef PanelDisplay<Panel> Display;
+  // The drawing functions only use the GFX API, so they draw on the paged
+  // display or on one band of a frame alike
+  typedef Adafruit_GFX Canvas;
+  typedef Layout<Panel::WIDTH, Panel::HEIGHT> L;
+
+  static constexpr int16_t WIDTH = Panel::WIDTH;
+  static constexpr int16_t HEIGHT = Panel::HEIGHT;
+  static constexpr int16_t SPLIT = L::SPLIT;
+  static constexpr uint16_t ACCENT = panelAccentColor<Panel>();
+
+  // The forecast chart rasterized ahead of the frame it is blitted into, so
+  // it can be done while other data is still being fetched and is not
+  // redone for every page of a paged display
+  struct ForecastRaster {
+    uint8_t *bits;
+    ForecastChart chart;
+
+    ForecastRaster() : bits(nullptr) {}
+    ~ForecastRaster() { free(bits); }
+    ForecastRaster(const ForecastRaster &) = delete;
+    ForecastRaster &operator=(const ForecastRaster &) = delete;
+  };
+
+  static void init(Display &display, bool initial);
+  static void startupScreen(Display &display);
+  static void wifiSetupScreen(Display &display);
+  static void replaceBatteryScreen(Display &display);
+  static void splitScreenLayout(Canvas &display, int batteryPercent = -1);
+  static void weatherData(Canvas &display, const WeatherData &currentWeather, const ForecastRaster &forecast);
+  static void calendarEvents(Canvas &display, const CalendarEvents &events);
+  static bool rasterizeForecast(ForecastRaster &forecast, const HourlyForecast hourlyForecast[], time_t now);
+  static void forecastChart(Canvas &display, const ForecastRaster &forecast);
+  static void weatherIcon(Canvas &display, int x, int y, int size, const String &iconCode);
+  static void batteryStatus(Canvas &display, int x, int y, int percent);
+  static void staleMarkers(Canvas &display, time_t now, time_t weatherAsOf, time_t calendarAsOf,
+                           uint32_t calendarIntervalS = 0);
+  static void staleMarker(Canvas &display, int16_t x, time_t now, time_t asOf, time_t staleAfter);
+  static bool staleText(char *marker, size_t size, time_t now, time_t asOf, time_t staleAfter);
+  static void clockWidget(Canvas &display, time_t now, const WidgetModel &model);
+  static bool clockText(char *date, size_t dateSize, char *line, size_t lineSize, time_t now, const WidgetModel &model);
+  static void refreshClockWidget(Display &display, time_t now, const WidgetModel &model);
+  static uint32_t clockKey(time_t now, const WidgetModel &model);
+  static RegionKeys contentKeys(const WeatherData &currentWeather, const HourlyForecast hourlyForecast[], const CalendarEvents &events,
+                                const WidgetModel &model, time_t now, time_t weatherAsOf, time_t calendarAsOf,
+                                int batteryPercent = -1, uint32_t calendarIntervalS = 0);
+  static void beginFrame(Display &display, RefreshMode mode, const Rect &window = L::SCREEN);
+  static void refreshFrameRows(Display &display, RefreshMode mode, int16_t y, int16_t count);
+
+  // selectFastFullUpdate() only exists on drivers that support it
+  static void selectFastFull(Display &display, bool fast, std::true_type) {
+    display.epd2.selectFastFullUpdate(fast);
+  }
+  static void selectFastFull(Display &, bool, std::false_type) {}
+
+  // Bytes per row of a 1bpp frame (MSB first, 1 = white)
+  static constexpr int16_t FRAME_STRIDE = (WIDTH + 7) / 8;
+
+  // Write rows of a 1bpp frame straight into the controller RAM
+  static void writeFrameRows(Display &display, const uint8_t *rows, int16_t y, int16_t count) {
+    writeFrameRows(display, rows, y, count, std::integral_constant<bool, (Panel::COLOR_PLANES > 1)>());
+  }
+  static void writeFrameRows(Display &display, const uint8_t *rows, int16_t y, int16_t count, std::false_type) {
+    display.writeImage(rows, 0, y, WIDTH, count);
+  }
+  static void writeFrameRows(Display &display, const uint8_t *rows, int16_t y, int16_t count, std::true_type) {
+    // Three-color panels get an empty red plane alongside the frame
+    static uint8_t noRed[FRAME_STRIDE * 16];
+    memset(noRed, 0xFF, sizeof(noRed));
+    for (int16_t done = 0; done < count; done += 16) {
+      int16_t n = min<int16_t>(16, count - done);
+      display.writeImage(rows + done * FRAME_STRIDE, noRed, 0, y + done, WIDTH, n);
+    }
+  }
+
+  // Write the same rows into the previous-image RAM after they were
+  // refreshed, as GxEPD2's nextPage() does, so the next partial refresh is
+  // diffed against what the panel shows. Only panels with fast partial
+  // refresh keep a previous image.
+  static void writeFrameRowsAgain(Display &display, const uint8_t *rows, int16_t y, int16_t count) {
+    writeFrameRowsAgain(display, rows, y, count, std::integral_constant<bool, (Panel::COLOR_PLANES == 1 && Panel::PARTIAL_REFRESH)>());
+  }
+  static void writeFrameRowsAgain(Display &display, const uint8_t *rows, int16_t y, int16_t count, std::true_type) {
+    display.epd2.writeImageAgain(rows, 0, y, WIDTH, count);
+  }
+  static void writeFrameRowsAgain(Display &, const uint8_t *, int16_t, int16_t, std::false_type) {}
+};
+
+// Initialize the E-Ink display. A warm init keeps the panel content so a
+// partial refresh can be applied on top of it after deep sleep.
+template <typename Panel>
+void Renderer<Panel>::init(Display &display, bool initial) {
+  display.init(0, initial);
+  display.setRotation(Panel::ROTATION); // Landscape mode
+  display.setTextColor(GxEPD_BLACK);
+  display.setFullWindow();
+}
+
+// Display startup screen
+template <typename Panel>
+void Renderer<Panel>::startupScreen(Display &display) {
+  display.firstPage();
+  do {
+    display.fillScreen(GxEPD_WHITE);
+    display.setFont(BUNDLED_FONT(FreeMonoBold18pt7b));
+    display.setCursor(50, HEIGHT / 2);
+    display.print("E-Ink Weather & Calendar");
+    display.setFont(BUNDLED_FONT(FreeMonoBold12pt7b));
+    display.setCursor(50, HEIGHT / 2 + 40);
+    display.print("Starting up...");
+  } while (display.nextPage());
+}
+
+// Display WiFi setup screen
+template <typename Panel>
+void Renderer<Panel>::wifiSetupScreen(Display &display) {
+  display.firstPage();
+  do {
+    display.fillScreen(GxEPD_WHITE);
+    display.setFont(BUNDLED_FONT(FreeMonoBold18pt7b));
+    display.setCursor(50, HEIGHT / 2 - 50);
+    display.print("WiFi Setup Mode");
+    display.setFont(BUNDLED_FONT(FreeMonoBold12pt7b));
+    display.setCursor(50, HEIGHT / 2);
+    display.print("Connect to WiFi network:");
+    display.setCursor(50, HEIGHT / 2 + 30);
+    display.print("EinkWeather_XXXXXX");
+    display.setCursor(50, HEIGHT / 2 + 60);
+    display.print("Then open: 192.168.4.1");
+  } while (display.nextPage());
+}
+
+// Left on the panel when the battery is about to brown out; it stays
+// readable with the ESP32 asleep for good
+template <typename Panel>
+void Renderer<Panel>::replaceBatteryScreen(Display &display) {
+  display.firstPage();
+  do {
+    display.fillScreen(GxEPD_WHITE);
+    display.setFont(BUNDLED_FONT(FreeMonoBold18pt7b));
+    display.setCursor(50, HEIGHT / 2 - 20);
+    display.print("Replace battery");
+    display.setFont(BUNDLED_FONT(FreeMonoBold12pt7b));
+    display.setCursor(50, HEIGHT / 2 + 20);
+    display.print("Updates resume after charging");
+    display.setCursor(50, HEIGHT / 2 + 50);
+    display.print("and pressing reset.");
+  } while (display.nextPage());
+}
+
+// Draw the split screen layout. batteryPercent is -1 without a battery.
+template <typename Panel>
+void Renderer<Panel>::splitScreenLayout(Canvas &display, int batteryPercent) {
+  display.fillScreen(GxEPD_WHITE);
+  
+  // Draw vertical divider line
+  display.drawLine(SPLIT, 0, SPLIT, HEIGHT, GxEPD_BLACK);
+  
+  // Draw headers
+  display.setFont(BUNDLED_FONT(FreeMonoBold12pt7b));
+  display.setCursor(L::WEATHER_TITLE_X, L::TITLE_BASELINE);
+  display.print("Weather");
+  
+  display.setCursor(L::CALENDAR_TITLE_X, L::TITLE_BASELINE);
+  display.print("Calendar");
+  
+  // Draw horizontal lines under headers
+  display.drawLine(L::MARGIN, L::HEADER.bottom(), SPLIT - L::MARGIN, L::HEADER.bottom(), ACCENT);
+  display.drawLine(SPLIT + L::MARGIN, L::HEADER.bottom(), WIDTH - L::MARGIN, L::HEADER.bottom(), ACCENT);
+  
+  // Draw battery status in top right corner
+  batteryStatus(display, L::BATTERY_X, L::BATTERY_BASELINE, batteryPercent);
+}
+
+// Draw weather data on the left side of the screen
+template <typename Panel>
+void Renderer<Panel>::weatherData(Canvas &display, const WeatherData &currentWeather, const ForecastRaster &forecast) {
+  // Draw location
+  display.setFont(BUNDLED_FONT(FreeMonoBold12pt7b));
+  display.setCursor(L::WEATHER_NOW.x, L::LOCATION_BASELINE);
+  display.print(currentWeather.location);
+  
+  // Draw current weather icon (large)
+  weatherIcon(display, L::NOW_ICON.x, L::NOW_ICON.y, L::NOW_ICON.w, currentWeather.iconCode);
+  
+  // Draw current temperature
+  display.setFont(BUNDLED_FONT(FreeMonoBold24pt7b));
+  display.setCursor(L::READINGS_X, L::TEMPERATURE_BASELINE);
+  display.print(String(currentWeather.temperature, 1));
+  display.print(" C");
+  
+  // Draw current weather details
+  display.setFont(BUNDLED_FONT(FreeMonoBold9pt7b));
+  int yPos = L::FIRST_READING_BASELINE;
+  display.setCursor(L::READINGS_X, yPos);
+  display.print("Feels like: ");
+  display.print(String(currentWeather.feelsLike, 1));
+  display.print(" C");
+  
+  yPos += L::READING_PITCH;
+  display.setCursor(L::READINGS_X, yPos);
+  display.print("Humidity: ");
+  display.print(currentWeather.humidity);
+  display.print("%");
+  
+  yPos += L::READING_PITCH;
+  display.setCursor(L::READINGS_X, yPos);
+  display.print("Wind: ");
+  display.print(String(currentWeather.windSpeed, 1));
+  display.print(" m/s");
+  
+  // Draw the forecast chart
+  display.setFont(BUNDLED_FONT(FreeMonoBold12pt7b));
+  display.setCursor(L::HOURLY.x, L::HOURLY_TITLE_BASELINE);
+  display.print("Next 48 Hours");
+  display.drawLine(L::HOURLY.x, L::HOURLY_RULE_Y, L::HOURLY.right(), L::HOURLY_RULE_Y, GxEPD_BLACK);
+  forecastChart(display, forecast);
+}
+
+// Rasterize the temperature and precipitation chart into a 1bpp bitmap. It
+// starts at the current hour so it slides along cached data between
+// fetches. Only touches the raster, so it may run on another task.
+template <typename Panel>
+bool Renderer<Panel>::rasterizeForecast(ForecastRaster &forecast, const HourlyForecast hourlyForecast[], time_t now) {
+  if (forecast.bits == nullptr) {
+    forecast.bits = (uint8_t *)malloc(((L::CHART.w + 7) / 8) * L::CHART.h);
+    if (forecast.bits == nullptr) {
+      return false;
+    }
+  }
+  ChartBitmap bitmap;
+  chartBegin(bitmap, forecast.bits, L::CHART.w, L::CHART.h);
+  if (!drawForecastChart(bitmap, hourlyForecast, forecastHourAt(hourlyForecast, now), forecast.chart)) {
+    free(forecast.bits);
+    forecast.bits = nullptr;
+    return false;
+  }
+  return true;
+}
+
+// Blit a rasterized chart and label its axes
+template <typename Panel>
+void Renderer<Panel>::forecastChart(Canvas &display, const ForecastRaster &forecast) {
+  if (forecast.bits == nullptr) {
+    return;
+  }
+  const ForecastChart &chart = forecast.chart;
+  display.drawBitmap(L::CHART.x, L::CHART.y, forecast.bits, L::CHART.w, L::CHART.h, GxEPD_BLACK);
+
+  // Temperatures right-aligned against the chart, centred on their gridlines
+  display.setFont(BUNDLED_FONT(FreeMonoBold9pt7b));
+  char label[8];
+  for (int i = 0; i < chart.temperature.tickCount; i++) {
+    int length = snprintf(label, sizeof(label), "%ld", lroundf(chart.temperature.ticks[i]));
+    display.setCursor(L::CHART.x - L::MARGIN / 2 - length * FONT_SMALL.advance, L::CHART.y + chart.tickY[i] + FONT_SMALL.ascent / 2);
+    display.print(label);
+  }
+
+  // Hours under their ticks; midnight shows the day instead
+  for (int i = 0; i < chart.timeTickCount; i++) {
+    struct tm timeinfo;
+    localTime(chart.timeTicks[i], timeinfo);
+    int length = strftime(label, sizeof(label), timeinfo.tm_hour == 0 ? "%a" : "%H", &timeinfo);
+    display.setCursor(L::CHART.x + chart.tickX[i] - length * FONT_SMALL.advance / 2, L::CHART_LABEL_BASELINE);
+    display.print(label);
+  }
+}
+
+// Draw calendar events on the right side of the screen
+template <typename Panel>
+void Renderer<Panel>::calendarEvents(Canvas &display, const CalendarEvents &events) {
+  // Get current time for highlighting today's events
+  time_t today = startOfDay(time(nullptr));
+  
+  // Date and next-meeting countdown are drawn by the clock widget above
+  
+  // Draw events
+  int yPos = L::FIRST_EVENT_BASELINE;
+  display.setFont(BUNDLED_FONT(FreeMonoBold9pt7b));
+  
+  if (events.events.empty()) {
+    display.setCursor(L::EVENT_TIME_X, yPos);
+    display.print("No upcoming events");
+  } else {
+    for (const auto &event : events.events) {
+      // Format event time
+      char startTimeStr[20], endTimeStr[20];
+      struct tm startTime, endTime;
+      localTime(event.startTime, startTime);
+      localTime(event.endTime, endTime);
+      
+      if (event.isAllDay) {
+        strcpy(startTimeStr, "All day");
+      } else {
+        strftime(startTimeStr, sizeof(startTimeStr), "%H:%M", &startTime);
+        strftime(endTimeStr, sizeof(endTimeStr), "%H:%M", &endTime);
+      }
+      
+      // Check if event is today
+      bool isToday = startOfDay(event.startTime) == today;
+      
+      // Draw event time
+      display.setCursor(L::EVENT_TIME_X, yPos);
+      if (event.isAllDay) {
+        display.print(startTimeStr);
+      } else {
+        display.print(startTimeStr);
+        display.print(" - ");
+        display.print(endTimeStr);
+      }
+      
+      // Draw event title
+      yPos += L::EVENT_TITLE_PITCH;
+      display.setCursor(L::EVENT_TEXT_X, yPos);
+      
+      // Highlight today's events
+      if (isToday) {
+        const Rect bar = L::highlight(yPos);
+        display.setTextColor(GxEPD_BLACK);
+        display.fillRect(bar.x, bar.y, bar.w, bar.h, ACCENT);
+        display.setTextColor(GxEPD_WHITE);
+      }
+      
+      // Truncate title to what fits across the pane
+      String title = event.title;
+      if (title.length() > (unsigned)L::EVENT_TEXT_CHARS) {
+        title = title.substring(0, L::EVENT_TEXT_CHARS - 3) + "...";
+      }
+      display.print(title);
+      
+      // Reset text color
+      if (isToday) {
+        display.setTextColor(GxEPD_BLACK);
+      }
+      
+      // Draw event location if available
+      if (!event.location.isEmpty()) {
+        yPos += L::EVENT_LOCATION_PITCH;
+        display.setCursor(L::EVENT_TEXT_X, yPos);
+        
+        // Truncate location to what fits across the pane
+        String location = event.location;
+        if (location.length() > (unsigned)L::EVENT_TEXT_CHARS) {
+          location = location.substring(0, L::EVENT_TEXT_CHARS - 3) + "...";
+        }
+        display.print(location);
+      }
+      
+      // Add separator line
+      yPos += L::EVENT_RULE_OFFSET;
+      display.drawLine(L::EVENT_TIME_X, yPos, L::EVENTS.right() - L::MARGIN, yPos, GxEPD_BLACK);
+      yPos += L::EVENT_GAP;
+      
+      // Check if we've reached the bottom of the display
+      if (yPos > L::LAST_EVENT_BASELINE) {
+        display.setCursor(L::EVENT_TIME_X, yPos);
+        display.print("+ more events");
+        break;
+      }
+    }
+  }
+}
+
+// Draw weather icon based on icon code
+template <typename Panel>
+void Renderer<Panel>::weatherIcon(Canvas &display, int x, int y, int size, const String &iconCode) {
+  // Icons come from the asset bundle's atlas for this size ("icons30x30")
+  char atlasName[ASSET_NAME_LENGTH];
+  snprintf(atlasName, sizeof(atlasName), "icons%dx%d", size, size);
+  IconAtlas atlas;
+  const uint8_t *bitmap = findIconAtlas(atlasName, atlas) ? atlasIcon(atlas, iconCode.c_str()) : nullptr;
+  if (bitmap != nullptr) {
+    display.drawBitmap(x, y, bitmap, atlas.width, atlas.height, GxEPD_BLACK);
+    return;
+  }
+  
+  // Without a bundle, draw a placeholder rectangle
+  display.drawRect(x, y, size, size, GxEPD_BLACK);
+  
+  // Draw icon code in the center for debugging
+  display.setFont(BUNDLED_FONT(FreeMonoBold9pt7b));
+  display.setCursor(x + size/4, y + size/2);
+  display.print(iconCode);
+}
+
+// Draw battery status indicator; nothing when running without a battery
+template <typename Panel>
+void Renderer<Panel>::batteryStatus(Canvas &display, int x, int y, int batteryPercentage) {
+  if (batteryPercentage < 0) {
+    return;
+  }
+
+  // Draw battery icon
+  display.drawRect(x, y - 10, 30, 15, GxEPD_BLACK);
+  display.fillRect(x + 30, y - 5, 3, 5, GxEPD_BLACK);
+  
+  // Fill battery based on percentage
+  int fillWidth = (batteryPercentage * 26) / 100;
+  display.fillRect(x + 2, y - 8, fillWidth, 11, GxEPD_BLACK);
+  
+  // Draw percentage text
+  display.setFont(BUNDLED_FONT(FreeMonoBold9pt7b));
+  display.setCursor(x - 40, y);
+  display.print(String(batteryPercentage) + "%");
+}
+
+// Flag panes drawn from cached data next to their headers. asOf is when the
+// data was fetched, 0 if there is none at all. Weather is normally rendered
+// from cache between fetches, and so is the calendar when the battery policy
+// spaces its fetches, so both get an allowance for their fetch interval.
+template <typename Panel>
+void Renderer<Panel>::staleMarkers(Canvas &display, time_t now, time_t weatherAsOf, time_t calendarAsOf,
+                                   uint32_t calendarIntervalS) {
+  staleMarker(display, L::WEATHER_STALE_X, now, weatherAsOf, WEATHER_STALE_AFTER_S);
+  staleMarker(display, L::CALENDAR_STALE_X, now, calendarAsOf, CALENDAR_STALE_AFTER_S(calendarIntervalS));
+}
+
+template <typename Panel>
+void Renderer<Panel>::staleMarker(Canvas &display, int16_t x, time_t now, time_t asOf, time_t staleAfter) {
+  char marker[24];
+  if (!staleText(marker, sizeof(marker), now, asOf, staleAfter)) {
+    return;
+  }
+
+  display.setFont(BUNDLED_FONT(FreeMonoBold9pt7b));
+  display.setTextColor(ACCENT);
+  display.setCursor(x, L::TITLE_BASELINE);
+  display.print(marker);
+  display.setTextColor(GxEPD_BLACK);
+}
+
+// Marker text for a pane fetched at asOf; false if the data is fresh
+template <typename Panel>
+bool Renderer<Panel>::staleText(char *marker, size_t size, time_t now, time_t asOf, time_t staleAfter) {
+  if (asOf == 0) {
+    snprintf(marker, size, "no data");
+  } else if (now - asOf >= staleAfter) {
+    struct tm timeinfo;
+    localTime(asOf, timeinfo);
+    strftime(marker, size, now - asOf < 24 * 60 * 60 ? "as of %H:%M" : "as of %b %d", &timeinfo);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Draw the date/time line and the countdown to the next meeting
+template <typename Panel>
+void Renderer<Panel>::clockWidget(Canvas &display, time_t now, const WidgetModel &model) {
+  display.fillRect(L::CLOCK.x, L::CLOCK.y, L::CLOCK.w, L::CLOCK.h, GxEPD_WHITE);
+
+  char dateStr[32];
+  char line[64];
+  bool soon = clockText(dateStr, sizeof(dateStr), line, sizeof(line), now, model);
+
+  display.setFont(BUNDLED_FONT(FreeMonoBold12pt7b));
+  display.setTextColor(GxEPD_BLACK);
+  display.setCursor(L::CLOCK_TEXT_X, L::DATE_BASELINE);
+  display.print(dateStr);
+
+  display.setFont(BUNDLED_FONT(FreeMonoBold9pt7b));
+  display.setTextColor(soon ? ACCENT : GxEPD_BLACK);
+  display.setCursor(L::CLOCK_TEXT_X, L::COUNTDOWN_BASELINE);
+  display.print(line);
+  display.setTextColor(GxEPD_BLACK);
+}
+
+// Date/time line and countdown line; true if the next meeting starts soon
+template <typename Panel>
+bool Renderer<Panel>::clockText(char *date, size_t dateSize, char *line, size_t lineSize, time_t now, const WidgetModel &model) {
+  struct tm timeinfo;
+  localTime(now, timeinfo);
+  strftime(date, dateSize, "%a, %b %d  %H:%M", &timeinfo);
+
+  // First timed event that has not finished yet
+  const CachedEvent *next = nullptr;
+  for (int i = 0; i < model.eventCount; i++) {
+    if (!model.events[i].isAllDay && model.events[i].endTime > now) {
+      next = &model.events[i];
+      break;
+    }
+  }
+
+  if (next == nullptr) {
+    snprintf(line, lineSize, "No more meetings");
+  } else if (next->startTime <= now) {
+    long minutesLeft = (next->endTime - now + 59) / 60;
+    snprintf(line, lineSize, "Now: %.22s (%ld min left)", next->title, minutesLeft);
+  } else {
+    long minutes = (next->startTime - now + 59) / 60;
+    if (minutes < 60) {
+      snprintf(line, lineSize, "Next: %.22s in %ld min", next->title, minutes);
+    } else {
+      snprintf(line, lineSize, "Next: %.22s in %ldh %02ldm", next->title, minutes / 60, minutes % 60);
+    }
+  }
+  return next != nullptr && next->startTime - now < 15 * 60;
+}
+
+// Push only the widget region with a fast partial refresh
+template <typename Panel>
+void Renderer<Panel>::refreshClockWidget(Display &display, time_t now, const WidgetModel &model) {
+  display.setPartialWindow(L::CLOCK.x, L::CLOCK.y, L::CLOCK.w, L::CLOCK.h);
+  display.firstPage();
+  do {
+    clockWidget(display, now, model);
+  } while (display.nextPage());
+}
+
+// Content keys of the clock widget: what its two lines currently say
+template <typename Panel>
+uint32_t Renderer<Panel>::clockKey(time_t now, const WidgetModel &model) {
+  char dateStr[32];
+  char line[64];
+  bool soon = clockText(dateStr, sizeof(dateStr), line, sizeof(line), now, model);
+  uint32_t key = contentHash(CONTENT_HASH_SEED, dateStr, strlen(dateStr));
+  key = contentHash(key, line, strlen(line));
+  return contentHash(key, soon);
+}
+
+// One key per layout region, built from exactly what the region would show.
+// A region whose key matches the one it was last drawn with needs no update.
+template <typename Panel>
+RegionKeys Renderer<Panel>::contentKeys(const WeatherData &currentWeather, const HourlyForecast hourlyForecast[], const CalendarEvents &events,
+                                        const WidgetModel &model, time_t now, time_t weatherAsOf, time_t calendarAsOf,
+                                        int batteryPercent, uint32_t calendarIntervalS) {
+  RegionKeys keys;
+  char marker[24];
+
+  // Header: stale markers and the battery gauge
+  uint32_t key = contentHash(CONTENT_HASH_SEED, (int32_t)batteryPercent);
+  if (staleText(marker, sizeof(marker), now, weatherAsOf, WEATHER_STALE_AFTER_S)) {
+    key = contentHash(key, marker, strlen(marker));
+  }
+  key = contentHash(key, '|');
+  if (staleText(marker, sizeof(marker), now, calendarAsOf, CALENDAR_STALE_AFTER_S(calendarIntervalS))) {
+    key = contentHash(key, marker, strlen(marker));
+  }
+  keys.keys[LAYOUT_HEADER] = key;
+
+  // Current conditions at the precision they are printed with
+  key = contentHash(CONTENT_HASH_SEED, weatherAsOf != 0);
+  if (weatherAsOf != 0) {
+    key = contentHash(key, currentWeather.location);
+    key = contentHash(key, currentWeather.iconCode);
+    key = contentHash(key, (int32_t)lroundf(currentWeather.temperature * 10));
+    key = contentHash(key, (int32_t)lroundf(currentWeather.feelsLike * 10));
+    key = contentHash(key, (int32_t)lroundf(currentWeather.windSpeed * 10));
+    key = contentHash(key, currentWeather.humidity);
+  }
+  keys.keys[LAYOUT_WEATHER_NOW] = key;
+
+  // The hours in the chart
+  key = contentHash(CONTENT_HASH_SEED, weatherAsOf != 0);
+  int first = weatherAsOf != 0 ? forecastHourAt(hourlyForecast, now) : -1;
+  for (int i = first; i >= 0 && i < HOURLY_FORECAST_COUNT && hourlyForecast[i].timestamp != 0; i++) {
+    key = contentHash(key, hourlyForecast[i].timestamp);
+    key = contentHash(key, hourlyForecast[i].temperature);
+    key = contentHash(key, hourlyForecast[i].precipitation);
+  }
+  keys.keys[LAYOUT_HOURLY] = key;
+
+  keys.keys[LAYOUT_CLOCK] = clockKey(now, model);
+
+  // Event list, including which events are highlighted as today's
+  time_t today = startOfDay(now);
+  key = contentHash(CONTENT_HASH_SEED, today);
+  for (const auto &event : events.events) {
+    key = contentHash(key, event.title);
+    key = contentHash(key, event.location);
+    key = contentHash(key, event.startTime);
+    key = contentHash(key, event.endTime);
+    key = contentHash(key, event.isAllDay);
+  }
+  keys.keys[LAYOUT_EVENTS] = key;
+  return keys;
+}
+
+// Set up the paged drawing window for an update in the given mode. A partial
+// refresh is limited to the window, normally the regions whose content changed.
+template <typename Panel>
+void Renderer<Panel>::beginFrame(Display &display, RefreshMode mode, const Rect &window) {
+  selectFastFull(display, mode == REFRESH_FAST_FULL, std::integral_constant<bool, Panel::FAST_FULL_REFRESH>());
+  if (mode == REFRESH_PARTIAL) {
+    display.setPartialWindow(window.x, window.y, window.w, window.h);
+  } else {
+    display.setFullWindow();
+  }
+  display.firstPage();
+}
+
+// Refresh rows already written with writeFrameRows(); a partial refresh is
+// limited to those rows
+template <typename Panel>
+void Renderer<Panel>::refreshFrameRows(Display &display, RefreshMode mode, int16_t y, int16_t count) {
+  if (mode == REFRESH_PARTIAL) {
+    display.refresh(0, y, WIDTH, count);
+    return;
+  }
+  selectFastFull(display, mode == REFRESH_FAST_FULL, std::integral_constant<bool, Panel::FAST_FULL_REFRESH>());
+  display.refresh(false);
+}
+
+#endif // RENDERER_H
@@ -0,0 +1,19 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+#include "metrics.h"
+
+// Interval between network fetches (seconds)
+#define DATA_INTERVAL_S (30 * 60)
+// Interval between clock widget ticks (seconds)
+#define TICK_INTERVAL_S 60
+
+// Function declarations
+WakeKind scheduleWake();
+WakeKind scheduleWakeAt(time_t now, bool fromDeepSleep);
+void markDataFetched(time_t now, bool allowTicks = true);
+uint64_t nextSleepDurationUs();
+uint64_t sleepDurationUs(int64_t nowUs);
+
+#endif // SCHEDULER_H
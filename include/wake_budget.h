@@ -0,0 +1,39 @@
+#ifndef WAKE_BUDGET_H
+#define WAKE_BUDGET_H
+
+#include <Arduino.h>
+
+// Wake-cycle deadline budget.
+// Every wake gets an upper bound on awake time, and each stage gets its own
+// sub-budget within it. Stages ask how much time they have left and bound
+// their blocking calls by it; HTTP bodies are cut off when it runs out (see
+// DeadlineStream), and the caller falls back to cached data. Stages that run
+// over are reported through metrics.
+
+// Whole-wake budgets (ms)
+#define BUDGET_DATA_WAKE_MS 45000
+#define BUDGET_TICK_WAKE_MS 5000
+
+// Stage sub-budgets (ms)
+#define BUDGET_CONNECT_MS 10000
+#define BUDGET_FETCH_MS 8000
+#define BUDGET_DRAW_MS 25000
+
+enum BudgetStage {
+  STAGE_CONNECT,
+  STAGE_WEATHER,
+  STAGE_CALENDAR,
+  STAGE_FRAME,
+  STAGE_DRAW,
+  STAGE_COUNT
+};
+
+// Function declarations
+void budgetBeginWake(uint32_t wakeMs);
+void budgetEndWake();
+bool budgetStart(BudgetStage stage);
+void budgetStop(BudgetStage stage);
+uint32_t budgetRemainingMs();
+bool budgetExpired();
+
+#endif // WAKE_BUDGET_H
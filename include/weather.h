@@ -18,6 +18,9 @@ struct WeatherData {
   time_t timestamp;
 };
 
+// OneCall returns 48 hourly entries; unused slots have a zero timestamp
+#define HOURLY_FORECAST_COUNT 48
+
 struct HourlyForecast {
   time_t timestamp;
   String iconCode;
@@ -28,5 +31,6 @@ struct HourlyForecast {
 // Function declarations
 bool getWeatherData(WeatherData &currentWeather, HourlyForecast hourlyForecast[]);
 bool getLocationFromIP(String &city, String &country);
+bool getTimeZoneFromIP(String &ianaName, int32_t &utcOffset);
 
 #endif // WEATHER_H
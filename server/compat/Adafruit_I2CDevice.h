@@ -0,0 +1,6 @@
+// Bus drivers are not used by the Linux frame server build; Adafruit GFX
+// includes this header unconditionally.
+#ifndef ADAFRUIT_I2CDEVICE_COMPAT_H
+#define ADAFRUIT_I2CDEVICE_COMPAT_H
+
+#endif // ADAFRUIT_I2CDEVICE_COMPAT_H
@@ -0,0 +1,99 @@
+#include "Arduino.h"
+#include <stdarg.h>
+#include <chrono>
+#include <thread>
+
+HardwareSerial Serial;
+
+static const auto startTime = std::chrono::steady_clock::now();
+
+unsigned long millis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+unsigned long micros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void delay(unsigned long ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void String::trim() {
+  size_t begin = _s.find_first_not_of(" \t\r\n");
+  if (begin == std::string::npos) {
+    _s.clear();
+    return;
+  }
+  size_t end = _s.find_last_not_of(" \t\r\n");
+  _s = _s.substr(begin, end - begin + 1);
+}
+
+std::string String::formatInteger(long long value, unsigned char base) {
+  char buffer[72];
+  if (base == 16) {
+    snprintf(buffer, sizeof(buffer), "%llx", (unsigned long long)value);
+  } else {
+    snprintf(buffer, sizeof(buffer), "%lld", value);
+  }
+  return buffer;
+}
+
+std::string String::formatFloat(double value, unsigned int decimals) {
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%.*f", (int)decimals, value);
+  return buffer;
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t n = 0;
+  while (n < size && write(buffer[n])) {
+    n++;
+  }
+  return n;
+}
+
+size_t Print::printf(const char *format, ...) {
+  char stackBuffer[256];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(stackBuffer, sizeof(stackBuffer), format, args);
+  va_end(args);
+  if (length < 0) {
+    return 0;
+  }
+  if ((size_t)length < sizeof(stackBuffer)) {
+    return write((const uint8_t *)stackBuffer, length);
+  }
+
+  std::string heapBuffer(length + 1, '\0');
+  va_start(args, format);
+  vsnprintf(&heapBuffer[0], heapBuffer.size(), format, args);
+  va_end(args);
+  return write((const uint8_t *)heapBuffer.data(), length);
+}
+
+// Host streams are fully buffered, so running dry means end of data
+size_t Stream::readBytes(char *buffer, size_t length) {
+  size_t count = 0;
+  while (count < length) {
+    int c = read();
+    if (c < 0) {
+      break;
+    }
+    buffer[count++] = (char)c;
+  }
+  return count;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  return fwrite(&c, 1, 1, stdout);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+  return fwrite(buffer, 1, size, stdout);
+}
+
+void HardwareSerial::flush() {
+  fflush(stdout);
+}
@@ -0,0 +1,155 @@
+// Minimal Arduino core for the Linux frame server build.
+// Provides just enough of String/Print/Stream and the timing helpers for the
+// shared renderer, the API clients, ArduinoJson and Adafruit GFX to compile
+// unchanged on the host.
+#ifndef ARDUINO_COMPAT_H
+#define ARDUINO_COMPAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+
+using std::max;
+using std::min;
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+// Firmware-only attributes are meaningless on the host
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+#define IRAM_ATTR
+#define PROGMEM
+#define F(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#define pgm_read_pointer(addr) ((void *)*(void **)(addr))
+
+// Reset causes of the firmware's esp_reset_reason(). Defined by whichever
+// host program links the RTC-state modules (the battery simulator plays
+// deep-sleep wakes through it).
+typedef enum {
+  ESP_RST_UNKNOWN,
+  ESP_RST_POWERON,
+  ESP_RST_EXT,
+  ESP_RST_SW,
+  ESP_RST_PANIC,
+  ESP_RST_INT_WDT,
+  ESP_RST_TASK_WDT,
+  ESP_RST_WDT,
+  ESP_RST_DEEPSLEEP,
+  ESP_RST_BROWNOUT,
+  ESP_RST_SDIO
+} esp_reset_reason_t;
+esp_reset_reason_t esp_reset_reason();
+
+#define DEC 10
+#define HEX 16
+
+typedef bool boolean;
+typedef uint8_t byte;
+class __FlashStringHelper;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+inline void yield() {}
+
+// String backed by std::string
+class String {
+public:
+  String() {}
+  String(const char *s) : _s(s ? s : "") {}
+  String(const std::string &s) : _s(s) {}
+  explicit String(char c) : _s(1, c) {}
+  explicit String(int value, unsigned char base = 10) : _s(formatInteger(value, base)) {}
+  explicit String(unsigned int value, unsigned char base = 10) : _s(formatInteger(value, base)) {}
+  explicit String(long value, unsigned char base = 10) : _s(formatInteger(value, base)) {}
+  explicit String(unsigned long value, unsigned char base = 10) : _s(formatInteger(value, base)) {}
+  explicit String(float value, unsigned int decimals = 2) : _s(formatFloat(value, decimals)) {}
+  explicit String(double value, unsigned int decimals = 2) : _s(formatFloat(value, decimals)) {}
+
+  const char *c_str() const { return _s.c_str(); }
+  unsigned int length() const { return _s.size(); }
+  bool isEmpty() const { return _s.empty(); }
+  bool reserve(unsigned int size) { _s.reserve(size); return true; }
+
+  char operator[](unsigned int i) const { return i < _s.size() ? _s[i] : 0; }
+  char charAt(unsigned int i) const { return (*this)[i]; }
+
+  String substring(unsigned int from) const { return from < _s.size() ? String(_s.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const {
+    return from < _s.size() && from < to ? String(_s.substr(from, to - from)) : String();
+  }
+  int indexOf(char c, unsigned int from = 0) const { return toIndex(_s.find(c, from)); }
+  int indexOf(const String &s, unsigned int from = 0) const { return toIndex(_s.find(s._s, from)); }
+  int lastIndexOf(char c) const { return toIndex(_s.rfind(c)); }
+  bool startsWith(const String &s) const { return _s.compare(0, s._s.size(), s._s) == 0; }
+  bool endsWith(const String &s) const {
+    return _s.size() >= s._s.size() && _s.compare(_s.size() - s._s.size(), s._s.size(), s._s) == 0;
+  }
+  bool equals(const String &s) const { return _s == s._s; }
+  bool equalsIgnoreCase(const String &s) const { return strcasecmp(_s.c_str(), s._s.c_str()) == 0; }
+  long toInt() const { return atol(_s.c_str()); }
+  float toFloat() const { return atof(_s.c_str()); }
+  void trim();
+
+  bool concat(const String &s) { _s += s._s; return true; }
+  bool concat(const char *s) { _s += s ? s : ""; return true; }
+  bool concat(const char *s, unsigned int n) { _s.append(s, n); return true; }
+  bool concat(char c) { _s += c; return true; }
+
+  String &operator=(const char *s) { _s = s ? s : ""; return *this; }
+  String &operator+=(const String &s) { _s += s._s; return *this; }
+  String &operator+=(const char *s) { concat(s); return *this; }
+  String &operator+=(char c) { _s += c; return *this; }
+  String &operator+=(int value) { _s += formatInteger(value, 10); return *this; }
+  String &operator+=(unsigned int value) { _s += formatInteger(value, 10); return *this; }
+  String &operator+=(long value) { _s += formatInteger(value, 10); return *this; }
+  String &operator+=(unsigned long value) { _s += formatInteger(value, 10); return *this; }
+
+  bool operator==(const String &s) const { return _s == s._s; }
+  bool operator==(const char *s) const { return _s == (s ? s : ""); }
+  bool operator!=(const String &s) const { return _s != s._s; }
+  bool operator!=(const char *s) const { return !(*this == s); }
+  bool operator<(const String &s) const { return _s < s._s; }
+
+  const std::string &str() const { return _s; }
+
+private:
+  static int toIndex(size_t pos) { return pos == std::string::npos ? -1 : (int)pos; }
+  static std::string formatInteger(long long value, unsigned char base);
+  static std::string formatFloat(double value, unsigned int decimals);
+
+  std::string _s;
+};
+
+inline String operator+(const String &a, const String &b) { String r(a); r += b; return r; }
+inline String operator+(const String &a, const char *b) { String r(a); r += b; return r; }
+inline String operator+(const char *a, const String &b) { String r(a); r += b; return r; }
+inline String operator+(const String &a, char b) { String r(a); r += b; return r; }
+
+#include "Print.h"
+
+// Serial writes to stdout
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long) {}
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  void flush() override;
+  operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
+
+#endif // ARDUINO_COMPAT_H
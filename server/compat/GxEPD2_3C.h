@@ -0,0 +1,13 @@
+// GxEPD2_3C stand-in for the Linux frame server build; frames are 1bpp
+#ifndef GXEPD2_3C_COMPAT_H
+#define GXEPD2_3C_COMPAT_H
+
+#include "GxEPD2_drivers.h"
+
+template <typename Driver, const uint16_t page_height>
+class GxEPD2_3C : public GxEPD2_CanvasDisplay<Driver> {
+public:
+  explicit GxEPD2_3C(Driver driver) : GxEPD2_CanvasDisplay<Driver>(driver) {}
+};
+
+#endif // GXEPD2_3C_COMPAT_H
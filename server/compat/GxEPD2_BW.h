@@ -0,0 +1,13 @@
+// GxEPD2_BW stand-in for the Linux frame server build
+#ifndef GXEPD2_BW_COMPAT_H
+#define GXEPD2_BW_COMPAT_H
+
+#include "GxEPD2_drivers.h"
+
+template <typename Driver, const uint16_t page_height>
+class GxEPD2_BW : public GxEPD2_CanvasDisplay<Driver> {
+public:
+  explicit GxEPD2_BW(Driver driver) : GxEPD2_CanvasDisplay<Driver>(driver) {}
+};
+
+#endif // GXEPD2_BW_COMPAT_H
@@ -0,0 +1,65 @@
+// Panel driver traits for the Linux frame server build.
+// Mirrors the static properties of the GxEPD2 driver classes named in
+// include/panel.h; there is no hardware behind them.
+#ifndef GXEPD2_DRIVERS_COMPAT_H
+#define GXEPD2_DRIVERS_COMPAT_H
+
+#include <Adafruit_GFX.h>
+
+#define GxEPD_BLACK 0x0000
+#define GxEPD_WHITE 0xFFFF
+#define GxEPD_RED 0xF800
+
+template <uint16_t W, uint16_t H, bool COLOR, bool FAST_PARTIAL>
+struct GxEPD2_CompatDriver {
+  static const uint16_t WIDTH = W;
+  static const uint16_t HEIGHT = H;
+  static const bool hasColor = COLOR;
+  static const bool hasPartialUpdate = FAST_PARTIAL;
+  static const bool hasFastPartialUpdate = FAST_PARTIAL;
+
+  GxEPD2_CompatDriver(int16_t, int16_t, int16_t, int16_t) {}
+  void selectFastFullUpdate(bool) {}
+};
+
+typedef GxEPD2_CompatDriver<800, 480, false, true> GxEPD2_750_T7;
+typedef GxEPD2_CompatDriver<800, 480, false, true> GxEPD2_750_GDEY075T7;
+typedef GxEPD2_CompatDriver<800, 480, true, false> GxEPD2_750c_Z08;
+typedef GxEPD2_CompatDriver<880, 528, true, false> GxEPD2_750c_Z90;
+
+// Frame buffer with the paged-drawing API of GxEPD2_BW/GxEPD2_3C.
+// GFXcanvas1 stores 1 for a set bit, and white is the only color that sets
+// bits, so buffer() has the same layout GxEPD2 writes to a B/W panel:
+// row-major, MSB first, 1 = white. Red is drawn as black.
+template <typename Driver>
+class GxEPD2_CanvasDisplay : public GFXcanvas1 {
+public:
+  Driver epd2;
+
+  explicit GxEPD2_CanvasDisplay(Driver driver) : GFXcanvas1(Driver::WIDTH, Driver::HEIGHT), epd2(driver) {}
+
+  void drawPixel(int16_t x, int16_t y, uint16_t color) override {
+    GFXcanvas1::drawPixel(x, y, color == GxEPD_WHITE ? 1 : 0);
+  }
+  void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) override {
+    GFXcanvas1::drawFastHLine(x, y, w, color == GxEPD_WHITE ? 1 : 0);
+  }
+  void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) override {
+    GFXcanvas1::drawFastVLine(x, y, h, color == GxEPD_WHITE ? 1 : 0);
+  }
+  void fillScreen(uint16_t color) override {
+    GFXcanvas1::fillScreen(color == GxEPD_WHITE ? 1 : 0);
+  }
+
+  void init(uint32_t = 0, bool = true, uint16_t = 10, bool = false) {}
+  void setFullWindow() {}
+  void setPartialWindow(uint16_t, uint16_t, uint16_t, uint16_t) {}
+  void firstPage() {}
+  bool nextPage() { return false; }
+  void hibernate() {}
+  void powerOff() {}
+
+  static constexpr size_t frameBytes() { return (Driver::WIDTH + 7) / 8 * Driver::HEIGHT; }
+};
+
+#endif // GXEPD2_DRIVERS_COMPAT_H
@@ -0,0 +1,123 @@
+#include "HTTPClient.h"
+#include <curl/curl.h>
+#include <mutex>
+
+static size_t appendBody(char *data, size_t size, size_t count, void *userdata) {
+  ((std::string *)userdata)->append(data, size * count);
+  return size * count;
+}
+
+static size_t collectHeader(char *data, size_t size, size_t count, void *userdata) {
+  std::map<std::string, std::string> &headers = *(std::map<std::string, std::string> *)userdata;
+  std::string line(data, size * count);
+  size_t colon = line.find(':');
+  if (colon != std::string::npos) {
+    String name(line.substr(0, colon));
+    String value(line.substr(colon + 1));
+    name.trim();
+    value.trim();
+    std::string key = name.str();
+    std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+    headers[key] = value.str();
+  }
+  return size * count;
+}
+
+bool HTTPClient::begin(const String &url) {
+  static std::once_flag curlInit;
+  std::call_once(curlInit, [] { curl_global_init(CURL_GLOBAL_DEFAULT); });
+
+  _url = url.str();
+  _requestHeaders.clear();
+  _responseHeaders.clear();
+  _body.assign(std::string());
+  return true;
+}
+
+void HTTPClient::end() {
+  _requestHeaders.clear();
+}
+
+void HTTPClient::addHeader(const String &name, const String &value, bool, bool) {
+  // libcurl handles content negotiation itself (CURLOPT_ACCEPT_ENCODING)
+  if (name.equalsIgnoreCase("Accept-Encoding")) {
+    return;
+  }
+  _requestHeaders.push_back(name.str() + ": " + value.str());
+}
+
+// All headers are collected; the key list is only needed on the device
+void HTTPClient::collectHeaders(const char *[], size_t) {}
+
+int HTTPClient::GET() {
+  return sendRequest("GET");
+}
+
+int HTTPClient::POST(const String &payload) {
+  return sendRequest("POST", payload);
+}
+
+int HTTPClient::sendRequest(const char *method, const String &payload) {
+  CURL *curl = curl_easy_init();
+  if (curl == nullptr) {
+    return HTTPC_ERROR_CONNECTION_REFUSED;
+  }
+
+  std::string body;
+  struct curl_slist *headers = nullptr;
+  for (const std::string &h : _requestHeaders) {
+    headers = curl_slist_append(headers, h.c_str());
+  }
+
+  curl_easy_setopt(curl, CURLOPT_URL, _url.c_str());
+  curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method);
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+  curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long)_timeoutMs);
+  curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, (long)_connectTimeoutMs);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, appendBody);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &body);
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, collectHeader);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, &_responseHeaders);
+  if (strcmp(method, "POST") == 0) {
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload.c_str());
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)payload.length());
+  }
+
+  CURLcode result = curl_easy_perform(curl);
+  long status = 0;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+  curl_slist_free_all(headers);
+  curl_easy_cleanup(curl);
+
+  if (result != CURLE_OK) {
+    return result == CURLE_OPERATION_TIMEDOUT ? HTTPC_ERROR_READ_TIMEOUT : HTTPC_ERROR_CONNECTION_REFUSED;
+  }
+  _body.assign(std::move(body));
+  return (int)status;
+}
+
+String HTTPClient::header(const char *name) {
+  std::string key(name);
+  std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+  auto it = _responseHeaders.find(key);
+  return it == _responseHeaders.end() ? String() : String(it->second);
+}
+
+bool HTTPClient::hasHeader(const char *name) {
+  return !header(name).isEmpty();
+}
+
+String HTTPClient::getString() {
+  String result;
+  int c;
+  while ((c = _body.read()) >= 0) {
+    result += (char)c;
+  }
+  return result;
+}
+
+String HTTPClient::errorToString(int error) {
+  return error == HTTPC_ERROR_READ_TIMEOUT ? String("read timeout") : String("connection failed");
+}
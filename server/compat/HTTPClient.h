@@ -0,0 +1,65 @@
+// HTTPClient for the Linux frame server build, implemented on libcurl.
+// Responses are buffered in memory; getStream() reads from that buffer.
+// libcurl negotiates and decodes gzip itself.
+#ifndef HTTPCLIENT_COMPAT_H
+#define HTTPCLIENT_COMPAT_H
+
+#include <Arduino.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#define HTTP_CODE_OK 200
+#define HTTP_CODE_NOT_MODIFIED 304
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+// Stream over a response body held in memory
+class BufferStream : public Stream {
+public:
+  void assign(std::string data) { _data = std::move(data); _pos = 0; }
+  int available() override { return _data.size() - _pos; }
+  int read() override { return _pos < _data.size() ? (uint8_t)_data[_pos++] : -1; }
+  int peek() override { return _pos < _data.size() ? (uint8_t)_data[_pos] : -1; }
+  size_t write(uint8_t) override { return 0; }
+
+private:
+  std::string _data;
+  size_t _pos = 0;
+};
+
+class HTTPClient {
+public:
+  bool begin(const String &url);
+  void end();
+
+  void useHTTP10(bool) {}
+  void setReuse(bool) {}
+  void setTimeout(uint16_t timeoutMs) { _timeoutMs = timeoutMs; }
+  void setConnectTimeout(int32_t timeoutMs) { _connectTimeoutMs = timeoutMs; }
+  void addHeader(const String &name, const String &value, bool first = false, bool replace = true);
+  void collectHeaders(const char *headerKeys[], size_t count);
+
+  int GET();
+  int POST(const String &payload);
+  int sendRequest(const char *method, const String &payload = String());
+
+  String header(const char *name);
+  bool hasHeader(const char *name);
+  int getSize() { return _body.available(); }
+  String getString();
+  Stream &getStream() { return _body; }
+  Stream *getStreamPtr() { return &_body; }
+
+  static String errorToString(int error);
+
+private:
+  std::string _url;
+  std::vector<std::string> _requestHeaders;
+  std::map<std::string, std::string> _responseHeaders;
+  BufferStream _body;
+  uint16_t _timeoutMs = 5000;
+  int32_t _connectTimeoutMs = 5000;
+};
+
+#endif // HTTPCLIENT_COMPAT_H
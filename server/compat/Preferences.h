@@ -0,0 +1,49 @@
+// The frame server keeps device configuration in its registry, not in NVS.
+// config.h and the model cache include this header. Entries live in memory
+// for the life of the process, which is enough for the model cache when the
+// battery simulator drives it; the frame server never stores anything.
+#ifndef PREFERENCES_COMPAT_H
+#define PREFERENCES_COMPAT_H
+
+#include <Arduino.h>
+#include <map>
+#include <vector>
+
+class Preferences {
+public:
+  bool begin(const char *name, bool = false) {
+    _entries = &store()[name];
+    return true;
+  }
+  void end() { _entries = nullptr; }
+  size_t getBytes(const char *key, void *buffer, size_t length) {
+    if (_entries == nullptr) {
+      return 0;
+    }
+    auto entry = _entries->find(key);
+    if (entry == _entries->end() || entry->second.size() > length) {
+      return 0;
+    }
+    memcpy(buffer, entry->second.data(), entry->second.size());
+    return entry->second.size();
+  }
+  size_t putBytes(const char *key, const void *value, size_t length) {
+    if (_entries == nullptr) {
+      return 0;
+    }
+    const uint8_t *bytes = (const uint8_t *)value;
+    (*_entries)[key].assign(bytes, bytes + length);
+    return length;
+  }
+
+private:
+  typedef std::map<std::string, std::vector<uint8_t>> Namespace;
+  static std::map<std::string, Namespace> &store() {
+    static std::map<std::string, Namespace> namespaces;
+    return namespaces;
+  }
+
+  Namespace *_entries = nullptr;
+};
+
+#endif // PREFERENCES_COMPAT_H
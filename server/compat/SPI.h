@@ -0,0 +1,6 @@
+// Bus drivers are not used by the Linux frame server build; Adafruit GFX
+// includes this header unconditionally.
+#ifndef SPI_COMPAT_H
+#define SPI_COMPAT_H
+
+#endif // SPI_COMPAT_H
@@ -0,0 +1,7 @@
+// Network status stubs for the Linux frame server build
+#ifndef WIFI_COMPAT_H
+#define WIFI_COMPAT_H
+
+#include <Arduino.h>
+
+#endif // WIFI_COMPAT_H
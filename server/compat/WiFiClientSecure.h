@@ -0,0 +1,7 @@
+// TLS is handled by libcurl in the Linux frame server build
+#ifndef WIFICLIENTSECURE_COMPAT_H
+#define WIFICLIENTSECURE_COMPAT_H
+
+#include <WiFi.h>
+
+#endif // WIFICLIENTSECURE_COMPAT_H
@@ -0,0 +1,6 @@
+// Bus drivers are not used by the Linux frame server build; Adafruit GFX
+// includes this header unconditionally.
+#ifndef WIRE_COMPAT_H
+#define WIRE_COMPAT_H
+
+#endif // WIRE_COMPAT_H
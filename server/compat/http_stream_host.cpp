@@ -0,0 +1,20 @@
+// Host implementation of the http_stream.h helpers. libcurl has already
+// decoded any Content-Encoding, so the buffered body is parsed directly.
+#include "http_stream.h"
+
+void prepareCompressedRequest(HTTPClient &) {}
+
+// The server has no wake budget; HTTPClient keeps its own timeouts
+void applyRequestDeadline(HTTPClient &) {}
+
+ContentEncoding responseEncoding(HTTPClient &) {
+  return ENCODING_IDENTITY;
+}
+
+DeserializationError deserializeResponse(HTTPClient &http, JsonDocument &doc) {
+  return deserializeJson(doc, http.getStream());
+}
+
+DeserializationError deserializeResponse(HTTPClient &http, JsonDocument &doc, DeserializationOption::Filter filter) {
+  return deserializeJson(doc, http.getStream(), filter);
+}
@@ -0,0 +1,14 @@
+// Host implementation of net_session.h. libcurl keeps its own DNS cache,
+// TLS sessions and connections, so requests go straight through. Each
+// thread gets its own client.
+#include "net_session.h"
+
+HTTPClient &beginRequest(const String &url) {
+  thread_local HTTPClient http;
+  http.begin(url);
+  return http;
+}
+
+void keepConnection(HTTPClient &) {}
+
+void closeConnections() {}
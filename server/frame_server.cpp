@@ -0,0 +1,310 @@
+// Frame server: renders display frames for a fleet of devices and serves
+// them over HTTP to firmware running in thin-client mode.
+//
+//   frame_server --registry devices.json [--port 8080] [--threads N] [--interval 300] [--assets assets.bin]
+//   frame_server --bench 2000 [--threads N] [--assets assets.bin]
+#include <Arduino.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "asset_bundle.h"
+#include "chart.h"
+#include "frame_codec.h"
+#include "frame_service.h"
+#include "mock_panel_bus.h"
+
+struct ServerOptions {
+  const char *registry = "devices.json";
+  int port = 8080;
+  unsigned threads = std::thread::hardware_concurrency();
+  unsigned interval = 300;
+  unsigned benchFrames = 0;
+  const char *assets = nullptr;
+};
+
+static bool parseOptions(int argc, char **argv, ServerOptions &options) {
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "--registry") == 0 && hasValue) {
+      options.registry = argv[++i];
+    } else if (strcmp(argv[i], "--port") == 0 && hasValue) {
+      options.port = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--threads") == 0 && hasValue) {
+      options.threads = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--interval") == 0 && hasValue) {
+      options.interval = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--bench") == 0 && hasValue) {
+      options.benchFrames = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--assets") == 0 && hasValue) {
+      options.assets = argv[++i];
+    } else {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return false;
+    }
+  }
+  if (options.threads == 0) {
+    options.threads = 1;
+  }
+  return true;
+}
+
+// Representative data for the benchmark: a full weather pane and a busy day
+static void fillBenchData(WeatherSnapshot &weather, CalendarEvents &events, time_t now) {
+  weather.current.location = "Amsterdam, NL";
+  weather.current.description = "light rain";
+  weather.current.iconCode = "10d";
+  weather.current.temperature = 12.4f;
+  weather.current.feelsLike = 10.9f;
+  weather.current.humidity = 81;
+  weather.current.windSpeed = 6.2f;
+  weather.current.pressure = 1011;
+  weather.current.uvIndex = 1;
+  weather.current.timestamp = now;
+  for (int i = 0; i < HOURLY_FORECAST_COUNT; i++) {
+    weather.hourly[i].timestamp = now + i * 3600;
+    weather.hourly[i].iconCode = i % 3 == 0 ? "10d" : "04d";
+    weather.hourly[i].temperature = 12.0f + (i % 6) * 0.7f;
+    weather.hourly[i].precipitation = (i * 17) % 100;
+  }
+  weather.fetchedAt = now;
+  weather.valid = true;
+
+  static const char *titles[] = {"Standup", "Design review", "1:1 with Sam", "Lunch",
+                                 "Sprint planning", "Customer call", "Focus time", "Retro"};
+  for (int i = 0; i < 8; i++) {
+    CalendarEvent event;
+    event.title = titles[i];
+    event.location = i % 2 == 0 ? "Room 4.12" : "";
+    event.startTime = now + i * 3600;
+    event.endTime = event.startTime + 1800;
+    event.isAllDay = false;
+    events.events.push_back(event);
+  }
+  events.lastUpdated = now;
+}
+
+// Band output modelled on the ESP32: GxEPD2 clocks SPI at 4 MHz, and
+// LittleFS reads back at about 1 MB/s
+#define BENCH_SPI_HZ 4000000
+#define BENCH_FLASH_BYTES_PER_S 1000000
+#define BENCH_BAND_ROWS 16
+
+// Push a frame to a mock panel in bands, as the thin client does: each band
+// is read from flash, then written out, either one after the other or with
+// the next read overlapping the last write. Returns the time taken (s).
+static double benchBandOutput(const Frame &frame, bool pipelined, bool &intact) {
+  int16_t stride = (frame.width + 7) / 8;
+  std::vector<uint8_t> first(stride * BENCH_BAND_ROWS), second(stride * BENCH_BAND_ROWS);
+  MockPanelBus bus(frame.width, frame.height, BENCH_SPI_HZ);
+  BandPipeline pipeline(bus, first.data(), second.data());
+
+  auto start = std::chrono::steady_clock::now();
+  for (int16_t y = 0; y < frame.height; y += BENCH_BAND_ROWS) {
+    int16_t rows = min<int16_t>(BENCH_BAND_ROWS, frame.height - y);
+    size_t length = (size_t)rows * stride;
+    std::this_thread::sleep_for(std::chrono::microseconds((uint64_t)length * 1000000 / BENCH_FLASH_BYTES_PER_S));
+    memcpy(pipeline.band(), frame.bits.data() + (size_t)y * stride, length);
+    pipeline.send(y, rows);
+    if (!pipelined) {
+      pipeline.finish();
+    }
+  }
+  pipeline.finish();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  intact = bus.ram() == frame.bits;
+  return seconds;
+}
+
+static int runBenchmark(const ServerOptions &options) {
+  time_t now = time(nullptr);
+  WeatherSnapshot weather;
+  CalendarEvents events;
+  fillBenchData(weather, events, now);
+
+  ThreadPool pool(options.threads);
+  std::atomic<uint32_t> checksum(0);
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < options.benchFrames; i++) {
+    pool.submit([&] {
+      std::shared_ptr<Frame> frame = FrameService::renderFrame(PANEL_MODEL_750_T7, weather, events, now);
+      checksum ^= frame->etag;
+    });
+  }
+  pool.waitIdle();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  double fps = options.benchFrames / seconds;
+  printf("Rendered %u frames (800x480) on %u threads in %.3f s\n", options.benchFrames, pool.size(), seconds);
+  printf("%.1f frames/s total, %.1f frames/s per core (checksum %08x)\n", fps, fps / pool.size(), (unsigned)checksum.load());
+
+  // Transfer sizes: a keyframe, and the delta for the next minute's frame
+  std::shared_ptr<Frame> first = FrameService::renderFrame(PANEL_MODEL_750_T7, weather, events, now);
+  std::shared_ptr<Frame> next = FrameService::renderFrame(PANEL_MODEL_750_T7, weather, events, now + 60);
+  std::vector<uint8_t> keyframe, delta;
+  encodeFrameDelta(nullptr, first->bits.data(), first->width, first->height, 0, first->etag, keyframe);
+  encodeFrameDelta(first->bits.data(), next->bits.data(), next->width, next->height, first->etag, next->etag, delta);
+  printf("Frame %u bytes, keyframe %u bytes, one-minute delta %u bytes\n",
+         (unsigned)first->bits.size(), (unsigned)keyframe.size(), (unsigned)delta.size());
+
+  // The forecast chart on its own, rasterized as the firmware does every wake
+  const unsigned chartRuns = 10000;
+  std::vector<uint8_t> chartBits((400 + 7) / 8 * 150);
+  ChartBitmap chartBitmap;
+  ForecastChart chart;
+  start = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < chartRuns; i++) {
+    chartBegin(chartBitmap, chartBits.data(), 400, 150);
+    drawForecastChart(chartBitmap, weather.hourly, 0, chart);
+  }
+  seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("Forecast chart (400x150, %u hours): %.1f us\n", chart.hourCount, seconds * 1e6 / chartRuns);
+
+  bool sequentialIntact, pipelinedIntact;
+  double sequential = benchBandOutput(*first, false, sequentialIntact);
+  double pipelined = benchBandOutput(*first, true, pipelinedIntact);
+  printf("Band output (%u-row bands, 4 MHz SPI): %.1f ms one after the other, %.1f ms pipelined%s\n", BENCH_BAND_ROWS,
+         sequential * 1e3, pipelined * 1e3, sequentialIntact && pipelinedIntact ? "" : " (FRAME MISMATCH)");
+  return sequentialIntact && pipelinedIntact ? 0 : 1;
+}
+
+static void sendAll(int fd, const char *data, size_t length) {
+  while (length > 0) {
+    ssize_t n = send(fd, data, length, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return;
+    }
+    data += n;
+    length -= n;
+  }
+}
+
+static void sendStatus(int fd, const char *status) {
+  char response[128];
+  int length = snprintf(response, sizeof(response), "HTTP/1.1 %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", status);
+  sendAll(fd, response, length);
+}
+
+static void sendFrame(int fd, const char *contentType, const char *etag, const Frame &frame,
+                      const uint8_t *body, size_t length) {
+  char header[256];
+  int headerLength = snprintf(header, sizeof(header),
+                              "HTTP/1.1 200 OK\r\n"
+                              "Content-Type: %s\r\n"
+                              "Content-Length: %u\r\n"
+                              "ETag: %s\r\n"
+                              "X-Frame-Width: %u\r\n"
+                              "X-Frame-Height: %u\r\n"
+                              "Connection: close\r\n\r\n",
+                              contentType, (unsigned)length, etag, frame.width, frame.height);
+  sendAll(fd, header, headerLength);
+  sendAll(fd, (const char *)body, length);
+}
+
+// GET /frame/<id>: 304 if If-None-Match matches. Otherwise the frame as raw
+// 1bpp rows, or as a delta against the If-None-Match frame when the client
+// accepts deltas (a keyframe if that frame is no longer known).
+static void handleConnection(int fd, FrameService &service) {
+  char request[2048];
+  ssize_t length = recv(fd, request, sizeof(request) - 1, 0);
+  if (length <= 0) {
+    return;
+  }
+  request[length] = '\0';
+
+  char method[8], path[256];
+  if (sscanf(request, "%7s %255s", method, path) != 2 || strcmp(method, "GET") != 0) {
+    sendStatus(fd, "405 Method Not Allowed");
+    return;
+  }
+  if (strncmp(path, "/frame/", 7) != 0) {
+    sendStatus(fd, "404 Not Found");
+    return;
+  }
+
+  std::shared_ptr<const Frame> frame = service.frame(path + 7);
+  if (!frame) {
+    sendStatus(fd, "404 Not Found");
+    return;
+  }
+
+  char etag[16];
+  snprintf(etag, sizeof(etag), "\"%08x\"", (unsigned)frame->etag);
+  const char *ifNoneMatch = strcasestr(request, "\r\nIf-None-Match:");
+  if (ifNoneMatch != nullptr && strstr(ifNoneMatch, etag) != nullptr) {
+    sendStatus(fd, "304 Not Modified");
+    return;
+  }
+
+  const char *accept = strcasestr(request, "\r\nAccept:");
+  if (accept == nullptr || strstr(accept, FRAME_DELTA_CONTENT_TYPE) == nullptr) {
+    sendFrame(fd, "application/octet-stream", etag, *frame, frame->bits.data(), frame->bits.size());
+    return;
+  }
+
+  std::shared_ptr<const Frame> base;
+  const char *quote = ifNoneMatch != nullptr ? strchr(ifNoneMatch, '"') : nullptr;
+  if (quote != nullptr) {
+    base = service.previousFrame(path + 7, strtoul(quote + 1, nullptr, 16));
+  }
+  std::vector<uint8_t> delta;
+  encodeFrameDelta(base ? base->bits.data() : nullptr, frame->bits.data(), frame->width, frame->height,
+                   base ? base->etag : 0, frame->etag, delta);
+  sendFrame(fd, FRAME_DELTA_CONTENT_TYPE, etag, *frame, delta.data(), delta.size());
+}
+
+static int runServer(const ServerOptions &options) {
+  FrameService service(options.threads);
+  if (!service.loadDevices(options.registry)) {
+    return 1;
+  }
+
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  int reuse = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(options.port);
+  if (bind(listener, (sockaddr *)&address, sizeof(address)) != 0 || listen(listener, 64) != 0) {
+    perror("listen");
+    return 1;
+  }
+
+  // Render every device now and then once per interval
+  std::thread renderLoop([&service, &options] {
+    while (true) {
+      auto start = std::chrono::steady_clock::now();
+      service.renderAll();
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      Serial.printf("Rendered %u devices in %.2f s\n", (unsigned)service.deviceCount(), seconds);
+      std::this_thread::sleep_for(std::chrono::seconds(options.interval));
+    }
+  });
+  renderLoop.detach();
+
+  Serial.printf("Serving frames on port %d with %u render threads\n", options.port, options.threads);
+  while (true) {
+    int fd = accept(listener, nullptr, nullptr);
+    if (fd < 0) {
+      continue;
+    }
+    handleConnection(fd, service);
+    close(fd);
+  }
+}
+
+int main(int argc, char **argv) {
+  ServerOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+  // Same bundle as the devices' asset partition, mapped from a file
+  if (options.assets != nullptr && !assetsBegin(options.assets)) {
+    return 1;
+  }
+  return options.benchFrames > 0 ? runBenchmark(options) : runServer(options);
+}
@@ -0,0 +1,285 @@
+#include "frame_service.h"
+#include <ArduinoJson.h>
+#include <fstream>
+#include <sstream>
+#include "renderer.h"
+
+// The firmware clients read and update this global. Each worker thread has
+// its own, loaded from the device it is rendering.
+thread_local Config config;
+
+static FrameService *activeService = nullptr;
+// The device this worker thread is rendering
+static thread_local Device *clientDevice = nullptr;
+
+bool loadConfig() {
+  return true;
+}
+
+bool saveConfig() {
+  if (activeService != nullptr) {
+    activeService->persistConfig(nullptr);
+  }
+  return true;
+}
+
+String loadRefreshToken() {
+  return activeService != nullptr ? activeService->refreshToken() : String();
+}
+
+bool saveRefreshToken(const String &token) {
+  if (activeService != nullptr && activeService->refreshToken() != token) {
+    activeService->persistConfig(&token);
+  }
+  return true;
+}
+
+static const char *PANEL_NAMES[] = {"750_T7", "750_GDEY075T7", "750C_Z08", "750C_Z90"};
+
+static bool parsePanel(const char *name, PanelModel &panel) {
+  for (int i = 0; i < 4; i++) {
+    if (name != nullptr && strcmp(name, PANEL_NAMES[i]) == 0) {
+      panel = (PanelModel)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+// FNV-1a over the frame, used as its ETag
+static uint32_t frameHash(const std::vector<uint8_t> &bits) {
+  uint32_t hash = 2166136261u;
+  for (uint8_t b : bits) {
+    hash = (hash ^ b) * 16777619u;
+  }
+  return hash;
+}
+
+template <typename Panel>
+static std::shared_ptr<Frame> renderPanelFrame(const WeatherSnapshot &weather, const CalendarEvents &events, time_t now) {
+  typedef Renderer<Panel> R;
+  PanelDisplay<Panel> canvas(typename Panel::Driver(-1, -1, -1, -1));
+
+  WidgetModel model;
+  buildWidgetModel(events, now, model);
+
+  R::init(canvas, true);
+  R::beginFrame(canvas, REFRESH_FULL);
+  R::splitScreenLayout(canvas);
+  typename R::ForecastRaster forecast;
+  R::rasterizeForecast(forecast, weather.hourly, now);
+  R::weatherData(canvas, weather.current, forecast);
+  R::calendarEvents(canvas, events);
+  R::clockWidget(canvas, now, model);
+  R::staleMarkers(canvas, now, weather.valid ? weather.fetchedAt : 0, events.lastUpdated);
+
+  std::shared_ptr<Frame> frame = std::make_shared<Frame>();
+  frame->width = Panel::WIDTH;
+  frame->height = Panel::HEIGHT;
+  frame->renderedAt = now;
+  frame->bits.assign(canvas.getBuffer(), canvas.getBuffer() + canvas.frameBytes());
+  frame->etag = frameHash(frame->bits);
+  return frame;
+}
+
+FrameService::FrameService(unsigned threads) : _pool(threads) {
+  activeService = this;
+}
+
+// Registry format:
+// {"devices": [{"id": "...", "panel": "750_T7", "location": "...",
+//               "weatherApiKey": "...", "msftClientId": "...",
+//               "msftClientSecret": "...", "msftRefreshToken": "...",
+//               "timeZone": "CET-1CEST,M3.5.0,M10.5.0/3"}]}
+bool FrameService::loadDevices(const char *path) {
+  std::ifstream file(path);
+  if (!file) {
+    Serial.printf("Cannot open device registry %s\n", path);
+    return false;
+  }
+  std::stringstream text;
+  text << file.rdbuf();
+
+  DynamicJsonDocument doc(256 * 1024);
+  DeserializationError error = deserializeJson(doc, text.str());
+  if (error) {
+    Serial.printf("Device registry parsing failed: %s\n", error.c_str());
+    return false;
+  }
+
+  _registryPath = path;
+  _devices.clear();
+  for (JsonObject entry : doc["devices"].as<JsonArray>()) {
+    std::unique_ptr<Device> device(new Device());
+    device->id = entry["id"] | "";
+    if (device->id.empty() || !parsePanel(entry["panel"] | "750_T7", device->panel)) {
+      Serial.println("Skipping registry entry without id or with unknown panel");
+      continue;
+    }
+    memset(&device->config, 0, sizeof(device->config));
+    setConfigField(device->config.location, entry["location"] | "");
+    setConfigField(device->config.weatherApiKey, entry["weatherApiKey"] | "");
+    setConfigField(device->config.msftClientId, entry["msftClientId"] | "");
+    setConfigField(device->config.msftClientSecret, entry["msftClientSecret"] | "");
+    device->refreshToken = entry["msftRefreshToken"] | "";
+    setConfigField(device->config.timeZone, entry["timeZone"] | "");
+    _devices.push_back(std::move(device));
+  }
+
+  Serial.printf("Loaded %u devices\n", (unsigned)_devices.size());
+  return true;
+}
+
+String FrameService::refreshToken() {
+  std::lock_guard<std::mutex> lock(_registryMutex);
+  return clientDevice != nullptr ? clientDevice->refreshToken : String();
+}
+
+// Take this worker's config (and a rotated token) into its device and
+// write the registry back
+void FrameService::persistConfig(const String *refreshToken) {
+  if (clientDevice == nullptr) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(_registryMutex);
+  clientDevice->config = config;
+  if (refreshToken != nullptr) {
+    clientDevice->refreshToken = *refreshToken;
+  }
+  if (_registryPath.empty()) {
+    return;
+  }
+
+  DynamicJsonDocument doc(256 * 1024);
+  JsonArray entries = doc.createNestedArray("devices");
+  for (const std::unique_ptr<Device> &device : _devices) {
+    JsonObject entry = entries.createNestedObject();
+    entry["id"] = device->id;
+    entry["panel"] = PANEL_NAMES[device->panel];
+    entry["location"] = device->config.location;
+    entry["weatherApiKey"] = device->config.weatherApiKey;
+    entry["msftClientId"] = device->config.msftClientId;
+    entry["msftClientSecret"] = device->config.msftClientSecret;
+    entry["msftRefreshToken"] = device->refreshToken.c_str();
+    entry["timeZone"] = device->config.timeZone;
+  }
+
+  std::string tmpPath = _registryPath + ".tmp";
+  std::ofstream file(tmpPath);
+  serializeJsonPretty(doc, file);
+  file.close();
+  if (!file || rename(tmpPath.c_str(), _registryPath.c_str()) != 0) {
+    Serial.println("Failed to write device registry");
+  }
+}
+
+void FrameService::renderAll() {
+  for (const std::unique_ptr<Device> &device : _devices) {
+    Device *target = device.get();
+    _pool.submit([this, target] { renderDevice(*target); });
+  }
+  _pool.waitIdle();
+}
+
+std::shared_ptr<const Frame> FrameService::frame(const std::string &deviceId) {
+  std::lock_guard<std::mutex> lock(_frameMutex);
+  auto it = _frames.find(deviceId);
+  return it == _frames.end() ? nullptr : it->second.front();
+}
+
+std::shared_ptr<const Frame> FrameService::previousFrame(const std::string &deviceId, uint32_t etag) {
+  std::lock_guard<std::mutex> lock(_frameMutex);
+  auto it = _frames.find(deviceId);
+  if (it == _frames.end()) {
+    return nullptr;
+  }
+  for (const std::shared_ptr<const Frame> &frame : it->second) {
+    if (frame->etag == etag) {
+      return frame;
+    }
+  }
+  return nullptr;
+}
+
+std::shared_ptr<Frame> FrameService::renderFrame(PanelModel panel, const WeatherSnapshot &weather,
+                                                 const CalendarEvents &events, time_t now) {
+  switch (panel) {
+    case PANEL_MODEL_750_GDEY075T7:
+      return renderPanelFrame<Panel750GDEY075T7>(weather, events, now);
+    case PANEL_MODEL_750C_Z08:
+      return renderPanelFrame<Panel750Z08>(weather, events, now);
+    case PANEL_MODEL_750C_Z90:
+      return renderPanelFrame<Panel750Z90>(weather, events, now);
+    case PANEL_MODEL_750_T7:
+    default:
+      return renderPanelFrame<Panel750T7>(weather, events, now);
+  }
+}
+
+// Weather is keyed by location: the first device at a location fetches,
+// the others wait on the entry and reuse the result until it goes stale
+std::shared_ptr<const WeatherSnapshot> FrameService::weatherFor() {
+  WeatherEntry *entry;
+  {
+    std::lock_guard<std::mutex> lock(_weatherMutex);
+    std::unique_ptr<WeatherEntry> &slot = _weather[config.location];
+    if (!slot) {
+      slot.reset(new WeatherEntry());
+    }
+    entry = slot.get();
+  }
+
+  std::lock_guard<std::mutex> entryLock(entry->mutex);
+  time_t now = time(nullptr);
+  if (entry->snapshot && now - entry->snapshot->fetchedAt < WEATHER_SHARE_TTL_S) {
+    return entry->snapshot;
+  }
+
+  std::shared_ptr<WeatherSnapshot> snapshot = std::make_shared<WeatherSnapshot>();
+  snapshot->valid = getWeatherData(snapshot->current, snapshot->hourly);
+  snapshot->fetchedAt = now;
+
+  // Keep serving the previous result if this fetch failed
+  if (snapshot->valid || !entry->snapshot) {
+    entry->snapshot = snapshot;
+  }
+  return entry->snapshot;
+}
+
+void FrameService::renderDevice(Device &device) {
+  // The clients on this thread work for this device, in parallel with the
+  // other workers
+  {
+    std::lock_guard<std::mutex> lock(_registryMutex);
+    config = device.config;
+  }
+  clientDevice = &device;
+
+  // The calendar window and everything drawn are in the device's local time
+  time_t now = time(nullptr);
+  TimeZone zone;
+  if (!buildTimeZone(config.timeZone, now, zone) && config.timeZone[0] != '\0') {
+    Serial.printf("Invalid time zone rule for %s: %s\n", device.id.c_str(), config.timeZone);
+  }
+  useTimeZone(&zone);
+
+  std::shared_ptr<const WeatherSnapshot> weather = weatherFor();
+  CalendarEvents events;
+  events.lastUpdated = 0;
+  if (!getCalendarEvents(events)) {
+    Serial.printf("Calendar fetch failed for %s\n", device.id.c_str());
+  }
+
+  std::shared_ptr<const Frame> rendered = renderFrame(device.panel, *weather, events, now);
+  useTimeZone(nullptr);
+  clientDevice = nullptr;
+  std::lock_guard<std::mutex> lock(_frameMutex);
+  std::deque<std::shared_ptr<const Frame>> &history = _frames[device.id];
+  if (!history.empty() && history.front()->etag == rendered->etag) {
+    return;
+  }
+  history.push_front(rendered);
+  if (history.size() > FRAME_HISTORY_DEPTH) {
+    history.pop_back();
+  }
+}
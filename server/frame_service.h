@@ -0,0 +1,95 @@
+#ifndef FRAME_SERVICE_H
+#define FRAME_SERVICE_H
+
+#include <Arduino.h>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "weather.h"
+#include "calendar.h"
+#include "model_snapshot.h"
+#include "thread_pool.h"
+
+// Weather is shared between all devices at a location for this long (seconds)
+#define WEATHER_SHARE_TTL_S (10 * 60)
+
+// Frames kept per device as delta bases for devices that missed an update
+#define FRAME_HISTORY_DEPTH 4
+
+// Panel models the server can render for
+enum PanelModel {
+  PANEL_MODEL_750_T7,
+  PANEL_MODEL_750_GDEY075T7,
+  PANEL_MODEL_750C_Z08,
+  PANEL_MODEL_750C_Z90
+};
+
+// One display in the fleet
+struct Device {
+  std::string id;
+  PanelModel panel;
+  Config config;
+  String refreshToken;
+};
+
+// A rendered 1bpp frame: row-major, MSB first, 1 = white
+struct Frame {
+  uint16_t width;
+  uint16_t height;
+  uint32_t etag;
+  time_t renderedAt;
+  std::vector<uint8_t> bits;
+};
+
+// Fetches and renders frames for every registered device on a thread pool
+class FrameService {
+public:
+  explicit FrameService(unsigned threads);
+
+  bool loadDevices(const char *path);
+  size_t deviceCount() const { return _devices.size(); }
+
+  // Queue a render of every device and wait for the batch to finish
+  void renderAll();
+  std::shared_ptr<const Frame> frame(const std::string &deviceId);
+  // An earlier frame of the device by ETag, or nullptr once it has aged out
+  std::shared_ptr<const Frame> previousFrame(const std::string &deviceId, uint32_t etag);
+
+  // Render one frame from the given data, without touching the network
+  static std::shared_ptr<Frame> renderFrame(PanelModel panel, const WeatherSnapshot &weather,
+                                            const CalendarEvents &events, time_t now);
+
+  // Called from saveConfig() and saveRefreshToken() on a worker thread when
+  // a client changes its device's config or rotates its refresh token
+  void persistConfig(const String *refreshToken);
+  String refreshToken();
+
+private:
+  struct WeatherEntry {
+    std::mutex mutex;
+    std::shared_ptr<const WeatherSnapshot> snapshot;
+  };
+
+  void renderDevice(Device &device);
+  std::shared_ptr<const WeatherSnapshot> weatherFor();
+
+  ThreadPool _pool;
+  std::string _registryPath;
+  std::vector<std::unique_ptr<Device>> _devices;
+
+  // Guards the device configs and tokens, which workers write back, and
+  // the registry file
+  std::mutex _registryMutex;
+
+  std::mutex _weatherMutex;
+  std::map<std::string, std::unique_ptr<WeatherEntry>> _weather;
+
+  std::mutex _frameMutex;
+  std::map<std::string, std::deque<std::shared_ptr<const Frame>>> _frames; // newest first
+};
+
+#endif // FRAME_SERVICE_H
@@ -0,0 +1,47 @@
+#ifndef MOCK_PANEL_BUS_H
+#define MOCK_PANEL_BUS_H
+
+#include <Arduino.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "band_pipeline.h"
+
+// Host stand-in for the panel's SPI bus. Bands land in a copy of the
+// controller RAM on a thread of their own, which takes as long as clocking
+// them out at the given SPI rate would, so band output can be timed and
+// checked without a panel.
+class MockPanelBus : public PanelBus {
+public:
+  MockPanelBus(int16_t width, int16_t height, uint32_t spiHz)
+      : _stride((width + 7) / 8), _spiHz(spiHz), _ram((size_t)_stride * height, 0xFF), _bands(0) {}
+  ~MockPanelBus() override { wait(); }
+
+  void write(const uint8_t *rows, int16_t y, int16_t count) override {
+    wait();
+    _bands++;
+    _transfer = std::thread([this, rows, y, count] {
+      size_t length = (size_t)count * _stride;
+      std::this_thread::sleep_for(std::chrono::microseconds((uint64_t)length * 8 * 1000000 / _spiHz));
+      memcpy(_ram.data() + (size_t)y * _stride, rows, length);
+    });
+  }
+
+  void wait() override {
+    if (_transfer.joinable()) {
+      _transfer.join();
+    }
+  }
+
+  const std::vector<uint8_t> &ram() const { return _ram; }
+  uint32_t bands() const { return _bands; }
+
+private:
+  int16_t _stride;
+  uint32_t _spiHz;
+  std::vector<uint8_t> _ram;
+  uint32_t _bands;
+  std::thread _transfer;
+};
+
+#endif // MOCK_PANEL_BUS_H
@@ -0,0 +1,60 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(unsigned threads) {
+  if (threads == 0) {
+    threads = 1;
+  }
+  for (unsigned i = 0; i < threads; i++) {
+    _workers.emplace_back(&ThreadPool::workerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopping = true;
+  }
+  _jobReady.notify_all();
+  for (std::thread &worker : _workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::submit(std::function<void()> job) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _jobs.push_back(std::move(job));
+  }
+  _jobReady.notify_one();
+}
+
+void ThreadPool::waitIdle() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _idle.wait(lock, [this] { return _jobs.empty() && _running == 0; });
+}
+
+void ThreadPool::workerLoop() {
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _jobReady.wait(lock, [this] { return _stopping || !_jobs.empty(); });
+      if (_stopping && _jobs.empty()) {
+        return;
+      }
+      job = std::move(_jobs.front());
+      _jobs.pop_front();
+      _running++;
+    }
+
+    job();
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _running--;
+      if (_jobs.empty() && _running == 0) {
+        _idle.notify_all();
+      }
+    }
+  }
+}
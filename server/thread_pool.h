@@ -0,0 +1,34 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads draining a FIFO of jobs
+class ThreadPool {
+public:
+  explicit ThreadPool(unsigned threads);
+  ~ThreadPool();
+
+  void submit(std::function<void()> job);
+  // Block until the queue is empty and no job is running
+  void waitIdle();
+  unsigned size() const { return _workers.size(); }
+
+private:
+  void workerLoop();
+
+  std::vector<std::thread> _workers;
+  std::deque<std::function<void()>> _jobs;
+  std::mutex _mutex;
+  std::condition_variable _jobReady;
+  std::condition_variable _idle;
+  unsigned _running = 0;
+  bool _stopping = false;
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,628 @@
+// Battery-life simulator: replays a calendar/weather trace through the
+// firmware's own scheduler, model cache, endpoint health, refresh policy and
+// battery policy, charging every wake to an energy model, and reports how
+// long a charge lasts and how fresh the screen stays under each policy.
+//
+//   battery_sim [--days 365] [--model energy.json] [--trace trace.json] [--policies policies.json]
+//
+// Each policy runs in a child process of its own, so the modules' RTC state
+// starts from a power-on for every run, as on a freshly charged device.
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <vector>
+#include "battery.h"
+#include "civil_time.h"
+#include "endpoint_health.h"
+#include "model_cache.h"
+#include "refresh_policy.h"
+#include "scheduler.h"
+
+#define SECONDS_PER_DAY 86400
+
+// What a wake costs. Durations at CPU_ACTIVE current, plus the WiFi extra
+// while the radio is up and the panel extra while it refreshes (metrics.h).
+struct EnergyModel {
+  float sleepMa = CURRENT_DEEP_SLEEP_MA;
+  float cpuMa = CURRENT_CPU_ACTIVE_MA;
+  float wifiMa = CURRENT_WIFI_EXTRA_MA;
+  float panelMa = CURRENT_PANEL_REFRESH_EXTRA_MA;
+  float bootMs = 250;
+  float connectMs = 1800;
+  float tlsFullMs = 1500;
+  float tlsResumedMs = 300;
+  // A TLS session is resumed if the last full handshake is this recent (s)
+  uint32_t tlsSessionS = 2 * 60 * 60;
+  float requestMs = 150;
+  // A request into an outage runs into the HTTP timeout
+  float failedRequestMs = 5000;
+  float bytesPerS = 100000;
+  uint32_t weatherBytes = 9000;
+  uint32_t calendarBytes = 4000;
+  float fullRefreshMs = 4000;
+  float fastFullRefreshMs = 1600;
+  float partialRefreshMs = 650;
+  float clockRefreshMs = 400;
+  float batteryMah = 2000;
+};
+
+struct Outage {
+  Endpoint endpoint;
+  time_t from;
+  time_t to;
+};
+
+// Calendar changes and endpoint outages, in seconds from the start. The
+// calendar changes repeat every repeatS (0: once).
+struct Trace {
+  time_t start = 1717372800;
+  uint32_t weatherIssueS = 60 * 60;
+  std::string timeZone;
+  uint32_t calendarRepeatS = 7 * SECONDS_PER_DAY;
+  std::vector<time_t> calendarChanges;
+  std::vector<Outage> outages;
+};
+
+struct SimPolicy {
+  std::string name;
+  uint32_t dataIntervalS;
+  bool ticks;
+  // Shortest time between calendar fetches, 0 for every data wake
+  uint32_t calendarIntervalS;
+  // Follow the battery levels (battery.h), or keep the normal policy to the end
+  bool batteryPolicy;
+  uint16_t partialBudget;
+  uint8_t fastFullBudget;
+};
+
+static const SimPolicy DEFAULT_POLICIES[] = {
+  {"baseline", DATA_INTERVAL_S, true, 0, true, REFRESH_PARTIAL_BUDGET, REFRESH_FAST_FULL_BUDGET},
+  {"no-ticks", DATA_INTERVAL_S, false, 0, true, REFRESH_PARTIAL_BUDGET, REFRESH_FAST_FULL_BUDGET},
+  {"15min", 15 * 60, true, 0, true, REFRESH_PARTIAL_BUDGET, REFRESH_FAST_FULL_BUDGET},
+  {"60min", 60 * 60, true, 0, true, REFRESH_PARTIAL_BUDGET, REFRESH_FAST_FULL_BUDGET},
+  {"no-battery-policy", DATA_INTERVAL_S, true, 0, false, REFRESH_PARTIAL_BUDGET, REFRESH_FAST_FULL_BUDGET},
+};
+
+// Where the charge goes
+enum EnergyUse {
+  USE_SLEEP,
+  USE_BOOT,
+  USE_WIFI,
+  USE_TLS,
+  USE_TRANSFER,
+  USE_REFRESH,
+  USE_COUNT
+};
+
+static const char *USE_NAMES[USE_COUNT] = {"sleep", "boot", "wifi", "tls", "transfer", "refresh"};
+
+// Sent back from the child as raw bytes
+struct SimResult {
+  double days;
+  bool depleted;
+  uint32_t dataWakes;
+  uint32_t tickWakes;
+  uint32_t offlineWakes;
+  uint32_t fetches[2];
+  uint32_t failedFetches;
+  uint32_t refreshes[REFRESH_FULL + 1];
+  uint32_t clockRefreshes;
+  double weatherAgeMeanS;
+  double weatherAgeMaxS;
+  uint32_t calendarChanges;
+  uint32_t calendarShown;
+  double calendarDelayMeanS;
+  double calendarDelayMaxS;
+  double energyMas[USE_COUNT];
+};
+
+struct SimOptions {
+  unsigned days = 365;
+  const char *model = nullptr;
+  const char *trace = nullptr;
+  const char *policies = nullptr;
+};
+
+// The firmware's battery_monitor.cpp and reset cause, played by the simulator
+static PowerPolicy simPower;
+static esp_reset_reason_t simResetReason = ESP_RST_POWERON;
+static uint16_t simMillivolts;
+
+const PowerPolicy &currentPowerPolicy() {
+  return simPower;
+}
+
+esp_reset_reason_t esp_reset_reason() {
+  return simResetReason;
+}
+
+static uint16_t simVoltage() {
+  return simMillivolts;
+}
+
+// Resting voltage for a charge, inverting the gauge's discharge curve
+static uint16_t millivoltsFor(float percent) {
+  uint16_t low = 3300, high = 4200;
+  while (low < high) {
+    uint16_t mid = (low + high) / 2;
+    if (batteryPercentFor(mid) < percent) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+static bool readJson(const char *path, DynamicJsonDocument &doc) {
+  std::ifstream file(path);
+  if (!file) {
+    fprintf(stderr, "Cannot open %s\n", path);
+    return false;
+  }
+  std::stringstream text;
+  text << file.rdbuf();
+  DeserializationError error = deserializeJson(doc, text.str());
+  if (error) {
+    fprintf(stderr, "%s: parsing failed: %s\n", path, error.c_str());
+    return false;
+  }
+  return true;
+}
+
+// Any field left out keeps its default
+static bool loadModel(const char *path, EnergyModel &model) {
+  DynamicJsonDocument doc(16 * 1024);
+  if (!readJson(path, doc)) {
+    return false;
+  }
+  model.sleepMa = doc["sleepMa"] | model.sleepMa;
+  model.cpuMa = doc["cpuMa"] | model.cpuMa;
+  model.wifiMa = doc["wifiMa"] | model.wifiMa;
+  model.panelMa = doc["panelMa"] | model.panelMa;
+  model.bootMs = doc["bootMs"] | model.bootMs;
+  model.connectMs = doc["connectMs"] | model.connectMs;
+  model.tlsFullMs = doc["tlsFullMs"] | model.tlsFullMs;
+  model.tlsResumedMs = doc["tlsResumedMs"] | model.tlsResumedMs;
+  model.tlsSessionS = doc["tlsSessionS"] | model.tlsSessionS;
+  model.requestMs = doc["requestMs"] | model.requestMs;
+  model.failedRequestMs = doc["failedRequestMs"] | model.failedRequestMs;
+  model.bytesPerS = doc["bytesPerS"] | model.bytesPerS;
+  model.weatherBytes = doc["weatherBytes"] | model.weatherBytes;
+  model.calendarBytes = doc["calendarBytes"] | model.calendarBytes;
+  model.fullRefreshMs = doc["fullRefreshMs"] | model.fullRefreshMs;
+  model.fastFullRefreshMs = doc["fastFullRefreshMs"] | model.fastFullRefreshMs;
+  model.partialRefreshMs = doc["partialRefreshMs"] | model.partialRefreshMs;
+  model.clockRefreshMs = doc["clockRefreshMs"] | model.clockRefreshMs;
+  model.batteryMah = doc["batteryMah"] | model.batteryMah;
+  return model.batteryMah > 0 && model.bytesPerS > 0;
+}
+
+// Three meetings moved every weekday (08:30, 11:00 and 14:15 UTC, from a
+// Monday start)
+static void defaultTrace(Trace &trace) {
+  for (int day = 0; day < 5; day++) {
+    for (time_t offset : {8 * 3600 + 30 * 60, 11 * 3600, 14 * 3600 + 15 * 60}) {
+      trace.calendarChanges.push_back(day * SECONDS_PER_DAY + offset);
+    }
+  }
+}
+
+// {"start": 1717372800, "weatherIssueS": 3600, "timeZone": "CET-1CEST,M3.5.0,M10.5.0/3",
+//  "calendar": {"repeatS": 604800, "changes": [30600, 39600]},
+//  "outages": [{"endpoint": "calendar", "from": 86400, "to": 172800}]}
+static bool loadTrace(const char *path, Trace &trace) {
+  DynamicJsonDocument doc(256 * 1024);
+  if (!readJson(path, doc)) {
+    return false;
+  }
+  trace.start = doc["start"] | (long)trace.start;
+  trace.weatherIssueS = doc["weatherIssueS"] | trace.weatherIssueS;
+  trace.timeZone = doc["timeZone"] | "";
+  trace.calendarRepeatS = doc["calendar"]["repeatS"] | trace.calendarRepeatS;
+  for (JsonVariant change : doc["calendar"]["changes"].as<JsonArray>()) {
+    trace.calendarChanges.push_back(change.as<long>());
+  }
+  for (JsonObject entry : doc["outages"].as<JsonArray>()) {
+    Outage outage;
+    outage.endpoint = strcmp(entry["endpoint"] | "", "calendar") == 0 ? ENDPOINT_CALENDAR : ENDPOINT_WEATHER;
+    outage.from = entry["from"] | 0L;
+    outage.to = entry["to"] | 0L;
+    trace.outages.push_back(outage);
+  }
+  if (trace.start < MIN_VALID_EPOCH || trace.weatherIssueS == 0) {
+    fprintf(stderr, "%s: start must be a valid epoch and weatherIssueS positive\n", path);
+    return false;
+  }
+  return true;
+}
+
+// [{"name": "hourly", "dataIntervalS": 3600, "ticks": false, "calendarIntervalS": 0,
+//   "batteryPolicy": true, "partialBudget": 45, "fastFullBudget": 3}]
+static bool loadPolicies(const char *path, std::vector<SimPolicy> &policies) {
+  DynamicJsonDocument doc(64 * 1024);
+  if (!readJson(path, doc)) {
+    return false;
+  }
+  for (JsonObject entry : doc.as<JsonArray>()) {
+    SimPolicy policy = DEFAULT_POLICIES[0];
+    policy.name = entry["name"] | "unnamed";
+    policy.dataIntervalS = entry["dataIntervalS"] | policy.dataIntervalS;
+    policy.ticks = entry["ticks"] | policy.ticks;
+    policy.calendarIntervalS = entry["calendarIntervalS"] | policy.calendarIntervalS;
+    policy.batteryPolicy = entry["batteryPolicy"] | policy.batteryPolicy;
+    policy.partialBudget = entry["partialBudget"] | policy.partialBudget;
+    policy.fastFullBudget = entry["fastFullBudget"] | policy.fastFullBudget;
+    if (policy.dataIntervalS == 0) {
+      fprintf(stderr, "%s: policy %s needs a data interval\n", path, policy.name.c_str());
+      return false;
+    }
+    policies.push_back(policy);
+  }
+  return !policies.empty();
+}
+
+// The battery level's policy, with the intervals scaled to the simulated
+// policy's own (the firmware's levels are relative to DATA_INTERVAL_S)
+static PowerPolicy powerFor(const SimPolicy &policy, BatteryLevel level) {
+  PowerPolicy power = powerPolicyFor(policy.batteryPolicy ? level : BATTERY_NORMAL);
+  power.dataIntervalS = (uint64_t)power.dataIntervalS * policy.dataIntervalS / DATA_INTERVAL_S;
+  power.calendarIntervalS = max(power.calendarIntervalS, policy.calendarIntervalS);
+  power.ticksAllowed = power.ticksAllowed && policy.ticks;
+  return power;
+}
+
+// Calendar change times in order, with the trace's repeats
+class ChangeStream {
+public:
+  explicit ChangeStream(const Trace &trace)
+      : _start(trace.start), _repeatS(trace.calendarRepeatS), _changes(trace.calendarChanges), _cycle(0), _index(0) {
+    std::sort(_changes.begin(), _changes.end());
+  }
+
+  time_t peek() const {
+    if (_changes.empty() || (_repeatS == 0 && _cycle > 0)) {
+      return std::numeric_limits<time_t>::max();
+    }
+    return _start + (time_t)_cycle * _repeatS + _changes[_index];
+  }
+
+  void next() {
+    if (++_index == _changes.size()) {
+      _index = 0;
+      _cycle++;
+    }
+  }
+
+private:
+  time_t _start;
+  uint32_t _repeatS;
+  std::vector<time_t> _changes;
+  uint32_t _cycle;
+  size_t _index;
+};
+
+class Simulation {
+public:
+  Simulation(const EnergyModel &model, const Trace &trace, const SimPolicy &policy)
+      : _model(model), _trace(trace), _policy(policy), _changes(trace), _result() {
+    _lastHandshake[0] = _lastHandshake[1] = 0;
+  }
+
+  SimResult run(unsigned days) {
+    BatteryState battery = {};
+    TimeZone zone = {};
+    time_t end = _trace.start + (time_t)days * SECONDS_PER_DAY;
+    int64_t nowUs = (int64_t)_trace.start * 1000000LL;
+
+    while (nowUs / 1000000LL < end) {
+      time_t now = nowUs / 1000000LL;
+      if (!_trace.timeZone.empty() && now >= zone.validUntil && buildTimeZone(_trace.timeZone.c_str(), now, zone)) {
+        useTimeZone(&zone);
+      }
+
+      // battery_monitor.cpp: measure before anything else, stop at empty
+      simMillivolts = millivoltsFor(100.0f * (1.0f - usedFraction()));
+      batteryUpdate(battery, simVoltage, now);
+      if (battery.level == BATTERY_EMPTY) {
+        _result.depleted = true;
+        break;
+      }
+      simPower = powerFor(_policy, battery.level);
+      RefreshPolicyConfig base = DEFAULT_REFRESH_POLICY;
+      base.partialBudget = _policy.partialBudget;
+      base.fastFullBudget = _policy.fastFullBudget;
+      setRefreshPolicyConfig(refreshConfigFor(simPower, base));
+
+      _wakeMs = 0;
+      spend(USE_BOOT, _model.bootMs, _model.cpuMa);
+      runWake(now);
+      accountWeatherAge(now);
+
+      // The wake itself takes time before the sleep timer is set
+      nowUs += (int64_t)(_wakeMs * 1000);
+      simResetReason = ESP_RST_DEEPSLEEP;
+      uint64_t sleepUs = sleepDurationUs(nowUs);
+      _energyMas[USE_SLEEP] += _model.sleepMa * sleepUs / 1e6;
+      nowUs += sleepUs;
+    }
+
+    time_t stop = min<time_t>(nowUs / 1000000LL, end);
+    accountWeatherAge(stop);
+    for (time_t change = _changes.peek(); change <= stop; _changes.next(), change = _changes.peek()) {
+      _result.calendarChanges++;
+    }
+    _result.days = (double)(stop - _trace.start) / SECONDS_PER_DAY;
+    double span = stop - _firstWeatherAt;
+    _result.weatherAgeMeanS = _firstWeatherAt != 0 && span > 0 ? _weatherAgeArea / span : 0;
+    _result.calendarDelayMeanS = _result.calendarShown > 0 ? _calendarDelaySum / _result.calendarShown : 0;
+    memcpy(_result.energyMas, _energyMas, sizeof(_energyMas));
+    return _result;
+  }
+
+private:
+  // Mirrors setup() in main.cpp
+  void runWake(time_t now) {
+    bool coldBoot = simResetReason != ESP_RST_DEEPSLEEP;
+    WakeKind wakeKind = scheduleWakeAt(now, !coldBoot);
+    if (wakeKind == WAKE_TICK && chooseRefresh(REGION_CLOCK, now) != REFRESH_PARTIAL) {
+      wakeKind = WAKE_DATA;
+    }
+    if (wakeKind == WAKE_TICK) {
+      _result.tickWakes++;
+      spend(USE_REFRESH, _model.clockRefreshMs, _model.cpuMa + _model.panelMa);
+      recordRefresh(REGION_CLOCK, REFRESH_PARTIAL);
+      _result.clockRefreshes++;
+      return;
+    }
+
+    _result.dataWakes++;
+    if (coldBoot) {
+      refresh(REFRESH_FULL);
+    }
+    bool weatherDue = weatherRefreshDue(now) && endpointAllowed(ENDPOINT_WEATHER, now);
+    bool calendarDue = calendarRefreshDue(now, simPower.calendarIntervalS) && endpointAllowed(ENDPOINT_CALENDAR, now);
+    if (weatherDue || calendarDue) {
+      spend(USE_WIFI, _model.connectMs, _model.cpuMa + _model.wifiMa);
+    } else {
+      _result.offlineWakes++;
+    }
+    if (weatherDue && fetch(ENDPOINT_WEATHER, now)) {
+      cacheWeather(now);
+    }
+    if (calendarDue && fetch(ENDPOINT_CALENDAR, now)) {
+      cacheWidgetModel(CalendarEvents(), now);
+      for (time_t change = _changes.peek(); change <= now; _changes.next(), change = _changes.peek()) {
+        double delay = now - change;
+        _result.calendarChanges++;
+        _result.calendarShown++;
+        _calendarDelaySum += delay;
+        _result.calendarDelayMaxS = max(_result.calendarDelayMaxS, delay);
+      }
+    }
+    markDataFetched(now);
+
+    // The clock widget is part of the screen, so a data wake always has
+    // something new to draw
+    refresh(chooseRefresh(REGION_SCREEN, now));
+  }
+
+  bool fetch(Endpoint endpoint, time_t now) {
+    bool up = true;
+    for (const Outage &outage : _trace.outages) {
+      if (outage.endpoint == endpoint && now >= _trace.start + outage.from && now < _trace.start + outage.to) {
+        up = false;
+      }
+    }
+
+    float radioMa = _model.cpuMa + _model.wifiMa;
+    time_t &lastHandshake = _lastHandshake[endpoint];
+    if (up && lastHandshake != 0 && now - lastHandshake < (time_t)_model.tlsSessionS) {
+      spend(USE_TLS, _model.tlsResumedMs, radioMa);
+    } else {
+      spend(USE_TLS, _model.tlsFullMs, radioMa);
+      lastHandshake = up ? now : 0;
+    }
+    if (up) {
+      uint32_t bytes = endpoint == ENDPOINT_WEATHER ? _model.weatherBytes : _model.calendarBytes;
+      spend(USE_TRANSFER, _model.requestMs + bytes * 1000.0f / _model.bytesPerS, radioMa);
+      _result.fetches[endpoint]++;
+    } else {
+      spend(USE_TRANSFER, _model.failedRequestMs, radioMa);
+      _result.failedFetches++;
+    }
+    recordEndpointResult(endpoint, up, now);
+    return up;
+  }
+
+  // A forecast as issued at the last issue time: 48 hours from its hour
+  void cacheWeather(time_t now) {
+    time_t issued = now - (now - _trace.start) % _trace.weatherIssueS;
+    WeatherData current = {};
+    current.location = "Simulated";
+    current.description = "clear sky";
+    current.iconCode = "01d";
+    current.timestamp = issued;
+    HourlyForecast hourly[HOURLY_FORECAST_COUNT];
+    for (int i = 0; i < HOURLY_FORECAST_COUNT; i++) {
+      hourly[i].timestamp = issued - issued % 3600 + (time_t)i * 3600;
+      hourly[i].iconCode = "01d";
+      hourly[i].temperature = 15;
+      hourly[i].precipitation = 0;
+    }
+    cacheWeatherModel(current, hourly, now);
+    if (_firstWeatherAt == 0) {
+      _firstWeatherAt = now;
+      _weatherAgeAt = now;
+    }
+    _shownIssue = issued;
+  }
+
+  void refresh(RefreshMode mode) {
+    static const float EnergyModel::*DURATIONS[] = {&EnergyModel::partialRefreshMs, &EnergyModel::fastFullRefreshMs,
+                                                    &EnergyModel::fullRefreshMs};
+    spend(USE_REFRESH, _model.*DURATIONS[mode], _model.cpuMa + _model.panelMa);
+    recordRefresh(REGION_SCREEN, mode);
+    _result.refreshes[mode]++;
+  }
+
+  // Age of the forecast on screen against its issue time, integrated over
+  // time; it grows linearly between fetches
+  void accountWeatherAge(time_t now) {
+    if (_firstWeatherAt == 0 || now <= _weatherAgeAt) {
+      return;
+    }
+    double from = _weatherAgeAt - _shownIssue;
+    double to = now - _shownIssue;
+    _weatherAgeArea += (from + to) / 2 * (now - _weatherAgeAt);
+    _result.weatherAgeMaxS = max(_result.weatherAgeMaxS, to);
+    _weatherAgeAt = now;
+  }
+
+  void spend(EnergyUse use, float ms, float ma) {
+    _energyMas[use] += ma * ms / 1000;
+    _wakeMs += ms;
+  }
+
+  double usedFraction() const {
+    double total = 0;
+    for (double mas : _energyMas) {
+      total += mas;
+    }
+    return min(1.0, total / (_model.batteryMah * 3600.0));
+  }
+
+  const EnergyModel &_model;
+  const Trace &_trace;
+  const SimPolicy &_policy;
+  ChangeStream _changes;
+  SimResult _result;
+  double _energyMas[USE_COUNT] = {};
+  float _wakeMs = 0;
+  time_t _lastHandshake[2];
+  time_t _firstWeatherAt = 0;
+  time_t _weatherAgeAt = 0;
+  time_t _shownIssue = 0;
+  double _weatherAgeArea = 0;
+  double _calendarDelaySum = 0;
+};
+
+// Run one policy in a child process and read its result back over a pipe.
+// The child's stdout, where the firmware modules log, goes nowhere.
+static bool simulate(const EnergyModel &model, const Trace &trace, const SimPolicy &policy, unsigned days,
+                     SimResult &result) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    perror("pipe");
+    return false;
+  }
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return false;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    if (freopen("/dev/null", "w", stdout) == nullptr) {
+      _exit(1);
+    }
+    Simulation simulation(model, trace, policy);
+    SimResult childResult = simulation.run(days);
+    _exit(write(fds[1], &childResult, sizeof(childResult)) == sizeof(childResult) ? 0 : 1);
+  }
+
+  close(fds[1]);
+  ssize_t length = read(fds[0], &result, sizeof(result));
+  close(fds[0]);
+  int status;
+  waitpid(pid, &status, 0);
+  return length == sizeof(result) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static void printResult(const SimPolicy &policy, const SimResult &result) {
+  char life[16];
+  snprintf(life, sizeof(life), "%s%.1f", result.depleted ? "" : ">", result.days);
+  printf("%-18s %7s %7u %7u %6u/%-5u %4u %4u %4u %7.1f %7.1f %7.1f %7.1f\n", policy.name.c_str(), life,
+         result.dataWakes, result.tickWakes, result.fetches[ENDPOINT_WEATHER], result.fetches[ENDPOINT_CALENDAR],
+         result.refreshes[REFRESH_FULL], result.refreshes[REFRESH_FAST_FULL], result.refreshes[REFRESH_PARTIAL],
+         result.weatherAgeMeanS / 60, result.weatherAgeMaxS / 60, result.calendarDelayMeanS / 60,
+         result.calendarDelayMaxS / 60);
+}
+
+static void printEnergy(const SimPolicy &policy, const SimResult &result) {
+  double total = 0;
+  for (double mas : result.energyMas) {
+    total += mas;
+  }
+  printf("%-18s", policy.name.c_str());
+  for (int use = 0; use < USE_COUNT; use++) {
+    printf(" %s %.1f%%", USE_NAMES[use], total > 0 ? 100 * result.energyMas[use] / total : 0);
+  }
+  printf("  (%.0f mAh, %u offline wakes, %u failed fetches, %u/%u calendar changes shown)\n", total / 3600,
+         result.offlineWakes, result.failedFetches, result.calendarShown, result.calendarChanges);
+}
+
+static bool parseOptions(int argc, char **argv, SimOptions &options) {
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "--days") == 0 && hasValue) {
+      options.days = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--model") == 0 && hasValue) {
+      options.model = argv[++i];
+    } else if (strcmp(argv[i], "--trace") == 0 && hasValue) {
+      options.trace = argv[++i];
+    } else if (strcmp(argv[i], "--policies") == 0 && hasValue) {
+      options.policies = argv[++i];
+    } else {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return false;
+    }
+  }
+  return options.days > 0;
+}
+
+int main(int argc, char **argv) {
+  SimOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+
+  EnergyModel model;
+  Trace trace;
+  std::vector<SimPolicy> policies;
+  if (options.model != nullptr && !loadModel(options.model, model)) {
+    return 1;
+  }
+  if (options.trace == nullptr) {
+    defaultTrace(trace);
+  } else if (!loadTrace(options.trace, trace)) {
+    return 1;
+  }
+  if (options.policies == nullptr) {
+    policies.assign(std::begin(DEFAULT_POLICIES), std::end(DEFAULT_POLICIES));
+  } else if (!loadPolicies(options.policies, policies)) {
+    return 1;
+  }
+
+  printf("%.0f mAh, up to %u days; life in days, ages and delays in minutes\n", model.batteryMah, options.days);
+  printf("%-18s %7s %7s %7s %12s %4s %4s %4s %7s %7s %7s %7s\n", "policy", "life", "data", "ticks", "fetch w/c",
+         "full", "fast", "part", "wx avg", "wx max", "cal avg", "cal max");
+  std::vector<SimResult> results(policies.size());
+  for (size_t i = 0; i < policies.size(); i++) {
+    if (!simulate(model, trace, policies[i], options.days, results[i])) {
+      fprintf(stderr, "Simulation of %s failed\n", policies[i].name.c_str());
+      return 1;
+    }
+    printResult(policies[i], results[i]);
+  }
+  printf("\nEnergy\n");
+  for (size_t i = 0; i < policies.size(); i++) {
+    printEnergy(policies[i], results[i]);
+  }
+  return 0;
+}
@@ -0,0 +1,218 @@
+// Heap soak: runs the firmware's fetch, cache and render cycle over and over
+// against recorded API responses on an instrumented heap (soak_heap.h), and
+// fails if live memory or the largest free block trends away over the run.
+//
+//   heap_soak [--cycles 100000] [--samples 20] [--fixtures sim/fixtures] [--arena 262144]
+//
+// The firmware keeps its display buffer, snapshots and models in statics, so
+// a steady cycle must leave the heap where the previous one left it. Sizes are
+// the host's (64-bit pointers, std::string behind String), so the absolute
+// numbers are larger than on the ESP32; the trends are what is checked.
+#include <Arduino.h>
+#include <vector>
+#include "calendar.h"
+#include "config.h"
+#include "model_cache.h"
+#include "model_snapshot.h"
+#include "net_session.h"
+#include "renderer.h"
+#include "replay_http.h"
+#include "soak_heap.h"
+#include "weather.h"
+
+// Growth over the checked part of the run that counts as a trend. Small
+// enough to catch a leak of a few bytes per thousand cycles.
+#define SOAK_LIVE_GROWTH_LIMIT 1024
+#define SOAK_BLOCK_GROWTH_LIMIT 8
+#define SOAK_LARGEST_FREE_SHRINK_LIMIT 4096
+// The first part of the run fills caches and is left out of the trends (%)
+#define SOAK_WARMUP_PERCENT 10
+// Simulated time between cycles, a data wake apart
+#define SOAK_CYCLE_S (30 * 60)
+
+struct SoakOptions {
+  unsigned cycles = 100000;
+  unsigned samples = 20;
+  const char *fixtures = "sim/fixtures";
+  size_t arenaBytes = 256 * 1024;
+};
+
+struct SoakSample {
+  unsigned cycle;
+  SoakHeapStats heap;
+  double allocationsPerCycle;
+};
+
+// The firmware globals the cycle touches (main.cpp, display.cpp)
+thread_local Config config;
+static ActiveDisplay display(ActivePanel::Driver(-1, -1, -1, -1));
+static Renderer<ActivePanel>::ForecastRaster forecastRaster;
+static SnapshotBuffer<WeatherSnapshot> weatherSnapshots;
+static SnapshotBuffer<CalendarEvents> calendarSnapshots;
+
+bool loadConfig() {
+  return true;
+}
+
+bool saveConfig() {
+  return true;
+}
+
+String loadRefreshToken() {
+  return "soak-refresh-token";
+}
+
+bool saveRefreshToken(const String &) {
+  return true;
+}
+
+// One data wake: both fetches with their cache fallbacks, then a full
+// frame, as updateWeatherData(), updateCalendarData() and updateDisplay() do
+static void runCycle(time_t now) {
+  typedef Renderer<ActivePanel> R;
+
+  WeatherSnapshot &weather = weatherSnapshots.back();
+  if (getWeatherData(weather.current, weather.hourly)) {
+    cacheWeatherModel(weather.current, weather.hourly, now);
+    weather.fetchedAt = now;
+  } else {
+    weather.fetchedAt = loadWeatherModel(weather.current, weather.hourly, now);
+  }
+  weather.valid = weather.fetchedAt != 0;
+  weatherSnapshots.publish();
+
+  CalendarEvents &events = calendarSnapshots.back();
+  if (getCalendarEvents(events)) {
+    cacheWidgetModel(events, now);
+  }
+  loadCachedEvents(events);
+  calendarSnapshots.publish();
+  closeConnections();
+
+  const WeatherSnapshot &shown = *weatherSnapshots.front();
+  const CalendarEvents &shownEvents = *calendarSnapshots.front();
+  WidgetModel model;
+  if (!loadWidgetModel(model)) {
+    model.eventCount = 0;
+  }
+  R::init(display, false);
+  R::beginFrame(display, REFRESH_FULL);
+  R::splitScreenLayout(display);
+  if (shown.valid) {
+    R::rasterizeForecast(forecastRaster, shown.hourly, now);
+    R::weatherData(display, shown.current, forecastRaster);
+  }
+  R::calendarEvents(display, shownEvents);
+  R::clockWidget(display, now, model);
+  R::staleMarkers(display, now, shown.valid ? shown.fetchedAt : 0, shownEvents.lastUpdated);
+}
+
+// Least-squares slope of a sampled quantity against the cycle number
+template <typename Value>
+static double trend(const std::vector<SoakSample> &samples, size_t first, Value value) {
+  double n = samples.size() - first, sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+  for (size_t i = first; i < samples.size(); i++) {
+    double x = samples[i].cycle, y = value(samples[i]);
+    sumX += x;
+    sumY += y;
+    sumXX += x * x;
+    sumXY += x * y;
+  }
+  double denominator = n * sumXX - sumX * sumX;
+  return denominator > 0 ? (n * sumXY - sumX * sumY) / denominator : 0;
+}
+
+static bool parseOptions(int argc, char **argv, SoakOptions &options) {
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "--cycles") == 0 && hasValue) {
+      options.cycles = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--samples") == 0 && hasValue) {
+      options.samples = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--fixtures") == 0 && hasValue) {
+      options.fixtures = argv[++i];
+    } else if (strcmp(argv[i], "--arena") == 0 && hasValue) {
+      options.arenaBytes = strtoul(argv[++i], nullptr, 0);
+    } else {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return false;
+    }
+  }
+  // Three samples after the warmup at the least, for a trend
+  unsigned minSamples = 3 * 100 / (100 - SOAK_WARMUP_PERCENT) + 1;
+  if (options.samples < minSamples) {
+    options.samples = minSamples;
+  }
+  return options.cycles >= options.samples;
+}
+
+int main(int argc, char **argv) {
+  SoakOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+  if (!replayLoad(options.fixtures)) {
+    return 1;
+  }
+
+  // Everything the harness itself keeps is allocated before the arena is armed
+  std::vector<SoakSample> samples;
+  samples.reserve(options.samples);
+  printf("Soaking %u cycles on a %u byte arena\n", options.cycles, (unsigned)options.arenaBytes);
+  printf("%8s %10s %8s %10s %10s %8s %10s %8s\n", "cycle", "live", "blocks", "allocs/cyc", "largest", "free blk",
+         "peak", "failed");
+  fflush(stdout);
+  if (!soakHeapArm(options.arenaBytes)) {
+    fprintf(stderr, "Cannot map a %u byte arena\n", (unsigned)options.arenaBytes);
+    return 1;
+  }
+
+  time_t start = MIN_VALID_EPOCH;
+  uint64_t lastAllocations = 0;
+  unsigned lastCycle = 0;
+  for (unsigned cycle = 1; cycle <= options.cycles; cycle++) {
+    runCycle(start + (time_t)cycle * SOAK_CYCLE_S);
+    if ((uint64_t)cycle * options.samples / options.cycles == (uint64_t)(cycle - 1) * options.samples / options.cycles) {
+      continue;
+    }
+    SoakSample sample;
+    sample.cycle = cycle;
+    soakHeapStats(sample.heap);
+    sample.allocationsPerCycle = (double)(sample.heap.allocations - lastAllocations) / (cycle - lastCycle);
+    lastAllocations = sample.heap.allocations;
+    lastCycle = cycle;
+    samples.push_back(sample);
+    printf("%8u %10u %8u %10.1f %10u %8u %10u %8u\n", cycle, (unsigned)sample.heap.liveBytes,
+           (unsigned)sample.heap.liveBlocks, sample.allocationsPerCycle, (unsigned)sample.heap.largestFree,
+           (unsigned)sample.heap.freeBlocks, (unsigned)sample.heap.peakBytes, (unsigned)sample.heap.failures);
+    fflush(stdout);
+  }
+
+  // Trends past the warmup, as the change they amount to over that span
+  size_t first = samples.size() * SOAK_WARMUP_PERCENT / 100;
+  double span = samples.back().cycle - samples[first].cycle;
+  double liveGrowth = span * trend(samples, first, [](const SoakSample &s) { return (double)s.heap.liveBytes; });
+  double blockGrowth = span * trend(samples, first, [](const SoakSample &s) { return (double)s.heap.liveBlocks; });
+  double freeShrink = -span * trend(samples, first, [](const SoakSample &s) { return (double)s.heap.largestFree; });
+  const SoakHeapStats &last = samples.back().heap;
+  printf("Trend over cycles %u-%u: live %+.0f bytes, %+.1f blocks, largest free block %+.0f bytes (%u requests)\n",
+         samples[first].cycle, samples.back().cycle, liveGrowth, blockGrowth, -freeShrink, replayRequests());
+
+  bool ok = true;
+  if (last.failures > 0) {
+    printf("FAIL: %u allocations did not fit in the arena\n", (unsigned)last.failures);
+    ok = false;
+  }
+  if (liveGrowth > SOAK_LIVE_GROWTH_LIMIT || blockGrowth > SOAK_BLOCK_GROWTH_LIMIT) {
+    printf("FAIL: live heap keeps growing (leak)\n");
+    ok = false;
+  }
+  if (freeShrink > SOAK_LARGEST_FREE_SHRINK_LIMIT) {
+    printf("FAIL: largest free block keeps shrinking (fragmentation)\n");
+    ok = false;
+  }
+  if (ok) {
+    printf("OK\n");
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,107 @@
+#include "replay_http.h"
+#include <HTTPClient.h>
+#include <fstream>
+#include <sstream>
+
+// Fixture per API host
+struct ReplayRoute {
+  const char *host;
+  const char *fixture;
+};
+
+static const ReplayRoute ROUTES[] = {
+  {"api.openweathermap.org", "onecall.json"},
+  {"ip-api.com", "ip-api.json"},
+  {"login.microsoftonline.com", "token.json"},
+  {"graph.microsoft.com", "calendarview.json"},
+};
+
+#define ROUTE_COUNT (sizeof(ROUTES) / sizeof(ROUTES[0]))
+
+// Read once up front, so that loading them never shows up on the soak heap
+static std::string bodies[ROUTE_COUNT];
+static uint32_t requestCount = 0;
+
+bool replayLoad(const char *directory) {
+  for (size_t i = 0; i < ROUTE_COUNT; i++) {
+    std::string path = std::string(directory) + "/" + ROUTES[i].fixture;
+    std::ifstream file(path);
+    if (!file) {
+      fprintf(stderr, "Cannot open fixture %s\n", path.c_str());
+      return false;
+    }
+    std::stringstream text;
+    text << file.rdbuf();
+    bodies[i] = text.str();
+  }
+  return true;
+}
+
+uint32_t replayRequests() {
+  return requestCount;
+}
+
+bool HTTPClient::begin(const String &url) {
+  _url = url.str();
+  _requestHeaders.clear();
+  _responseHeaders.clear();
+  _body.assign(std::string());
+  return true;
+}
+
+void HTTPClient::end() {
+  _requestHeaders.clear();
+}
+
+void HTTPClient::addHeader(const String &name, const String &value, bool, bool) {
+  _requestHeaders.push_back(name.str() + ": " + value.str());
+}
+
+void HTTPClient::collectHeaders(const char *[], size_t) {}
+
+int HTTPClient::GET() {
+  return sendRequest("GET");
+}
+
+int HTTPClient::POST(const String &payload) {
+  return sendRequest("POST", payload);
+}
+
+// Unknown hosts get a 404, as from a server that has moved the API
+int HTTPClient::sendRequest(const char *, const String &) {
+  requestCount++;
+  size_t hostStart = _url.find("://");
+  hostStart = hostStart == std::string::npos ? 0 : hostStart + 3;
+  std::string host = _url.substr(hostStart, _url.find_first_of(":/?", hostStart) - hostStart);
+  for (size_t i = 0; i < ROUTE_COUNT; i++) {
+    if (host == ROUTES[i].host) {
+      _body.assign(bodies[i]);
+      return HTTP_CODE_OK;
+    }
+  }
+  return 404;
+}
+
+String HTTPClient::header(const char *name) {
+  std::string key(name);
+  std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+  auto it = _responseHeaders.find(key);
+  return it == _responseHeaders.end() ? String() : String(it->second);
+}
+
+bool HTTPClient::hasHeader(const char *name) {
+  return !header(name).isEmpty();
+}
+
+String HTTPClient::getString() {
+  String result;
+  int c;
+  while ((c = _body.read()) >= 0) {
+    result += (char)c;
+  }
+  return result;
+}
+
+String HTTPClient::errorToString(int error) {
+  return error == HTTPC_ERROR_READ_TIMEOUT ? String("read timeout") : String("connection failed");
+}
@@ -0,0 +1,16 @@
+#ifndef REPLAY_HTTP_H
+#define REPLAY_HTTP_H
+
+#include <Arduino.h>
+
+// Recorded API responses for the host harnesses.
+// An HTTPClient (server/compat/HTTPClient.h) that answers from fixture files
+// instead of the network: each request is matched to a fixture by host and
+// gets a copy of its body, so the API clients parse the same bytes on every
+// cycle. Linked in place of the libcurl implementation.
+
+// Function declarations
+bool replayLoad(const char *directory);
+uint32_t replayRequests();
+
+#endif // REPLAY_HTTP_H
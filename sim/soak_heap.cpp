@@ -0,0 +1,215 @@
+#include "soak_heap.h"
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+void __libc_free(void *pointer);
+}
+
+// Every block starts with its header; payloads are 16-byte aligned like
+// malloc's. A free block keeps the free-list link in its payload.
+#define HEAP_ALIGN 16
+#define HEAP_MIN_BLOCK 32
+
+struct BlockHeader {
+  size_t size;       // whole block, header included
+  size_t requested;  // bytes asked for; 0 while free
+};
+
+struct FreeBlock : BlockHeader {
+  FreeBlock *next;
+};
+
+static_assert(sizeof(BlockHeader) % HEAP_ALIGN == 0, "payloads must stay aligned");
+
+static pthread_mutex_t heapLock = PTHREAD_MUTEX_INITIALIZER;
+static char *arena = nullptr;
+static size_t arenaSize = 0;
+// Free blocks in address order, so neighbours can be coalesced
+static FreeBlock *freeList = nullptr;
+static SoakHeapStats counters;
+
+static bool inArena(void *pointer) {
+  return arena != nullptr && (char *)pointer >= arena && (char *)pointer < arena + arenaSize;
+}
+
+static BlockHeader *headerOf(void *pointer) {
+  return (BlockHeader *)((char *)pointer - sizeof(BlockHeader));
+}
+
+// First fit; the remainder of a larger block stays on the list in its place
+static void *arenaAlloc(size_t requested) {
+  size_t size = (requested + sizeof(BlockHeader) + HEAP_ALIGN - 1) & ~(size_t)(HEAP_ALIGN - 1);
+  if (size < HEAP_MIN_BLOCK) {
+    size = HEAP_MIN_BLOCK;
+  }
+  for (FreeBlock **link = &freeList; *link != nullptr; link = &(*link)->next) {
+    FreeBlock *block = *link;
+    if (block->size < size) {
+      continue;
+    }
+    if (block->size - size >= HEAP_MIN_BLOCK) {
+      FreeBlock *rest = (FreeBlock *)((char *)block + size);
+      rest->size = block->size - size;
+      rest->requested = 0;
+      rest->next = block->next;
+      *link = rest;
+      block->size = size;
+    } else {
+      *link = block->next;
+    }
+    block->requested = requested;
+    counters.liveBytes += requested;
+    counters.liveBlocks++;
+    counters.allocations++;
+    if (counters.liveBytes > counters.peakBytes) {
+      counters.peakBytes = counters.liveBytes;
+    }
+    return (char *)block + sizeof(BlockHeader);
+  }
+  return nullptr;
+}
+
+static void arenaFree(void *pointer) {
+  FreeBlock *block = (FreeBlock *)headerOf(pointer);
+  counters.liveBytes -= block->requested;
+  counters.liveBlocks--;
+  block->requested = 0;
+
+  FreeBlock *previous = nullptr;
+  FreeBlock **link = &freeList;
+  while (*link != nullptr && *link < block) {
+    previous = *link;
+    link = &(*link)->next;
+  }
+  block->next = *link;
+  *link = block;
+  if (block->next != nullptr && (char *)block + block->size == (char *)block->next) {
+    block->size += block->next->size;
+    block->next = block->next->next;
+  }
+  if (previous != nullptr && (char *)previous + previous->size == (char *)block) {
+    previous->size += block->size;
+    previous->next = block->next;
+  }
+}
+
+// Blocks that do not fit are still served, by libc, and counted as failures
+static void *heapAlloc(size_t size) {
+  if (size == 0) {
+    size = 1;
+  }
+  pthread_mutex_lock(&heapLock);
+  void *pointer = arena != nullptr ? arenaAlloc(size) : nullptr;
+  if (pointer == nullptr && arena != nullptr) {
+    counters.failures++;
+  }
+  pthread_mutex_unlock(&heapLock);
+  return pointer != nullptr ? pointer : __libc_malloc(size);
+}
+
+bool soakHeapArm(size_t arenaBytes) {
+  arenaBytes &= ~(size_t)(HEAP_ALIGN - 1);
+  void *memory = mmap(nullptr, arenaBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED || arenaBytes < HEAP_MIN_BLOCK) {
+    return false;
+  }
+  pthread_mutex_lock(&heapLock);
+  arena = (char *)memory;
+  arenaSize = arenaBytes;
+  freeList = (FreeBlock *)arena;
+  freeList->size = arenaBytes;
+  freeList->requested = 0;
+  freeList->next = nullptr;
+  memset(&counters, 0, sizeof(counters));
+  pthread_mutex_unlock(&heapLock);
+  return true;
+}
+
+void soakHeapStats(SoakHeapStats &stats) {
+  pthread_mutex_lock(&heapLock);
+  stats = counters;
+  stats.freeBytes = 0;
+  stats.largestFree = 0;
+  stats.freeBlocks = 0;
+  for (FreeBlock *block = freeList; block != nullptr; block = block->next) {
+    size_t usable = block->size - sizeof(BlockHeader);
+    stats.freeBytes += usable;
+    stats.freeBlocks++;
+    if (usable > stats.largestFree) {
+      stats.largestFree = usable;
+    }
+  }
+  pthread_mutex_unlock(&heapLock);
+}
+
+extern "C" {
+
+void *malloc(size_t size) {
+  return heapAlloc(size);
+}
+
+void free(void *pointer) {
+  if (pointer == nullptr) {
+    return;
+  }
+  if (!inArena(pointer)) {
+    __libc_free(pointer);
+    return;
+  }
+  pthread_mutex_lock(&heapLock);
+  arenaFree(pointer);
+  pthread_mutex_unlock(&heapLock);
+}
+
+void *calloc(size_t count, size_t size) {
+  if (size != 0 && count > (size_t)-1 / size) {
+    return nullptr;
+  }
+  if (arena == nullptr) {
+    return __libc_calloc(count, size);
+  }
+  void *pointer = heapAlloc(count * size);
+  memset(pointer, 0, count * size);
+  return pointer;
+}
+
+// Moves to a new block unless the old one is already big enough, as the
+// ESP32 heap does when the next block is not free
+void *realloc(void *pointer, size_t size) {
+  if (pointer == nullptr) {
+    return malloc(size);
+  }
+  if (!inArena(pointer)) {
+    return __libc_realloc(pointer, size);
+  }
+  if (size == 0) {
+    free(pointer);
+    return nullptr;
+  }
+  pthread_mutex_lock(&heapLock);
+  BlockHeader *header = headerOf(pointer);
+  size_t old = header->requested;
+  bool fits = header->size - sizeof(BlockHeader) >= size;
+  if (fits) {
+    counters.liveBytes += size - old;
+    header->requested = size;
+    if (counters.liveBytes > counters.peakBytes) {
+      counters.peakBytes = counters.liveBytes;
+    }
+  }
+  pthread_mutex_unlock(&heapLock);
+  if (fits) {
+    return pointer;
+  }
+  void *moved = heapAlloc(size);
+  memcpy(moved, pointer, old < size ? old : size);
+  free(pointer);
+  return moved;
+}
+
+}  // extern "C"
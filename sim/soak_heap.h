@@ -0,0 +1,30 @@
+#ifndef SOAK_HEAP_H
+#define SOAK_HEAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Instrumented heap for the soak harness.
+// Replaces malloc/free (and with them operator new/delete) for the whole
+// process. Once armed, allocations come from a fixed arena managed like the
+// ESP32's heap: a first-fit free list in address order, split on allocation
+// and coalesced on free. That way fragmentation shows up as a shrinking
+// largest free block, just as heap_caps_get_largest_free_block() reports it
+// on the device. Blocks allocated before arming stay with libc.
+
+struct SoakHeapStats {
+  size_t liveBytes;       // requested bytes not yet freed
+  size_t liveBlocks;
+  uint64_t allocations;   // since arming
+  size_t freeBytes;
+  size_t largestFree;     // largest single allocation that would succeed
+  size_t freeBlocks;
+  size_t peakBytes;
+  uint64_t failures;      // requests the arena could not satisfy
+};
+
+// Function declarations
+bool soakHeapArm(size_t arenaBytes);
+void soakHeapStats(SoakHeapStats &stats);
+
+#endif // SOAK_HEAP_H
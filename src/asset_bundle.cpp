@@ -0,0 +1,199 @@
+#include "asset_bundle.h"
+#include "binlog.h"
+#ifdef SERVER_BUILD
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <esp_partition.h>
+#endif
+
+#define ICON_ATLAS_HEADER_SIZE 8
+#define GLYPH_SET_HEADER_SIZE 8
+
+struct BundledFont {
+  const char *name;
+  GFXfont font;
+};
+
+// The mapped bundle; set once at startup and read-only afterwards, so the
+// frame server's render threads can share it
+static const uint8_t *bundle = nullptr;
+static uint32_t bundleSize = 0;
+static BundledFont fonts[ASSET_MAX_FONTS];
+static uint8_t fontCount = 0;
+
+static uint16_t readU16(const uint8_t *p) {
+  return p[0] | (p[1] << 8);
+}
+
+static const AssetDirectoryEntry *directory() {
+  return (const AssetDirectoryEntry *)(bundle + sizeof(AssetBundleHeader));
+}
+
+static uint16_t assetCount() {
+  return ((const AssetBundleHeader *)bundle)->count;
+}
+
+// Check the header and that every entry lies inside the bundle
+static bool validBundle(const uint8_t *data, size_t length) {
+  if (length < sizeof(AssetBundleHeader)) {
+    return false;
+  }
+  const AssetBundleHeader *header = (const AssetBundleHeader *)data;
+  if (header->magic != ASSET_BUNDLE_MAGIC || header->version != ASSET_BUNDLE_VERSION || header->size > length ||
+      sizeof(AssetBundleHeader) + (size_t)header->count * sizeof(AssetDirectoryEntry) > header->size) {
+    return false;
+  }
+  const AssetDirectoryEntry *entries = (const AssetDirectoryEntry *)(data + sizeof(AssetBundleHeader));
+  for (uint16_t i = 0; i < header->count; i++) {
+    const AssetDirectoryEntry &entry = entries[i];
+    if (entry.name[ASSET_NAME_LENGTH - 1] != '\0' || entry.offset % 4 != 0 || entry.offset > header->size ||
+        entry.size > header->size - entry.offset) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// GFXfonts whose glyph table and bitmaps point straight into the bundle
+static void loadFonts() {
+  fontCount = 0;
+  const AssetDirectoryEntry *entries = directory();
+  for (uint16_t i = 0; i < assetCount() && fontCount < ASSET_MAX_FONTS; i++) {
+    const AssetDirectoryEntry &entry = entries[i];
+    if (entry.type != ASSET_GLYPH_SET || entry.size < GLYPH_SET_HEADER_SIZE) {
+      continue;
+    }
+    const uint8_t *data = bundle + entry.offset;
+    uint16_t first = readU16(data);
+    uint16_t last = readU16(data + 2);
+    size_t glyphBytes = (size_t)(last - first + 1) * sizeof(GFXglyph);
+    if (last < first || GLYPH_SET_HEADER_SIZE + glyphBytes > entry.size) {
+      LOG(ASSET_INVALID, entry.name);
+      continue;
+    }
+
+    BundledFont &bundled = fonts[fontCount++];
+    bundled.name = entry.name;
+    bundled.font.glyph = (GFXglyph *)(data + GLYPH_SET_HEADER_SIZE);
+    bundled.font.bitmap = (uint8_t *)(data + GLYPH_SET_HEADER_SIZE + glyphBytes);
+    bundled.font.first = first;
+    bundled.font.last = last;
+    bundled.font.yAdvance = data[4];
+  }
+}
+
+static bool useBundle(const uint8_t *data, size_t length) {
+  if (!validBundle(data, length)) {
+    LOG(ASSETS_INVALID);
+    return false;
+  }
+  bundle = data;
+  bundleSize = ((const AssetBundleHeader *)data)->size;
+  loadFonts();
+  LOG(ASSETS_MAPPED, assetCount(), bundleSize, fontCount);
+  return true;
+}
+
+#ifdef SERVER_BUILD
+// Map a bundle file; the mapping lives as long as the process
+bool assetsBegin(const char *source) {
+  int fd = open(source, O_RDONLY);
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) != 0 || info.st_size == 0) {
+    LOG(ASSETS_MISSING, source);
+    if (fd >= 0) {
+      close(fd);
+    }
+    return false;
+  }
+  void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    LOG(ASSETS_MISSING, source);
+    return false;
+  }
+  if (!useBundle((const uint8_t *)data, info.st_size)) {
+    munmap(data, info.st_size);
+    return false;
+  }
+  return true;
+}
+#else
+// Map the asset partition into the data address space. The mapping is kept
+// until deep sleep; the partition is never written at runtime.
+bool assetsBegin(const char *source) {
+  if (bundle != nullptr) {
+    return true;
+  }
+  const esp_partition_t *partition =
+      esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)ASSET_PARTITION_SUBTYPE, source);
+  if (partition == nullptr) {
+    LOG(ASSETS_MISSING, source);
+    return false;
+  }
+  const void *data;
+  esp_partition_mmap_handle_t handle;
+  if (esp_partition_mmap(partition, 0, partition->size, ESP_PARTITION_MMAP_DATA, &data, &handle) != ESP_OK) {
+    LOG(ASSETS_MISSING, source);
+    return false;
+  }
+  return useBundle((const uint8_t *)data, partition->size);
+}
+#endif
+
+// Entry of the given name and type, or nullptr if the bundle has none
+const uint8_t *findAsset(const char *name, AssetType type, uint32_t &size) {
+  if (bundle == nullptr) {
+    return nullptr;
+  }
+  const AssetDirectoryEntry *entries = directory();
+  for (uint16_t i = 0; i < assetCount(); i++) {
+    if (entries[i].type == type && strcmp(entries[i].name, name) == 0) {
+      size = entries[i].size;
+      return bundle + entries[i].offset;
+    }
+  }
+  return nullptr;
+}
+
+bool findIconAtlas(const char *name, IconAtlas &atlas) {
+  uint32_t size;
+  const uint8_t *data = findAsset(name, ASSET_ICON_ATLAS, size);
+  if (data == nullptr || size < ICON_ATLAS_HEADER_SIZE) {
+    return false;
+  }
+  atlas.width = readU16(data);
+  atlas.height = readU16(data + 2);
+  atlas.count = readU16(data + 4);
+  atlas.stride = readU16(data + 6);
+  if (atlas.stride < (atlas.width + 7) / 8 * atlas.height ||
+      ICON_ATLAS_HEADER_SIZE + (size_t)atlas.count * (4 + atlas.stride) > size) {
+    return false;
+  }
+  atlas.codes = (const char (*)[4])(data + ICON_ATLAS_HEADER_SIZE);
+  atlas.bitmaps = data + ICON_ATLAS_HEADER_SIZE + atlas.count * 4;
+  return true;
+}
+
+// Bitmap for an icon code, or nullptr if the atlas does not have it
+const uint8_t *atlasIcon(const IconAtlas &atlas, const char *code) {
+  for (uint16_t i = 0; i < atlas.count; i++) {
+    if (strncmp(atlas.codes[i], code, 4) == 0) {
+      return atlas.bitmaps + (size_t)i * atlas.stride;
+    }
+  }
+  return nullptr;
+}
+
+// Bundled glyph set of this name if there is one, else the compiled-in font
+const GFXfont *assetFont(const char *name, const GFXfont *fallback) {
+  for (uint8_t i = 0; i < fontCount; i++) {
+    if (strcmp(fonts[i].name, name) == 0) {
+      return &fonts[i].font;
+    }
+  }
+  return fallback;
+}
@@ -0,0 +1,29 @@
+#include "band_pipeline.h"
+
+BandPipeline::BandPipeline(PanelBus &bus, uint8_t *first, uint8_t *second)
+    : _bus(bus), _next(0), _inFlight(false), _stallUs(0) {
+  _buffers[0] = first;
+  _buffers[1] = second;
+}
+
+// The bus takes one band at a time, so the previous one has to be done
+// first. That also frees its buffer for the band after this one.
+void BandPipeline::send(int16_t y, int16_t count) {
+  if (_inFlight) {
+    uint32_t start = micros();
+    _bus.wait();
+    _stallUs += micros() - start;
+  }
+  _bus.write(_buffers[_next], y, count);
+  _inFlight = true;
+  _next ^= 1;
+}
+
+void BandPipeline::finish() {
+  if (_inFlight) {
+    uint32_t start = micros();
+    _bus.wait();
+    _stallUs += micros() - start;
+    _inFlight = false;
+  }
+}
@@ -0,0 +1,163 @@
+#include "battery.h"
+#include "civil_time.h"
+
+// Resting Li-ion voltage against remaining charge, at the light load of a
+// sleeping ESP32; interpolated linearly in between
+struct ChargePoint {
+  uint16_t millivolts;
+  uint8_t percent;
+};
+
+static const ChargePoint DISCHARGE_CURVE[] = {
+  {4200, 100}, {4060, 90}, {3980, 80}, {3920, 70}, {3870, 60}, {3820, 50},
+  {3790, 40}, {3770, 30}, {3740, 20}, {3680, 10}, {3450, 5}, {3300, 0}
+};
+
+static const char *LEVEL_NAMES[] = {"normal", "low", "critical", "empty"};
+
+uint8_t batteryPercentFor(uint16_t millivolts) {
+  const int points = sizeof(DISCHARGE_CURVE) / sizeof(DISCHARGE_CURVE[0]);
+  if (millivolts >= DISCHARGE_CURVE[0].millivolts) {
+    return 100;
+  }
+  for (int i = 1; i < points; i++) {
+    const ChargePoint &upper = DISCHARGE_CURVE[i - 1];
+    const ChargePoint &lower = DISCHARGE_CURVE[i];
+    if (millivolts >= lower.millivolts) {
+      return lower.percent + (uint32_t)(millivolts - lower.millivolts) * (upper.percent - lower.percent) /
+                                 (upper.millivolts - lower.millivolts);
+    }
+  }
+  return 0;
+}
+
+// One reading per history interval; earlier ones are overwritten
+static void recordHistory(BatteryHistory &history, uint16_t millivolts, time_t now) {
+  if (history.count > 0) {
+    uint8_t last = (history.next + BATTERY_HISTORY_SIZE - 1) % BATTERY_HISTORY_SIZE;
+    if (now < (time_t)history.times[last]) {
+      // The clock was set back; the old readings no longer line up
+      history.count = 0;
+    } else if (now - (time_t)history.times[last] < BATTERY_HISTORY_INTERVAL_S) {
+      return;
+    }
+  }
+  history.times[history.next] = now;
+  history.millivolts[history.next] = millivolts;
+  history.next = (history.next + 1) % BATTERY_HISTORY_SIZE;
+  if (history.count < BATTERY_HISTORY_SIZE) {
+    history.count++;
+  }
+}
+
+// Level for a reading. A level is only left upwards once the charge is
+// clear of its threshold, so a reading wobbling around one does not flip
+// the policy from wake to wake.
+static BatteryLevel levelFor(const BatteryState &state, BatteryLevel previous) {
+  if (state.millivolts == 0) {
+    return BATTERY_NORMAL;
+  }
+  if (previous == BATTERY_EMPTY) {
+    return state.millivolts < BATTERY_EMPTY_MV + BATTERY_RECOVERY_MV ? BATTERY_EMPTY : BATTERY_CRITICAL;
+  }
+  if (state.millivolts < BATTERY_EMPTY_MV) {
+    return BATTERY_EMPTY;
+  }
+
+  BatteryLevel level = BATTERY_NORMAL;
+  if (state.percent < BATTERY_CRITICAL_PERCENT) {
+    level = BATTERY_CRITICAL;
+  } else if (state.percent < BATTERY_LOW_PERCENT || batteryHoursLeft(state) < BATTERY_LOW_HOURS_LEFT) {
+    level = BATTERY_LOW;
+  }
+  if (level < previous) {
+    uint8_t threshold = previous == BATTERY_CRITICAL ? BATTERY_CRITICAL_PERCENT : BATTERY_LOW_PERCENT;
+    if (state.percent < threshold + BATTERY_HYSTERESIS_PERCENT) {
+      level = previous;
+    }
+  }
+  return level;
+}
+
+// Measure, and move the level on. Without a valid clock the reading is not
+// added to the history, since its time would be meaningless.
+void batteryUpdate(BatteryState &state, VoltageSource source, time_t now) {
+  uint16_t millivolts = source();
+  state.millivolts = millivolts >= BATTERY_ABSENT_MV ? millivolts : 0;
+  state.percent = state.millivolts != 0 ? batteryPercentFor(state.millivolts) : 0;
+  if (state.millivolts != 0 && now >= MIN_VALID_EPOCH) {
+    recordHistory(state.history, state.millivolts, now);
+  }
+  state.level = levelFor(state, state.level);
+}
+
+// Charge lost per day (percent), from a least-squares line through the
+// history; 0 until it spans a few hours or while the charge is not falling
+float batteryDischargeRate(const BatteryState &state) {
+  const BatteryHistory &history = state.history;
+  if (history.count < 3) {
+    return 0;
+  }
+  uint8_t oldest = (history.next + BATTERY_HISTORY_SIZE - history.count) % BATTERY_HISTORY_SIZE;
+  uint32_t start = history.times[oldest];
+  uint8_t newest = (history.next + BATTERY_HISTORY_SIZE - 1) % BATTERY_HISTORY_SIZE;
+  if (history.times[newest] - start < BATTERY_RATE_MIN_SPAN_S) {
+    return 0;
+  }
+
+  float sumT = 0, sumP = 0, sumTT = 0, sumTP = 0;
+  for (uint8_t i = 0; i < history.count; i++) {
+    uint8_t slot = (oldest + i) % BATTERY_HISTORY_SIZE;
+    float days = (history.times[slot] - start) / 86400.0f;
+    float percent = batteryPercentFor(history.millivolts[slot]);
+    sumT += days;
+    sumP += percent;
+    sumTT += days * days;
+    sumTP += days * percent;
+  }
+  float n = history.count;
+  float denominator = n * sumTT - sumT * sumT;
+  if (denominator <= 0) {
+    return 0;
+  }
+  float slope = (n * sumTP - sumT * sumP) / denominator;
+  return slope < 0 ? -slope : 0;
+}
+
+// Hours until the charge runs out at the current rate; very large if unknown
+float batteryHoursLeft(const BatteryState &state) {
+  float rate = batteryDischargeRate(state);
+  if (rate <= 0) {
+    return 1e6f;
+  }
+  return state.percent / rate * 24;
+}
+
+PowerPolicy powerPolicyFor(BatteryLevel level) {
+  switch (level) {
+    case BATTERY_LOW:
+      return {DATA_INTERVAL_S * 2, 2 * 60 * 60, false, 2, false, false};
+    case BATTERY_CRITICAL:
+      return {DATA_INTERVAL_S * 4, 6 * 60 * 60, false, 4, false, false};
+    case BATTERY_EMPTY:
+      return {0, 0, false, 4, false, true};
+    default:
+      return {DATA_INTERVAL_S, 0, true, 1, true, false};
+  }
+}
+
+// Ghosting budgets stretched by the policy; without quiet-hour cleaning the
+// quiet window is left empty
+RefreshPolicyConfig refreshConfigFor(const PowerPolicy &policy, const RefreshPolicyConfig &base) {
+  RefreshPolicyConfig config = base;
+  config.partialBudget = base.partialBudget * policy.refreshBudgetFactor;
+  config.fastFullBudget = base.fastFullBudget * policy.refreshBudgetFactor;
+  if (!policy.quietCleaning) {
+    config.quietEndHour = config.quietStartHour;
+  }
+  return config;
+}
+
+const char *batteryLevelName(BatteryLevel level) {
+  return LEVEL_NAMES[level];
+}
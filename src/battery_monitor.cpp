@@ -0,0 +1,58 @@
+#include "battery.h"
+#include "refresh_policy.h"
+#include "binlog.h"
+
+#define BATTERY_MAGIC 0x42415431
+
+// Battery state kept across deep sleep
+struct BatteryMonitor {
+  uint32_t magic;
+  BatteryState state;
+};
+
+RTC_DATA_ATTR static BatteryMonitor batteryMonitor;
+
+static PowerPolicy powerPolicy = powerPolicyFor(BATTERY_NORMAL);
+
+// Averaged over a burst of reads; analogReadMilliVolts() applies the
+// ADC's factory calibration
+uint16_t readBatteryMillivolts() {
+  uint32_t sum = 0;
+  for (int i = 0; i < BATTERY_ADC_SAMPLES; i++) {
+    sum += analogReadMilliVolts(BATTERY_ADC_PIN);
+  }
+  return sum * BATTERY_DIVIDER_RATIO / BATTERY_ADC_SAMPLES;
+}
+
+// Measure the battery and set this wake's policy from its level
+const PowerPolicy &batteryCheck(time_t now) {
+  if (batteryMonitor.magic != BATTERY_MAGIC) {
+    memset(&batteryMonitor, 0, sizeof(batteryMonitor));
+    batteryMonitor.magic = BATTERY_MAGIC;
+  }
+  BatteryState &state = batteryMonitor.state;
+  BatteryLevel previous = state.level;
+  batteryUpdate(state, readBatteryMillivolts, now);
+  LOG(BATTERY_READING, state.millivolts, state.percent);
+  if (state.level != previous) {
+    LOG(BATTERY_LEVEL, batteryLevelName(state.level), state.percent, batteryDischargeRate(state));
+  }
+
+  powerPolicy = powerPolicyFor(state.level);
+  setRefreshPolicyConfig(refreshConfigFor(powerPolicy, DEFAULT_REFRESH_POLICY));
+  return powerPolicy;
+}
+
+const PowerPolicy &currentPowerPolicy() {
+  return powerPolicy;
+}
+
+// Charge shown in the header, in 5% steps so ADC noise does not redraw it;
+// -1 hides the gauge when there is no battery
+int batteryGaugePercent() {
+  const BatteryState &state = batteryMonitor.state;
+  if (batteryMonitor.magic != BATTERY_MAGIC || state.millivolts == 0) {
+    return -1;
+  }
+  return (state.percent + 2) / 5 * 5;
+}
@@ -0,0 +1,147 @@
+#include "binlog.h"
+#include <atomic>
+
+#define LOG_RING_MAGIC 0x424c4f47
+#define LOG_RING_MASK (LOG_RING_WORDS - 1)
+// Heads past this are power-on garbage; a real one takes years to get there
+#define LOG_RING_HEAD_LIMIT 0x80000000u
+// Record header: 0xA5 mark, payload word count, message ID
+#define LOG_RECORD_MARK 0xA5000000u
+
+// The ring survives deep sleep and crash resets. RTC_DATA_ATTR would not:
+// the bootloader reloads that section on every reset but deep sleep. After
+// power-on the words are garbage, which the magic and head checks catch.
+#ifndef SERVER_BUILD
+RTC_NOINIT_ATTR static uint32_t logRingMagic;
+#endif
+RTC_NOINIT_ATTR static uint32_t logRingHead;
+RTC_NOINIT_ATTR static uint32_t logRing[LOG_RING_WORDS];
+
+// Writers reserve their words by bumping this counter, so no writer ever
+// waits on another. It lives in DRAM because the atomic instructions do not
+// work on RTC memory, and is mirrored to logRingHead after every record.
+static std::atomic<uint32_t> logHead(0);
+
+#if LOG_ECHO_SERIAL
+static const char *const LOG_FORMATS[LOG_MESSAGE_COUNT] = {
+#define LOG_MESSAGE(name, level, format) format,
+#include "log_messages.h"
+#undef LOG_MESSAGE
+};
+
+// Format a message the same way tools/decode_log.py does
+static void logEcho(LogId id, std::initializer_list<LogArg> args) {
+  char line[160];
+  size_t length = 0;
+  const char *format = LOG_FORMATS[id];
+  const LogArg *arg = args.begin();
+
+  while (*format != '\0' && length < sizeof(line) - 1) {
+    if (*format != '%' || format[1] == '%') {
+      line[length++] = *format;
+      format += *format == '%' ? 2 : 1;
+      continue;
+    }
+
+    // Copy one conversion spec, e.g. "%-6.1f"
+    char spec[16];
+    size_t n = 0;
+    do {
+      spec[n++] = *format++;
+    } while (*format != '\0' && strchr("diuxXcfs", *format) == nullptr && n < sizeof(spec) - 2);
+    char conversion = *format;
+    if (conversion != '\0') {
+      spec[n++] = *format++;
+    }
+    spec[n] = '\0';
+    if (arg == args.end()) {
+      break;
+    }
+
+    int written;
+    if (conversion == 's') {
+      written = snprintf(line + length, sizeof(line) - length, spec, arg->str != nullptr ? arg->str : "");
+    } else if (conversion == 'f') {
+      float value;
+      memcpy(&value, &arg->word, sizeof(value));
+      written = snprintf(line + length, sizeof(line) - length, spec, (double)value);
+    } else {
+      written = snprintf(line + length, sizeof(line) - length, spec, arg->word);
+    }
+    length = min<size_t>(length + max(written, 0), sizeof(line) - 1);
+    ++arg;
+  }
+  line[length] = '\0';
+  Serial.println(line);
+}
+#endif
+
+// Append one record: header, millis(), then the arguments. Strings are a
+// length word followed by their bytes packed little-endian.
+void logWrite(LogId id, std::initializer_list<LogArg> args) {
+  uint32_t payload = 0;
+  for (const LogArg &arg : args) {
+    payload += arg.str == nullptr ? 1 : 1 + (strnlen(arg.str, LOG_STRING_MAX) + 3) / 4;
+  }
+
+  uint32_t start = logHead.fetch_add(2 + payload, std::memory_order_relaxed);
+  uint32_t pos = start + 1;
+  logRing[pos++ & LOG_RING_MASK] = millis();
+  for (const LogArg &arg : args) {
+    if (arg.str == nullptr) {
+      logRing[pos++ & LOG_RING_MASK] = arg.word;
+      continue;
+    }
+    size_t length = strnlen(arg.str, LOG_STRING_MAX);
+    logRing[pos++ & LOG_RING_MASK] = length;
+    for (size_t i = 0; i < length; i += 4) {
+      uint32_t word = 0;
+      for (size_t b = 0; b < 4 && i + b < length; b++) {
+        word |= (uint32_t)(uint8_t)arg.str[i + b] << (8 * b);
+      }
+      logRing[pos++ & LOG_RING_MASK] = word;
+    }
+  }
+
+  // The header goes in last, so a record cut short by a crash is skipped
+  logRing[start & LOG_RING_MASK] = LOG_RECORD_MARK | (payload << 16) | id;
+  logRingHead = logHead.load(std::memory_order_relaxed);
+
+#if LOG_ECHO_SERIAL
+  logEcho(id, args);
+#endif
+}
+
+// Print the ring for tools/decode_log.py: a header line with the word range,
+// then the words oldest first in hex, eight per line
+void logDump() {
+  uint32_t head = logHead.load();
+  uint32_t first = head > LOG_RING_WORDS ? head - LOG_RING_WORDS : 0;
+  Serial.printf("BINLOG %u %u\n", (unsigned)first, (unsigned)head);
+  for (uint32_t i = first; i < head; i++) {
+    Serial.printf("%08x%c", (unsigned)logRing[i & LOG_RING_MASK], (i - first) % 8 == 7 || i + 1 == head ? '\n' : ' ');
+  }
+  Serial.println("BINLOG END");
+  // Sleep would cut off whatever is still queued for the UART
+  Serial.flush();
+}
+
+#ifndef SERVER_BUILD
+// Pick up the ring where the last wake left it and mark the start of this
+// one. After any reset other than power-on or deep sleep (a crash, watchdog,
+// brownout or restart) the ring is dumped as the post-mortem trail.
+void logBegin() {
+  esp_reset_reason_t reason = esp_reset_reason();
+  if (reason == ESP_RST_POWERON || logRingMagic != LOG_RING_MAGIC || logRingHead >= LOG_RING_HEAD_LIMIT) {
+    memset(logRing, 0, sizeof(logRing));
+    logRingHead = 0;
+    logRingMagic = LOG_RING_MAGIC;
+  }
+  logHead.store(logRingHead);
+
+  LOG(WAKE, (unsigned)reason, (unsigned)time(nullptr));
+  if (reason != ESP_RST_POWERON && reason != ESP_RST_DEEPSLEEP) {
+    logDump();
+  }
+}
+#endif
@@ -1,5 +1,9 @@
 #include "calendar.h"
 #include "config.h"
+#include "http_stream.h"
+#include "net_session.h"
+#include "binlog.h"
+#include "civil_time.h"
 #include <HTTPClient.h>
 #include <ArduinoJson.h>
 #include <WiFiClientSecure.h>
@@ -9,14 +13,21 @@ const char* GRAPH_API_ENDPOINT = "https://graph.microsoft.com/v1.0/me/calendarvi
 // Microsoft OAuth endpoints
 const char* MS_AUTH_ENDPOINT = "https://login.microsoftonline.com/common/oauth2/v2.0/token";
 
+// Access token from the last token refresh, sent with the Graph requests.
+// The frame server refreshes tokens for several devices at once.
+#ifdef SERVER_BUILD
+static thread_local String accessToken;
+#else
+static String accessToken;
+#endif
+
 // Authenticate with Microsoft OAuth
 bool authenticateMicrosoft() {
   // This is a simplified implementation
   // In a real application, you would need to implement the OAuth 2.0 flow
   // including device code flow or authorization code flow
   
-  Serial.println("Microsoft authentication not fully implemented");
-  Serial.println("In a real application, you would need to implement the OAuth 2.0 flow");
+  LOG(MSFT_AUTH_STUB);
   
   // For testing purposes, assume authentication succeeded
   return true;
@@ -24,121 +35,173 @@ bool authenticateMicrosoft() {
 
 // Refresh Microsoft access token using refresh token
 bool refreshMicrosoftToken() {
-  // Access the global config variable
-  extern Config config;
-  
-  if (config.msftRefreshToken.isEmpty()) {
-    Serial.println("No refresh token available");
+  String refreshToken = loadRefreshToken();
+  if (refreshToken.length() == 0) {
+    LOG(MSFT_NO_REFRESH_TOKEN);
     return false;
   }
   
-  HTTPClient http;
-  http.begin(MS_AUTH_ENDPOINT);
+  HTTPClient &http = beginRequest(MS_AUTH_ENDPOINT);
   http.addHeader("Content-Type", "application/x-www-form-urlencoded");
+  prepareCompressedRequest(http);
+  applyRequestDeadline(http);
   
-  String postData = "client_id=" + config.msftClientId;
-  postData += "&refresh_token=" + config.msftRefreshToken;
+  String postData = "client_id=" + String(config.msftClientId);
+  postData += "&refresh_token=" + refreshToken;
   postData += "&grant_type=refresh_token";
-  postData += "&client_secret=" + config.msftClientSecret;
+  postData += "&client_secret=" + String(config.msftClientSecret);
   
   int httpCode = http.POST(postData);
   if (httpCode != HTTP_CODE_OK) {
-    Serial.printf("Token refresh failed, error: %d\n", httpCode);
+    LOG(TOKEN_HTTP_FAILED, httpCode);
     http.end();
     return false;
   }
   
-  String payload = http.getString();
+  // Parse JSON response directly from the connection, skipping the ID token
+  StaticJsonDocument<64> filter;
+  filter["access_token"] = true;
+  filter["refresh_token"] = true;
+  // Both tokens are kept, each up to a few KB
+  DynamicJsonDocument doc(2 * REFRESH_TOKEN_MAX);
+  DeserializationError error = deserializeResponse(http, doc, DeserializationOption::Filter(filter));
   http.end();
   
-  // Parse JSON response
-  DynamicJsonDocument doc(4096);
-  DeserializationError error = deserializeJson(doc, payload);
-  
   if (error) {
-    Serial.print("Token JSON parsing failed: ");
-    Serial.println(error.c_str());
+    LOG(TOKEN_PARSE_FAILED, error.c_str());
     return false;
   }
   
-  // Extract and save new refresh token
+  accessToken = doc["access_token"] | "";
+  
+  // Extract and save new refresh token (only written to flash if it rotated)
   if (doc.containsKey("refresh_token")) {
-    config.msftRefreshToken = doc["refresh_token"].as<String>();
-    saveConfig();
+    saveRefreshToken(doc["refresh_token"].as<const char*>());
   }
   
   return true;
 }
 
-// Get calendar events from Microsoft Outlook
+// Parse a Graph dateTime ("2024-06-03T09:30:00.0000000", UTC as asked for
+// in the Prefer header). All-day events are dated in the local calendar, so
+// their date is taken at local midnight.
+static time_t parseGraphTime(const char *text, bool allDay) {
+  int year, month, day, hour = 0, minute = 0, second = 0;
+  if (text == nullptr || sscanf(text, "%d-%d-%dT%d:%d:%d", &year, &month, &day, &hour, &minute, &second) < 3) {
+    return 0;
+  }
+  if (allDay) {
+    time_t noon = utcEpoch(year, month, day, 12 * 3600);
+    return startOfDay(noon - utcOffsetAt(noon));
+  }
+  return utcEpoch(year, month, day, hour * 3600 + minute * 60 + second);
+}
+
+// Get calendar events from Microsoft Outlook. The window is read a page at a
+// time through a filter into one reused document, so memory stays the same
+// however busy the calendar is, and paging stops once the pane is full.
 bool getCalendarEvents(CalendarEvents &events) {
   // Check if we need to authenticate or refresh token
-  if (config.msftRefreshToken.isEmpty()) {
+  if (loadRefreshToken().length() == 0) {
     if (!authenticateMicrosoft()) {
-      Serial.println("Microsoft authentication failed");
+      LOG(MSFT_AUTH_FAILED);
       return false;
     }
   } else {
     if (!refreshMicrosoftToken()) {
-      Serial.println("Microsoft token refresh failed");
+      LOG(MSFT_TOKEN_FAILED);
       return false;
     }
   }
+  if (accessToken.length() == 0) {
+    LOG(MSFT_AUTH_FAILED);
+    return false;
+  }
   
-  // Calculate time range for calendar events (today and next 7 days)
+  // Calculate time range for calendar events (today and next 7 days),
+  // starting at local midnight so events bucket into the user's days
   time_t now = time(nullptr);
-  struct tm timeinfo;
-  gmtime_r(&now, &timeinfo);
-  
-  // Set to start of day
-  timeinfo.tm_hour = 0;
-  timeinfo.tm_min = 0;
-  timeinfo.tm_sec = 0;
-  time_t startTime = mktime(&timeinfo);
-  
-  // Set to 7 days later
-  timeinfo.tm_mday += 7;
-  time_t endTime = mktime(&timeinfo);
+  time_t startTime = startOfDay(now);
+  time_t endTime = addLocalDays(startTime, 7);
   
   // Format times for API request
   char startTimeStr[30], endTimeStr[30];
-  strftime(startTimeStr, sizeof(startTimeStr), "%Y-%m-%dT%H:%M:%SZ", gmtime(&startTime));
-  strftime(endTimeStr, sizeof(endTimeStr), "%Y-%m-%dT%H:%M:%SZ", gmtime(&endTime));
-  
-  // Prepare API request
+  struct tm utc;
+  utcTime(startTime, utc);
+  strftime(startTimeStr, sizeof(startTimeStr), "%Y-%m-%dT%H:%M:%SZ", &utc);
+  utcTime(endTime, utc);
+  strftime(endTimeStr, sizeof(endTimeStr), "%Y-%m-%dT%H:%M:%SZ", &utc);
+  
+  // Prepare API request. Later pages come from @odata.nextLink, which keeps
+  // the query.
   String url = String(GRAPH_API_ENDPOINT);
   url += "?startDateTime=" + String(startTimeStr);
   url += "&endDateTime=" + String(endTimeStr);
   url += "&$select=subject,start,end,location,isAllDay";
   url += "&$orderby=start/dateTime";
-  url += "&$top=50";
-  
-  // This is a simplified implementation
-  // In a real application, you would need to include the access token in the request
+  url += "&$top=" + String(CALENDAR_PAGE_SIZE);
+  String authorization = "Bearer " + accessToken;
+  
+  // Keep only the fields used below; bodies, attendees and the rest of each
+  // event are skipped by the parser without being stored
+  StaticJsonDocument<256> filter;
+  JsonObject fields = filter["value"].createNestedObject();
+  fields["subject"] = true;
+  fields["start"]["dateTime"] = true;
+  fields["end"]["dateTime"] = true;
+  fields["isAllDay"] = true;
+  fields["location"]["displayName"] = true;
+  filter["@odata.nextLink"] = true;
   
-  Serial.println("Calendar API request not fully implemented");
-  Serial.println("In a real application, you would make an authenticated request to Microsoft Graph API");
-  
-  // For testing purposes, create some dummy events
   events.events.clear();
+  events.events.reserve(CALENDAR_MAX_EVENTS);
+  DynamicJsonDocument page(CALENDAR_PAGE_DOC_BYTES);
+  unsigned pages = 0;
+  bool full = false;
+  while (url.length() > 0 && pages < CALENDAR_MAX_PAGES) {
+    pages++;
+    HTTPClient &http = beginRequest(url);
+    http.addHeader("Authorization", authorization);
+    // UTC times, so no time zone names need parsing
+    http.addHeader("Prefer", "outlook.timezone=\"UTC\"");
+    prepareCompressedRequest(http);
+    applyRequestDeadline(http);
+    
+    int httpCode = http.GET();
+    if (httpCode != HTTP_CODE_OK) {
+      LOG(CALENDAR_HTTP_FAILED, pages, httpCode);
+      http.end();
+      return false;
+    }
+    
+    DeserializationError error = deserializeResponse(http, page, DeserializationOption::Filter(filter));
+    http.end();
+    
+    if (error) {
+      LOG(CALENDAR_PARSE_FAILED, pages, error.c_str());
+      return false;
+    }
+    
+    for (JsonObject item : page["value"].as<JsonArray>()) {
+      if (events.events.size() >= CALENDAR_MAX_EVENTS) {
+        full = true;
+        break;
+      }
+      CalendarEvent event;
+      event.isAllDay = item["isAllDay"] | false;
+      event.title = item["subject"] | "";
+      event.location = item["location"]["displayName"] | "";
+      event.startTime = parseGraphTime(item["start"]["dateTime"].as<const char*>(), event.isAllDay);
+      event.endTime = parseGraphTime(item["end"]["dateTime"].as<const char*>(), event.isAllDay);
+      events.events.push_back(event);
+    }
+    full = full || events.events.size() >= CALENDAR_MAX_EVENTS;
+    
+    // The link is copied out before the document is reused for the next page
+    url = full ? "" : (page["@odata.nextLink"] | "");
+  }
   
-  // Add dummy events
-  CalendarEvent event1;
-  event1.title = "Team Meeting";
-  event1.location = "Conference Room A";
-  event1.startTime = now + 3600; // 1 hour from now
-  event1.endTime = now + 7200;   // 2 hours from now
-  event1.isAllDay = false;
-  events.events.push_back(event1);
-  
-  CalendarEvent event2;
-  event2.title = "Project Deadline";
-  event2.location = "";
-  event2.startTime = now + 86400; // Tomorrow
-  event2.endTime = now + 86400;
-  event2.isAllDay = true;
-  events.events.push_back(event2);
-  
+  LOG(CALENDAR_PAGES, (unsigned)events.events.size(), pages, full ? "window full" : "complete");
   events.lastUpdated = now;
   
   return true;
@@ -0,0 +1,252 @@
+#include "chart.h"
+#include "civil_time.h"
+
+// Smallest temperature range the chart spreads over its height (degrees)
+#define CHART_MIN_TEMPERATURE_SPAN 4.0f
+// Temperature ticks on the value axis, at most
+#define CHART_TEMPERATURE_TICKS 5
+
+void chartBegin(ChartBitmap &bitmap, uint8_t *bits, int16_t width, int16_t height) {
+  bitmap.bits = bits;
+  bitmap.width = width;
+  bitmap.height = height;
+  bitmap.stride = (width + 7) / 8;
+  memset(bits, 0, bitmap.stride * height);
+}
+
+// Round the range of values out to between 2 and maxTicks ticks on a
+// 1/2/5 step. Ranges narrower than minSpan are widened around their middle,
+// so a flat series does not fill the plot with noise.
+bool chartAxis(const float *values, int count, float minSpan, uint8_t maxTicks, ChartAxis &axis) {
+  if (count <= 0) {
+    return false;
+  }
+  float lo = values[0];
+  float hi = values[0];
+  for (int i = 1; i < count; i++) {
+    lo = min(lo, values[i]);
+    hi = max(hi, values[i]);
+  }
+  if (hi - lo < minSpan) {
+    float middle = (lo + hi) / 2;
+    lo = middle - minSpan / 2;
+    hi = middle + minSpan / 2;
+  }
+  maxTicks = constrain(maxTicks, 2, CHART_MAX_TICKS);
+
+  static const float STEPS[] = {1, 2, 5};
+  float magnitude = powf(10, floorf(log10f((hi - lo) / (maxTicks - 1))));
+  for (int i = 0;; i++) {
+    axis.step = STEPS[i % 3] * magnitude * powf(10, i / 3);
+    axis.min = floorf(lo / axis.step) * axis.step;
+    axis.max = ceilf(hi / axis.step) * axis.step;
+    if (lroundf((axis.max - axis.min) / axis.step) + 1 <= maxTicks) {
+      break;
+    }
+  }
+
+  axis.tickCount = lroundf((axis.max - axis.min) / axis.step) + 1;
+  for (int i = 0; i < axis.tickCount; i++) {
+    axis.ticks[i] = axis.min + i * axis.step;
+  }
+  return true;
+}
+
+// Row of a value on an axis drawn top..top+height-1, max at the top
+int16_t chartScaleY(const ChartAxis &axis, float value, int16_t top, int16_t height) {
+  float fraction = (value - axis.min) / (axis.max - axis.min);
+  int16_t offset = lroundf(fraction * (height - 1));
+  return top + height - 1 - constrain(offset, 0, height - 1);
+}
+
+static uint8_t fillPattern(ChartFill fill, int16_t y) {
+  switch (fill) {
+    case CHART_FILL_HALF:
+      return (y & 1) ? 0x55 : 0xAA;
+    case CHART_FILL_QUARTER:
+      return (y & 1) ? 0x22 : 0x88;
+    case CHART_FILL_DOTTED:
+      return 0xAA;
+    default:
+      return 0xFF;
+  }
+}
+
+static inline void setPixel(ChartBitmap &bitmap, int16_t x, int16_t y) {
+  if (x >= 0 && x < bitmap.width && y >= 0 && y < bitmap.height) {
+    bitmap.bits[y * bitmap.stride + (x >> 3)] |= 0x80 >> (x & 7);
+  }
+}
+
+// Fill x0..x1 (inclusive) of one row, a byte at a time between the edges
+void chartSpan(ChartBitmap &bitmap, int16_t y, int16_t x0, int16_t x1, ChartFill fill) {
+  if (y < 0 || y >= bitmap.height) {
+    return;
+  }
+  x0 = max<int16_t>(x0, 0);
+  x1 = min<int16_t>(x1, bitmap.width - 1);
+  if (x0 > x1) {
+    return;
+  }
+
+  uint8_t pattern = fillPattern(fill, y);
+  uint8_t *row = bitmap.bits + y * bitmap.stride;
+  int16_t first = x0 >> 3;
+  int16_t last = x1 >> 3;
+  uint8_t firstMask = 0xFF >> (x0 & 7);
+  uint8_t lastMask = 0xFF << (7 - (x1 & 7));
+  if (first == last) {
+    row[first] |= pattern & firstMask & lastMask;
+    return;
+  }
+  row[first] |= pattern & firstMask;
+  for (int16_t i = first + 1; i < last; i++) {
+    row[i] |= pattern;
+  }
+  row[last] |= pattern & lastMask;
+}
+
+void chartFillRect(ChartBitmap &bitmap, int16_t x, int16_t y, int16_t w, int16_t h, ChartFill fill) {
+  for (int16_t row = y; row < y + h; row++) {
+    chartSpan(bitmap, row, x, x + w - 1, fill);
+  }
+}
+
+// Bresenham, all octants
+void chartLine(ChartBitmap &bitmap, int16_t x0, int16_t y0, int16_t x1, int16_t y1) {
+  int16_t dx = abs(x1 - x0);
+  int16_t dy = -abs(y1 - y0);
+  int16_t sx = x0 < x1 ? 1 : -1;
+  int16_t sy = y0 < y1 ? 1 : -1;
+  int16_t error = dx + dy;
+  while (true) {
+    setPixel(bitmap, x0, y0);
+    if (x0 == x1 && y0 == y1) {
+      break;
+    }
+    int16_t error2 = 2 * error;
+    if (error2 >= dy) {
+      error += dy;
+      x0 += sx;
+    }
+    if (error2 <= dx) {
+      error += dx;
+      y0 += sy;
+    }
+  }
+}
+
+void chartPolyline(ChartBitmap &bitmap, const int16_t *xs, const int16_t *ys, int count) {
+  for (int i = 1; i < count; i++) {
+    chartLine(bitmap, xs[i - 1], ys[i - 1], xs[i], ys[i]);
+  }
+}
+
+// Fill between the polyline and the baseline row. Each segment is a
+// trapezoid: below its lower end every row is one full span, and above it
+// the span is cut where the segment crosses the row.
+void chartArea(ChartBitmap &bitmap, const int16_t *xs, const int16_t *ys, int count, int16_t baseline, ChartFill fill) {
+  for (int i = 1; i < count; i++) {
+    int16_t xa = xs[i - 1];
+    int16_t ya = ys[i - 1];
+    int16_t xb = xs[i];
+    int16_t yb = ys[i];
+    // Segments share their end column; the next one owns it
+    int16_t xEnd = i + 1 < count ? xb - 1 : xb;
+    if (xEnd < xa) {
+      continue;
+    }
+
+    for (int16_t y = min(ya, yb); y < max(ya, yb) && y <= baseline; y++) {
+      int16_t xCross = xa + (int32_t)(y - ya) * (xb - xa) / (yb - ya);
+      if (ya < yb) {
+        chartSpan(bitmap, y, xa, min(xCross, xEnd), fill);
+      } else {
+        chartSpan(bitmap, y, max(xCross, xa), xEnd, fill);
+      }
+    }
+    for (int16_t y = max(ya, yb); y <= baseline; y++) {
+      chartSpan(bitmap, y, xa, xEnd, fill);
+    }
+  }
+}
+
+// Temperature curve over a light fill in the upper part of the bitmap and
+// precipitation chance as bars in a band along the bottom, for the hours
+// from first on. Hours sit at fixed columns across the whole forecast span,
+// so the scale stays put as the cached window slides and shrinks.
+bool drawForecastChart(ChartBitmap &bitmap, const HourlyForecast hourlyForecast[], int first, ForecastChart &chart) {
+  chart.hourCount = 0;
+  chart.timeTickCount = 0;
+  if (first < 0) {
+    return false;
+  }
+  float temperatures[HOURLY_FORECAST_COUNT];
+  int16_t xs[HOURLY_FORECAST_COUNT];
+  int16_t ys[HOURLY_FORECAST_COUNT];
+  int count = 0;
+  while (first + count < HOURLY_FORECAST_COUNT && hourlyForecast[first + count].timestamp != 0) {
+    temperatures[count] = hourlyForecast[first + count].temperature;
+    count++;
+  }
+  if (count < 2 || !chartAxis(temperatures, count, CHART_MIN_TEMPERATURE_SPAN, CHART_TEMPERATURE_TICKS, chart.temperature)) {
+    return false;
+  }
+  chart.hourCount = count;
+
+  // Temperature plot above the precipitation band, one row clear of each
+  // edge so the doubled line stays inside
+  int16_t bandHeight = bitmap.height / CHART_PRECIPITATION_SHARE;
+  int16_t bandTop = bitmap.height - bandHeight;
+  int16_t plotTop = 1;
+  int16_t plotHeight = bandTop - 3;
+  for (int i = 0; i < count; i++) {
+    xs[i] = (int32_t)i * (bitmap.width - 1) / (HOURLY_FORECAST_COUNT - 1);
+    ys[i] = chartScaleY(chart.temperature, temperatures[i], plotTop, plotHeight);
+  }
+
+  // Dotted gridlines at the temperature ticks
+  for (int i = 0; i < chart.temperature.tickCount; i++) {
+    chart.tickY[i] = chartScaleY(chart.temperature, chart.temperature.ticks[i], plotTop, plotHeight);
+    chartSpan(bitmap, chart.tickY[i], 0, bitmap.width - 1, CHART_FILL_DOTTED);
+  }
+
+  chartArea(bitmap, xs, ys, count, bandTop - 1, CHART_FILL_QUARTER);
+
+  // One bar per hour, filling the band at 100%
+  int16_t barWidth = max<int16_t>((bitmap.width - 1) / (HOURLY_FORECAST_COUNT - 1) - 1, 1);
+  for (int i = 0; i < count; i++) {
+    int16_t barHeight = (int32_t)constrain(hourlyForecast[first + i].precipitation, 0, 100) * bandHeight / 100;
+    chartFillRect(bitmap, xs[i], bitmap.height - barHeight, barWidth, barHeight, CHART_FILL_HALF);
+  }
+  chartSpan(bitmap, bandTop, 0, bitmap.width - 1, CHART_FILL_SOLID);
+  chartSpan(bitmap, bitmap.height - 1, 0, bitmap.width - 1, CHART_FILL_SOLID);
+
+  // Two pixels thick, to read from across the room
+  chartPolyline(bitmap, xs, ys, count);
+  for (int i = 0; i < count; i++) {
+    ys[i]++;
+  }
+  chartPolyline(bitmap, xs, ys, count);
+
+  // Time ticks on local hours; midnight also gets a dotted line
+  for (int i = 0; i < count && chart.timeTickCount < CHART_MAX_TICKS; i++) {
+    struct tm timeinfo;
+    localTime(hourlyForecast[first + i].timestamp, timeinfo);
+    if (timeinfo.tm_hour % CHART_TIME_TICK_HOURS != 0) {
+      continue;
+    }
+    chart.tickX[chart.timeTickCount] = xs[i];
+    chart.timeTicks[chart.timeTickCount] = hourlyForecast[first + i].timestamp;
+    chart.timeTickCount++;
+    for (int16_t y = bitmap.height - 5; y < bitmap.height; y++) {
+      setPixel(bitmap, xs[i], y);
+    }
+    if (timeinfo.tm_hour == 0) {
+      for (int16_t y = 0; y < bitmap.height; y += 2) {
+        setPixel(bitmap, xs[i], y);
+      }
+    }
+  }
+  return true;
+}
@@ -0,0 +1,416 @@
+#include "civil_time.h"
+#include "binlog.h"
+
+#define SECONDS_PER_DAY 86400
+#define TIME_ZONE_MAGIC 0x545a4e31
+
+// Rule for the day a DST transition falls on (POSIX TZ "Mm.w.d", "Jn" or "n")
+struct TransitionRule {
+  char kind;       // 'M', 'J' or 'n'
+  uint8_t month;
+  uint8_t week;
+  uint8_t weekday;
+  uint16_t day;
+  int32_t time;    // local time of day in seconds, may exceed 24h
+};
+
+// IANA zones the IP geolocation may report, with their POSIX rules
+struct ZoneRule {
+  const char *name;
+  const char *rule;
+};
+
+static const ZoneRule ZONE_RULES[] = {
+  {"Europe/London", "GMT0BST,M3.5.0/1,M10.5.0"},
+  {"Europe/Dublin", "GMT0IST,M3.5.0/1,M10.5.0"},
+  {"Europe/Lisbon", "WET0WEST,M3.5.0/1,M10.5.0"},
+  {"Europe/Amsterdam", "CET-1CEST,M3.5.0,M10.5.0/3"},
+  {"Europe/Berlin", "CET-1CEST,M3.5.0,M10.5.0/3"},
+  {"Europe/Brussels", "CET-1CEST,M3.5.0,M10.5.0/3"},
+  {"Europe/Copenhagen", "CET-1CEST,M3.5.0,M10.5.0/3"},
+  {"Europe/Madrid", "CET-1CEST,M3.5.0,M10.5.0/3"},
+  {"Europe/Oslo", "CET-1CEST,M3.5.0,M10.5.0/3"},
+  {"Europe/Paris", "CET-1CEST,M3.5.0,M10.5.0/3"},
+  {"Europe/Prague", "CET-1CEST,M3.5.0,M10.5.0/3"},
+  {"Europe/Rome", "CET-1CEST,M3.5.0,M10.5.0/3"},
+  {"Europe/Stockholm", "CET-1CEST,M3.5.0,M10.5.0/3"},
+  {"Europe/Vienna", "CET-1CEST,M3.5.0,M10.5.0/3"},
+  {"Europe/Warsaw", "CET-1CEST,M3.5.0,M10.5.0/3"},
+  {"Europe/Zurich", "CET-1CEST,M3.5.0,M10.5.0/3"},
+  {"Europe/Athens", "EET-2EEST,M3.5.0/3,M10.5.0/4"},
+  {"Europe/Bucharest", "EET-2EEST,M3.5.0/3,M10.5.0/4"},
+  {"Europe/Helsinki", "EET-2EEST,M3.5.0/3,M10.5.0/4"},
+  {"Europe/Kyiv", "EET-2EEST,M3.5.0/3,M10.5.0/4"},
+  {"Europe/Kiev", "EET-2EEST,M3.5.0/3,M10.5.0/4"},
+  {"Europe/Istanbul", "<+03>-3"},
+  {"Europe/Moscow", "MSK-3"},
+  {"America/New_York", "EST5EDT,M3.2.0,M11.1.0"},
+  {"America/Toronto", "EST5EDT,M3.2.0,M11.1.0"},
+  {"America/Chicago", "CST6CDT,M3.2.0,M11.1.0"},
+  {"America/Denver", "MST7MDT,M3.2.0,M11.1.0"},
+  {"America/Phoenix", "MST7"},
+  {"America/Los_Angeles", "PST8PDT,M3.2.0,M11.1.0"},
+  {"America/Vancouver", "PST8PDT,M3.2.0,M11.1.0"},
+  {"America/Anchorage", "AKST9AKDT,M3.2.0,M11.1.0"},
+  {"America/Halifax", "AST4ADT,M3.2.0,M11.1.0"},
+  {"America/St_Johns", "NST3:30NDT,M3.2.0,M11.1.0"},
+  {"America/Mexico_City", "CST6"},
+  {"America/Bogota", "<-05>5"},
+  {"America/Lima", "<-05>5"},
+  {"America/Santiago", "<-04>4<-03>,M9.1.6/24,M4.1.6/24"},
+  {"America/Sao_Paulo", "<-03>3"},
+  {"America/Argentina/Buenos_Aires", "<-03>3"},
+  {"Pacific/Honolulu", "HST10"},
+  {"Pacific/Auckland", "NZST-12NZDT,M9.5.0,M4.1.0/3"},
+  {"Australia/Sydney", "AEST-10AEDT,M10.1.0,M4.1.0/3"},
+  {"Australia/Melbourne", "AEST-10AEDT,M10.1.0,M4.1.0/3"},
+  {"Australia/Brisbane", "AEST-10"},
+  {"Australia/Adelaide", "ACST-9:30ACDT,M10.1.0,M4.1.0/3"},
+  {"Australia/Perth", "AWST-8"},
+  {"Asia/Kolkata", "IST-5:30"},
+  {"Asia/Kathmandu", "<+0545>-5:45"},
+  {"Asia/Dubai", "<+04>-4"},
+  {"Asia/Tehran", "<+0330>-3:30"},
+  {"Asia/Jerusalem", "IST-2IDT,M3.4.4/26,M10.5.0"},
+  {"Asia/Karachi", "PKT-5"},
+  {"Asia/Dhaka", "<+06>-6"},
+  {"Asia/Bangkok", "<+07>-7"},
+  {"Asia/Jakarta", "WIB-7"},
+  {"Asia/Shanghai", "CST-8"},
+  {"Asia/Hong_Kong", "HKT-8"},
+  {"Asia/Singapore", "<+08>-8"},
+  {"Asia/Manila", "PST-8"},
+  {"Asia/Tokyo", "JST-9"},
+  {"Asia/Seoul", "KST-9"},
+  {"Africa/Cairo", "EET-2EEST,M4.5.5/0,M10.5.4/24"},
+  {"Africa/Johannesburg", "SAST-2"},
+  {"Africa/Lagos", "WAT-1"},
+  {"Africa/Nairobi", "EAT-3"},
+  {"Africa/Casablanca", "<+01>-1"},
+};
+
+// The frame server renders devices in different zones on parallel threads
+#ifdef SERVER_BUILD
+static thread_local const TimeZone *activeZone = nullptr;
+#else
+static const TimeZone *activeZone = nullptr;
+
+// The device's zone table, kept across deep sleep
+RTC_DATA_ATTR static uint32_t deviceZoneMagic;
+RTC_DATA_ATTR static TimeZone deviceZone;
+#endif
+
+static int64_t floorDiv(int64_t a, int64_t b) {
+  return a / b - (a % b < 0 ? 1 : 0);
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date (H. Hinnant's algorithm)
+static int32_t daysFromCivil(int32_t year, uint32_t month, uint32_t day) {
+  year -= month <= 2;
+  int32_t era = (year >= 0 ? year : year - 399) / 400;
+  uint32_t yearOfEra = year - era * 400;
+  uint32_t dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  uint32_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return era * 146097 + (int32_t)dayOfEra - 719468;
+}
+
+static void civilFromDays(int32_t days, int32_t &year, uint32_t &month, uint32_t &day) {
+  days += 719468;
+  int32_t era = (days >= 0 ? days : days - 146096) / 146097;
+  uint32_t dayOfEra = days - era * 146097;
+  uint32_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+  uint32_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+  uint32_t mp = (5 * dayOfYear + 2) / 153;
+  day = dayOfYear - (153 * mp + 2) / 5 + 1;
+  month = mp < 10 ? mp + 3 : mp - 9;
+  year = yearOfEra + era * 400 + (month <= 2);
+}
+
+static bool isLeapYear(int32_t year) {
+  return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+static uint32_t daysInMonth(int32_t year, uint32_t month) {
+  static const uint8_t DAYS[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  return DAYS[month - 1] + (month == 2 && isLeapYear(year) ? 1 : 0);
+}
+
+// 0 = Sunday; 1970-01-01 was a Thursday
+static int weekdayOfDays(int64_t days) {
+  return (int)(floorDiv(days + 4, 7) * -7 + days + 4);
+}
+
+// Zone name: alphabetic, or anything between angle brackets
+static const char *parseZoneName(const char *p) {
+  if (*p == '<') {
+    p = strchr(p, '>');
+    return p != nullptr ? p + 1 : nullptr;
+  }
+  const char *start = p;
+  while (isalpha((unsigned char)*p)) {
+    p++;
+  }
+  return p - start >= 3 ? p : nullptr;
+}
+
+// [+-]hh[:mm[:ss]] in seconds
+static const char *parseClock(const char *p, int32_t &seconds) {
+  int sign = 1;
+  if (*p == '+' || *p == '-') {
+    sign = *p == '-' ? -1 : 1;
+    p++;
+  }
+  if (!isdigit((unsigned char)*p)) {
+    return nullptr;
+  }
+  int32_t parts[3] = {0, 0, 0};
+  for (int i = 0; i < 3; i++) {
+    char *end;
+    parts[i] = strtol(p, &end, 10);
+    p = end;
+    if (*p != ':' || i == 2) {
+      break;
+    }
+    p++;
+  }
+  seconds = sign * (parts[0] * 3600 + parts[1] * 60 + parts[2]);
+  return p;
+}
+
+static const char *parseTransitionRule(const char *p, TransitionRule &rule) {
+  char *end;
+  rule.time = 2 * 3600;
+  if (*p == 'M') {
+    rule.kind = 'M';
+    rule.month = strtol(p + 1, &end, 10);
+    if (*end != '.') {
+      return nullptr;
+    }
+    rule.week = strtol(end + 1, &end, 10);
+    if (*end != '.') {
+      return nullptr;
+    }
+    rule.weekday = strtol(end + 1, &end, 10);
+    if (rule.month < 1 || rule.month > 12 || rule.week < 1 || rule.week > 5 || rule.weekday > 6) {
+      return nullptr;
+    }
+  } else if (*p == 'J' || isdigit((unsigned char)*p)) {
+    rule.kind = *p == 'J' ? 'J' : 'n';
+    rule.day = strtol(*p == 'J' ? p + 1 : p, &end, 10);
+  } else {
+    return nullptr;
+  }
+  p = end;
+  if (*p == '/') {
+    p = parseClock(p + 1, rule.time);
+  }
+  return p;
+}
+
+// Day (since the epoch) a transition rule falls on in the given year
+static int32_t transitionDay(const TransitionRule &rule, int32_t year) {
+  int32_t jan1 = daysFromCivil(year, 1, 1);
+  if (rule.kind == 'J') {
+    // 1-365, February 29 is never counted
+    return jan1 + rule.day - 1 + (isLeapYear(year) && rule.day >= 60 ? 1 : 0);
+  }
+  if (rule.kind == 'n') {
+    return jan1 + rule.day;
+  }
+
+  // Weekday d of week w (5 = last) of month m
+  int32_t first = daysFromCivil(year, rule.month, 1);
+  int32_t day = first + (rule.weekday - weekdayOfDays(first) + 7) % 7 + (rule.week - 1) * 7;
+  while (day >= first + (int32_t)daysInMonth(year, rule.month)) {
+    day -= 7;
+  }
+  return day;
+}
+
+// Expand a POSIX TZ rule into the transitions of now's year and the next.
+// Returns false (leaving the zone on UTC) if the rule does not parse or has
+// DST without transition rules; callers report it.
+bool buildTimeZone(const char *rule, time_t now, TimeZone &zone) {
+  memset(&zone, 0, sizeof(zone));
+  zone.validUntil = INT32_MAX;
+  if (rule == nullptr || rule[0] == '\0') {
+    return false;
+  }
+
+  int32_t standard, daylight;
+  const char *p = parseZoneName(rule);
+  p = p != nullptr ? parseClock(p, standard) : nullptr;
+  if (p == nullptr) {
+    return false;
+  }
+  strncpy(zone.rule, rule, sizeof(zone.rule) - 1);
+  zone.standardOffset = -standard; // POSIX offsets count west of UTC
+  zone.initialOffset = zone.standardOffset;
+
+  if (*p == '\0') {
+    return true;
+  }
+
+  // DST name, optional offset (default one hour ahead), then the two rules
+  p = parseZoneName(p);
+  daylight = standard - 3600;
+  if (p != nullptr && *p != ',' && *p != '\0') {
+    p = parseClock(p, daylight);
+  }
+  TransitionRule start, end;
+  if (p == nullptr || *p != ',' || (p = parseTransitionRule(p + 1, start)) == nullptr ||
+      *p != ',' || (p = parseTransitionRule(p + 1, end)) == nullptr) {
+    zone.rule[0] = '\0';
+    zone.standardOffset = zone.initialOffset = 0;
+    return false;
+  }
+
+  int32_t year;
+  uint32_t month, day;
+  civilFromDays(floorDiv(now, SECONDS_PER_DAY), year, month, day);
+  for (int32_t y = year; y <= year + 1; y++) {
+    // Each transition happens at local time in the offset it ends
+    time_t dstStart = (time_t)transitionDay(start, y) * SECONDS_PER_DAY + start.time + standard;
+    time_t dstEnd = (time_t)transitionDay(end, y) * SECONDS_PER_DAY + end.time + daylight;
+    bool startFirst = dstStart < dstEnd;
+    uint8_t n = zone.transitionCount;
+    zone.transitions[n] = startFirst ? dstStart : dstEnd;
+    zone.offsets[n] = startFirst ? -daylight : -standard;
+    zone.transitions[n + 1] = startFirst ? dstEnd : dstStart;
+    zone.offsets[n + 1] = startFirst ? -standard : -daylight;
+    zone.transitionCount += 2;
+  }
+
+  // Southern hemisphere zones start the year in DST
+  zone.initialOffset = zone.offsets[0] == -daylight ? -standard : -daylight;
+  zone.validUntil = (time_t)daysFromCivil(year + 2, 1, 1) * SECONDS_PER_DAY - 14 * 3600;
+  return true;
+}
+
+// Conversions on this thread use the given zone (nullptr = UTC)
+void useTimeZone(const TimeZone *zone) {
+  activeZone = zone;
+}
+
+#ifndef SERVER_BUILD
+// Restore the zone table kept across deep sleep; UTC until configured
+void timeZoneBegin() {
+  if (esp_reset_reason() == ESP_RST_DEEPSLEEP && deviceZoneMagic == TIME_ZONE_MAGIC) {
+    useTimeZone(&deviceZone);
+  }
+}
+
+// Rebuild the table when the rule changes or the covered years run out.
+// Waits for a set clock, since the table is built around the current year.
+// A rule that does not parse is kept in the table as UTC, so it is reported
+// once instead of being parsed again every wake. Returns true if the table
+// was rebuilt.
+bool timeZoneConfigure(const char *rule, time_t now) {
+  bool current = deviceZoneMagic == TIME_ZONE_MAGIC && strcmp(deviceZone.rule, rule) == 0 && now < deviceZone.validUntil;
+  bool rebuilt = !current && now >= MIN_VALID_EPOCH;
+  if (rebuilt) {
+    if (!buildTimeZone(rule, now, deviceZone) && rule[0] != '\0') {
+      LOG(TIMEZONE_RULE_INVALID, rule);
+      strncpy(deviceZone.rule, rule, sizeof(deviceZone.rule) - 1);
+    }
+    deviceZoneMagic = TIME_ZONE_MAGIC;
+  }
+  if (deviceZoneMagic == TIME_ZONE_MAGIC) {
+    useTimeZone(&deviceZone);
+  }
+  return rebuilt;
+}
+#endif
+
+// POSIX rule for an IANA zone name, or a fixed offset if it is not in the table
+void posixTimeZoneFor(const char *ianaName, int32_t utcOffset, char *rule, size_t size) {
+  for (const ZoneRule &zone : ZONE_RULES) {
+    if (strcmp(zone.name, ianaName) == 0) {
+      strncpy(rule, zone.rule, size - 1);
+      rule[size - 1] = '\0';
+      return;
+    }
+  }
+
+  int32_t west = -utcOffset;
+  char sign = west < 0 ? '-' : '+';
+  int32_t minutes = abs(west) / 60;
+  snprintf(rule, size, "<%c%02d%02d>%c%d:%02d", west < 0 ? '+' : '-', (int)(minutes / 60), (int)(minutes % 60),
+           sign, (int)(minutes / 60), (int)(minutes % 60));
+}
+
+int32_t utcOffsetAt(time_t t) {
+  const TimeZone *zone = activeZone;
+  if (zone == nullptr) {
+    return 0;
+  }
+  int32_t offset = zone->initialOffset;
+  for (uint8_t i = 0; i < zone->transitionCount && t >= zone->transitions[i]; i++) {
+    offset = zone->offsets[i];
+  }
+  return offset;
+}
+
+static void civilTime(int64_t local, int32_t offset, struct tm &civil) {
+  int64_t days = floorDiv(local, SECONDS_PER_DAY);
+  int32_t secondOfDay = local - days * SECONDS_PER_DAY;
+  int32_t year;
+  uint32_t month, day;
+  civilFromDays(days, year, month, day);
+
+  memset(&civil, 0, sizeof(civil));
+  civil.tm_year = year - 1900;
+  civil.tm_mon = month - 1;
+  civil.tm_mday = day;
+  civil.tm_hour = secondOfDay / 3600;
+  civil.tm_min = secondOfDay / 60 % 60;
+  civil.tm_sec = secondOfDay % 60;
+  civil.tm_wday = weekdayOfDays(days);
+  civil.tm_yday = days - daysFromCivil(year, 1, 1);
+  civil.tm_isdst = activeZone != nullptr && offset != activeZone->standardOffset ? 1 : 0;
+}
+
+// Like localtime_r(), in the zone set with useTimeZone()
+void localTime(time_t t, struct tm &civil) {
+  int32_t offset = utcOffsetAt(t);
+  civilTime((int64_t)t + offset, offset, civil);
+}
+
+void utcTime(time_t t, struct tm &civil) {
+  civilTime(t, 0, civil);
+}
+
+// Inverse of utcTime() for a date and a time of day in seconds
+time_t utcEpoch(int32_t year, uint32_t month, uint32_t day, int32_t secondOfDay) {
+  return (time_t)daysFromCivil(year, month, day) * SECONDS_PER_DAY + secondOfDay;
+}
+
+// Local boundary at or before t for a period that divides the day
+static time_t startOfLocalPeriod(time_t t, int32_t period) {
+  int64_t local = (int64_t)t + utcOffsetAt(t);
+  int64_t boundary = floorDiv(local, period) * period;
+  time_t start = boundary - utcOffsetAt(t);
+  // The boundary may be on the other side of a transition
+  return boundary - utcOffsetAt(start);
+}
+
+time_t startOfHour(time_t t) {
+  return startOfLocalPeriod(t, 3600);
+}
+
+time_t startOfDay(time_t t) {
+  return startOfLocalPeriod(t, SECONDS_PER_DAY);
+}
+
+// Local midnight starting the week (Monday) that contains t
+time_t startOfWeek(time_t t) {
+  time_t day = startOfDay(t);
+  int64_t localDays = floorDiv((int64_t)day + utcOffsetAt(day), SECONDS_PER_DAY);
+  int daysSinceMonday = (weekdayOfDays(localDays) + 6) % 7;
+  return addLocalDays(day, -daysSinceMonday);
+}
+
+// Local midnight a number of days after dayStart (days are 23-25 h around DST)
+time_t addLocalDays(time_t dayStart, int days) {
+  return startOfDay(dayStart + (time_t)days * SECONDS_PER_DAY + SECONDS_PER_DAY / 2);
+}
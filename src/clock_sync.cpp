@@ -0,0 +1,146 @@
+#include "clock_sync.h"
+#include "civil_time.h"
+#include "wake_budget.h"
+#include "binlog.h"
+#include "esp_sntp.h"
+#include <sys/time.h>
+
+#define CLOCK_MAGIC 0x434c4b31
+
+// Drift model kept across deep sleep
+struct ClockModel {
+  uint32_t magic;
+  // Rate error of the clock, positive when it gains (ppm)
+  int32_t driftPpm;
+  bool driftKnown;
+  // Last NTP sync, and the last drift correction (epoch seconds)
+  uint32_t syncedAt;
+  uint32_t correctedAt;
+};
+
+RTC_DATA_ATTR static ClockModel clockModel;
+
+// Filled in by the SNTP callback on the lwIP task and folded into the model
+// by clockFinishSync(). The clock has already been set by then, so what it
+// read before is worked out from millis(), which runs off the crystal.
+static volatile bool syncArrived;
+static int64_t syncNtpMs;
+static int64_t syncLocalMs;
+static int64_t syncStartMs;
+static uint32_t syncStartMillis;
+
+static int64_t clockMs() {
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static void shiftClock(int64_t ms) {
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  int64_t us = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec + ms * 1000;
+  tv.tv_sec = us / 1000000;
+  tv.tv_usec = us % 1000000;
+  settimeofday(&tv, nullptr);
+}
+
+static void onTimeSync(struct timeval *tv) {
+  syncLocalMs = syncStartMs + (millis() - syncStartMillis);
+  syncNtpMs = (int64_t)tv->tv_sec * 1000 + tv->tv_usec / 1000;
+  syncArrived = true;
+}
+
+// Error the clock may have picked up since the last sync
+static uint32_t predictedErrorMs(time_t now) {
+  if (now < MIN_VALID_EPOCH || clockModel.syncedAt == 0 || now < (time_t)clockModel.syncedAt) {
+    return UINT32_MAX;
+  }
+  uint32_t ppm = clockModel.driftKnown ? CLOCK_RESIDUAL_DRIFT_PPM : CLOCK_UNKNOWN_DRIFT_PPM;
+  return min<uint64_t>((uint64_t)(now - clockModel.syncedAt) * ppm / 1000, UINT32_MAX);
+}
+
+// Correct the clock for the drift over the time slept since the last wake
+void clockBegin() {
+  if (clockModel.magic != CLOCK_MAGIC) {
+    memset(&clockModel, 0, sizeof(clockModel));
+    clockModel.magic = CLOCK_MAGIC;
+    return;
+  }
+  time_t now = time(nullptr);
+  if (now < MIN_VALID_EPOCH || clockModel.correctedAt == 0 || now <= (time_t)clockModel.correctedAt) {
+    return;
+  }
+
+  // Left to add up while it is under a millisecond
+  int64_t correctionMs = -(int64_t)(now - clockModel.correctedAt) * clockModel.driftPpm / 1000;
+  if (correctionMs != 0) {
+    shiftClock(correctionMs);
+    clockModel.correctedAt = time(nullptr);
+    LOG(CLOCK_CORRECTED, (int)correctionMs, (int)clockModel.driftPpm);
+  }
+}
+
+bool clockKnown() {
+  return predictedErrorMs(time(nullptr)) <= CLOCK_USABLE_ERROR_MS;
+}
+
+bool clockSyncDue() {
+  time_t now = time(nullptr);
+  uint32_t errorMs = predictedErrorMs(now);
+  if (errorMs > CLOCK_MAX_ERROR_MS || now - (time_t)clockModel.syncedAt >= CLOCK_MAX_SYNC_INTERVAL_S) {
+    return true;
+  }
+  LOG(CLOCK_SYNC_SKIPPED, (unsigned)errorMs);
+  return false;
+}
+
+// Ask NTP in the background; the answer sets the clock whenever it comes
+void clockStartSync() {
+  syncArrived = false;
+  syncStartMs = clockMs();
+  syncStartMillis = millis();
+  sntp_set_time_sync_notification_cb(onTimeSync);
+  configTime(0, 0, "pool.ntp.org", "time.nist.gov");
+}
+
+// Block until NTP answers, on a wake whose clock is not known
+bool clockWaitKnown() {
+  if (clockKnown()) {
+    return true;
+  }
+  LOG(CLOCK_UNKNOWN);
+  uint32_t timeoutMs = min<uint32_t>(CLOCK_SYNC_TIMEOUT_MS, budgetRemainingMs());
+  uint32_t start = millis();
+  while (!syncArrived && millis() - start < timeoutMs) {
+    delay(20);
+  }
+  clockFinishSync();
+  return clockKnown();
+}
+
+// Fold an NTP answer that arrived this wake into the drift model
+void clockFinishSync() {
+  if (!syncArrived) {
+    return;
+  }
+  syncArrived = false;
+
+  // What the clock was behind by, after the corrections already made
+  int64_t offsetMs = syncNtpMs - syncLocalMs;
+  int64_t sinceSyncS = syncNtpMs / 1000 - (int64_t)clockModel.syncedAt;
+  bool wasSet = syncLocalMs >= (int64_t)MIN_VALID_EPOCH * 1000;
+  if (wasSet && clockModel.syncedAt != 0 && sinceSyncS >= CLOCK_MIN_DRIFT_SAMPLE_S) {
+    int32_t residualPpm = -offsetMs * 1000 / sinceSyncS;
+    if (abs(residualPpm) > CLOCK_MAX_DRIFT_PPM) {
+      clockModel.driftPpm = 0;
+      clockModel.driftKnown = false;
+    } else {
+      // The first measurement is taken whole; later ones are averaged in
+      clockModel.driftPpm += clockModel.driftKnown ? residualPpm / 2 : residualPpm;
+      clockModel.driftKnown = true;
+    }
+  }
+  clockModel.syncedAt = syncNtpMs / 1000;
+  clockModel.correctedAt = clockModel.syncedAt;
+  LOG(CLOCK_SYNCED, (int)constrain(offsetMs, INT32_MIN, INT32_MAX), (int)clockModel.driftPpm);
+}
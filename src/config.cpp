@@ -1,38 +1,238 @@
 #include "config.h"
+#include "binlog.h"
+#if CONFIG_IDF_TARGET_ESP32
+#include "esp32/rom/crc.h"
+#else
+#include "rom/crc.h"
+#endif
+
+// NVS namespace and key of the config blob
+#define CONFIG_NAMESPACE "eink-weather"
+#define CONFIG_BLOB_KEY "config"
+#define REFRESH_TOKEN_KEY "msft_refresh"
+// Marks the RTC copy as initialised (RTC memory is random after power-on)
+#define CONFIG_RTC_MAGIC 0x43464731
+
+// On-flash layout: header followed by the raw Config struct
+struct ConfigBlobHeader {
+  uint16_t version;
+  uint16_t size;
+  uint32_t crc;
+};
+
+// Layout of blob versions 1-3, which kept the refresh token inline. Only
+// read to convert them; v1 and v2 blobs are prefixes of it.
+struct LegacyConfig {
+  char location[64];
+  char weatherApiKey[48];
+  char msftClientId[48];
+  char msftClientSecret[64];
+  char msftRefreshToken[1536];
+  char frameServerUrl[96];
+  char timeZone[TZ_RULE_LENGTH];
+};
+
+#define LEGACY_CONFIG_VERSION 3
+#define CONFIG_BLOB_MAX (sizeof(ConfigBlobHeader) + max(sizeof(Config), sizeof(LegacyConfig)))
 
 // Preferences instance for storing configuration
 Preferences preferences;
 
-// Load configuration from non-volatile storage
+// Global configuration, cached in RTC memory so deep-sleep wakes skip NVS
+RTC_DATA_ATTR Config config;
+// CRC of the config as last read from / written to NVS
+RTC_DATA_ATTR static uint32_t persistedCrc;
+RTC_DATA_ATTR static uint32_t rtcMagic;
+
+// The refresh token as last read from / written to NVS, this wake
+static String refreshToken;
+static bool refreshTokenRead = false;
+
+static uint32_t configCrc(const Config &cfg) {
+  return crc32_le(0, (const uint8_t *)&cfg, sizeof(cfg));
+}
+
+static bool writeConfigBlob(uint32_t crc) {
+  size_t length = sizeof(ConfigBlobHeader) + sizeof(Config);
+  uint8_t *buffer = (uint8_t *)malloc(length);
+  if (buffer == nullptr) {
+    return false;
+  }
+
+  ConfigBlobHeader header = {CONFIG_VERSION, sizeof(Config), crc};
+  memcpy(buffer, &header, sizeof(header));
+  memcpy(buffer + sizeof(header), &config, sizeof(config));
+  size_t written = preferences.putBytes(CONFIG_BLOB_KEY, buffer, length);
+  free(buffer);
+
+  if (written != length) {
+    LOG(CONFIG_WRITE_FAILED);
+    return false;
+  }
+  persistedCrc = crc;
+  return true;
+}
+
+// Store the refresh token under its own key; preferences must be open
+static bool writeRefreshToken(const char *token) {
+  size_t length = strlen(token);
+  if (length >= REFRESH_TOKEN_MAX) {
+    LOG(REFRESH_TOKEN_TOO_LONG, (unsigned)length, (unsigned)(REFRESH_TOKEN_MAX - 1));
+    return false;
+  }
+  if (preferences.putString(REFRESH_TOKEN_KEY, token) != length) {
+    LOG(REFRESH_TOKEN_WRITE_FAILED);
+    return false;
+  }
+  refreshToken = token;
+  refreshTokenRead = true;
+  return true;
+}
+
+// Copy a v1-v3 blob into config and move its refresh token to its own key
+static void convertLegacyConfig(const LegacyConfig &legacy) {
+  setConfigField(config.location, legacy.location);
+  setConfigField(config.weatherApiKey, legacy.weatherApiKey);
+  setConfigField(config.msftClientId, legacy.msftClientId);
+  setConfigField(config.msftClientSecret, legacy.msftClientSecret);
+  setConfigField(config.frameServerUrl, legacy.frameServerUrl);
+  setConfigField(config.timeZone, legacy.timeZone);
+  if (legacy.msftRefreshToken[0] != '\0') {
+    writeRefreshToken(legacy.msftRefreshToken);
+  }
+}
+
+// Read the blob into config; false if missing, too new or corrupt.
+// Blobs from older versions are zero-extended and written back.
+static bool readConfigBlob() {
+  size_t length = preferences.getBytesLength(CONFIG_BLOB_KEY);
+  if (length < sizeof(ConfigBlobHeader) || length > CONFIG_BLOB_MAX) {
+    return false;
+  }
+
+  // Zero-filled past the stored bytes, which zero-extends older layouts
+  uint8_t *buffer = (uint8_t *)calloc(1, CONFIG_BLOB_MAX);
+  if (buffer == nullptr) {
+    return false;
+  }
+  preferences.getBytes(CONFIG_BLOB_KEY, buffer, length);
+
+  ConfigBlobHeader header;
+  memcpy(&header, buffer, sizeof(header));
+  size_t storedSize = length - sizeof(header);
+  bool legacy = header.version <= LEGACY_CONFIG_VERSION;
+  bool valid = header.version <= CONFIG_VERSION && header.size == storedSize &&
+               storedSize <= (legacy ? sizeof(LegacyConfig) : sizeof(Config)) &&
+               header.crc == crc32_le(0, buffer + sizeof(header), storedSize);
+  if (valid && legacy) {
+    convertLegacyConfig(*(const LegacyConfig *)(buffer + sizeof(header)));
+  } else if (valid) {
+    memcpy(&config, buffer + sizeof(header), sizeof(config));
+  }
+  free(buffer);
+
+  if (!valid) {
+    LOG(CONFIG_INVALID);
+    return false;
+  }
+
+  if (header.version != CONFIG_VERSION) {
+    LOG(CONFIG_UPGRADED, (unsigned)header.version, (unsigned)CONFIG_VERSION);
+    return writeConfigBlob(configCrc(config));
+  }
+  persistedCrc = header.crc;
+  return true;
+}
+
+// Import the per-key layout used by earlier firmware, then drop the old keys
+static bool migrateLegacyConfig() {
+  static const char *legacyKeys[] = {"location", "weather_key", "msft_id", "msft_secret", "msft_token"};
+  bool found = false;
+  for (const char *key : legacyKeys) {
+    found |= preferences.isKey(key);
+  }
+  if (!found) {
+    return false;
+  }
+
+  LOG(CONFIG_LEGACY);
+  setConfigField(config.location, preferences.getString("location", "").c_str());
+  setConfigField(config.weatherApiKey, preferences.getString("weather_key", "").c_str());
+  setConfigField(config.msftClientId, preferences.getString("msft_id", "").c_str());
+  setConfigField(config.msftClientSecret, preferences.getString("msft_secret", "").c_str());
+  String token = preferences.getString("msft_token", "");
+  if (token.length() > 0) {
+    writeRefreshToken(token.c_str());
+  }
+
+  if (!writeConfigBlob(configCrc(config))) {
+    return false;
+  }
+  for (const char *key : legacyKeys) {
+    preferences.remove(key);
+  }
+  return true;
+}
+
+// Load configuration from non-volatile storage.
+// After a deep-sleep wake the RTC copy is used as-is if it still matches
+// what was last persisted, so a normal wake performs no NVS access at all.
 bool loadConfig() {
-  preferences.begin("eink-weather", true); // Read-only mode
-  
-  Config config;
-  config.location = preferences.getString("location", "");
-  config.weatherApiKey = preferences.getString("weather_key", "");
-  config.msftClientId = preferences.getString("msft_id", "");
-  config.msftClientSecret = preferences.getString("msft_secret", "");
-  config.msftRefreshToken = preferences.getString("msft_token", "");
-  
+  if (rtcMagic == CONFIG_RTC_MAGIC && configCrc(config) == persistedCrc) {
+    return true;
+  }
+
+  memset(&config, 0, sizeof(config));
+  persistedCrc = 0;
+  refreshTokenRead = false;
+
+  preferences.begin(CONFIG_NAMESPACE, false); // Read-write mode for migration
+  bool loaded = readConfigBlob() || migrateLegacyConfig();
   preferences.end();
-  
+
+  if (!loaded) {
+    // Nothing stored yet; an empty config is valid
+    memset(&config, 0, sizeof(config));
+    persistedCrc = configCrc(config);
+  }
+  rtcMagic = CONFIG_RTC_MAGIC;
+
   return true;
 }
 
-// Save configuration to non-volatile storage
+// Save configuration to non-volatile storage, only if a field changed
 bool saveConfig() {
-  // Access the global config variable
-  extern Config config;
-  
-  preferences.begin("eink-weather", false); // Read-write mode
-  
-  preferences.putString("location", config.location);
-  preferences.putString("weather_key", config.weatherApiKey);
-  preferences.putString("msft_id", config.msftClientId);
-  preferences.putString("msft_secret", config.msftClientSecret);
-  preferences.putString("msft_token", config.msftRefreshToken);
-  
+  uint32_t crc = configCrc(config);
+  if (crc == persistedCrc) {
+    return true;
+  }
+
+  preferences.begin(CONFIG_NAMESPACE, false); // Read-write mode
+  bool saved = writeConfigBlob(crc);
   preferences.end();
-  
-  return true;
+
+  return saved;
+}
+
+// The Microsoft refresh token, read from NVS on first use each wake
+String loadRefreshToken() {
+  if (!refreshTokenRead) {
+    preferences.begin(CONFIG_NAMESPACE, true);
+    refreshToken = preferences.getString(REFRESH_TOKEN_KEY, "");
+    preferences.end();
+    refreshTokenRead = true;
+  }
+  return refreshToken;
+}
+
+// Store a rotated refresh token, only if it changed. A token too long to
+// store is rejected and logged; the previous one is kept.
+bool saveRefreshToken(const String &token) {
+  if (loadRefreshToken() == token) {
+    return true;
+  }
+  preferences.begin(CONFIG_NAMESPACE, false);
+  bool saved = writeRefreshToken(token.c_str());
+  preferences.end();
+  return saved;
 }
@@ -1,290 +1,358 @@
 #include "display.h"
-#include <GxEPD2_BW.h>
-#include <Fonts/FreeMonoBold9pt7b.h>
-#include <Fonts/FreeMonoBold12pt7b.h>
-#include <Fonts/FreeMonoBold18pt7b.h>
-#include <Fonts/FreeMonoBold24pt7b.h>
-
-// External reference to display instance
-extern GxEPD2_BW<GxEPD2_750_T7, GxEPD2_750_T7::HEIGHT> display;
-
-// Weather icons (simplified for now, would be replaced with actual bitmap icons)
-const uint8_t ICON_SUNNY[] = {0x00}; // Placeholder
-const uint8_t ICON_CLOUDY[] = {0x00}; // Placeholder
-const uint8_t ICON_RAINY[] = {0x00}; // Placeholder
-const uint8_t ICON_SNOWY[] = {0x00}; // Placeholder
-
-// Initialize the E-Ink display
-void initDisplay() {
-  display.init();
-  display.setRotation(3); // Landscape mode
-  display.setTextColor(GxEPD_BLACK);
-  display.setFullWindow();
+#include "renderer.h"
+#include "battery.h"
+#include "binlog.h"
+
+#define SHOWN_REGIONS_MAGIC 0x53524731
+
+typedef Layout<DISPLAY_WIDTH, DISPLAY_HEIGHT> ActiveLayout;
+
+// Display instance for the panel selected at build time
+ActiveDisplay display(ActivePanel::Driver(EPD_PIN_CS, EPD_PIN_DC, EPD_PIN_RST, EPD_PIN_BUSY));
+
+// Content keys of what each layout region shows on the panel, kept across
+// deep sleep so the next wake only refreshes regions that change
+struct ShownRegions {
+  uint32_t magic;
+  RegionKeys keys;
+};
+
+RTC_DATA_ATTR static ShownRegions shownRegions;
+// ETag of the frame server frame on the panel, 0 if it shows anything else.
+// Like the region keys it starts over at 0 on any reset but deep sleep.
+RTC_DATA_ATTR static uint32_t shownFrameEtag;
+
+// Forecast chart of the weather snapshot, rasterized ahead of the composite
+static Renderer<ActivePanel>::ForecastRaster forecastRaster;
+
+// Where the drawing functions below draw: the paged display, or the band
+// of a frame being rendered (see beginFrame())
+static Renderer<ActivePanel>::Canvas *frameCanvas = &display;
+
+// The panel is brought up on first use, so a wake with nothing to show
+// never powers it or waits on it
+static bool panelReady;
+static bool panelInitial = true;
+
+static void ensurePanel() {
+  if (!panelReady) {
+    Renderer<ActivePanel>::init(display, panelInitial);
+    panelReady = true;
+  }
+}
+
+// Public drawing API, bound to the panel selected at build time
+
+// initial is true when the panel's content is unknown (power-on or reset)
+void initDisplay(bool initial) {
+  panelInitial = initial;
+  panelReady = false;
+}
+
+void hibernateDisplay() {
+  if (panelReady) {
+    display.hibernate();
+    panelReady = false;
+    panelInitial = false;
+  }
 }
 
-// Display startup screen
 void displayStartupScreen() {
-  display.firstPage();
-  do {
-    display.fillScreen(GxEPD_WHITE);
-    display.setFont(&FreeMonoBold18pt7b);
-    display.setCursor(50, DISPLAY_HEIGHT / 2);
-    display.print("E-Ink Weather & Calendar");
-    display.setFont(&FreeMonoBold12pt7b);
-    display.setCursor(50, DISPLAY_HEIGHT / 2 + 40);
-    display.print("Starting up...");
-  } while (display.nextPage());
+  ensurePanel();
+  forgetShownRegions();
+  shownFrameEtag = 0;
+  Renderer<ActivePanel>::startupScreen(display);
 }
 
-// Display WiFi setup screen
 void displayWiFiSetupScreen() {
-  display.firstPage();
-  do {
-    display.fillScreen(GxEPD_WHITE);
-    display.setFont(&FreeMonoBold18pt7b);
-    display.setCursor(50, DISPLAY_HEIGHT / 2 - 50);
-    display.print("WiFi Setup Mode");
-    display.setFont(&FreeMonoBold12pt7b);
-    display.setCursor(50, DISPLAY_HEIGHT / 2);
-    display.print("Connect to WiFi network:");
-    display.setCursor(50, DISPLAY_HEIGHT / 2 + 30);
-    display.print("EinkWeather_XXXXXX");
-    display.setCursor(50, DISPLAY_HEIGHT / 2 + 60);
-    display.print("Then open: 192.168.4.1");
-  } while (display.nextPage());
+  ensurePanel();
+  forgetShownRegions();
+  shownFrameEtag = 0;
+  Renderer<ActivePanel>::wifiSetupScreen(display);
+}
+
+void displayReplaceBattery() {
+  ensurePanel();
+  forgetShownRegions();
+  shownFrameEtag = 0;
+  Renderer<ActivePanel>::replaceBatteryScreen(display);
 }
 
-// Draw the split screen layout
 void drawSplitScreenLayout() {
-  display.fillScreen(GxEPD_WHITE);
-  
-  // Draw vertical divider line
-  display.drawLine(SPLIT_POSITION, 0, SPLIT_POSITION, DISPLAY_HEIGHT, GxEPD_BLACK);
-  
-  // Draw headers
-  display.setFont(&FreeMonoBold12pt7b);
-  display.setCursor(10, 30);
-  display.print("Weather");
-  
-  display.setCursor(SPLIT_POSITION + 10, 30);
-  display.print("Calendar");
-  
-  // Draw horizontal lines under headers
-  display.drawLine(10, 40, SPLIT_POSITION - 10, 40, GxEPD_BLACK);
-  display.drawLine(SPLIT_POSITION + 10, 40, DISPLAY_WIDTH - 10, 40, GxEPD_BLACK);
-  
-  // Draw battery status in top right corner
-  drawBatteryStatus(DISPLAY_WIDTH - 50, 25);
+  Renderer<ActivePanel>::splitScreenLayout(*frameCanvas, batteryGaugePercent());
 }
 
-// Draw weather data on the left side of the screen
-void drawWeatherData(const WeatherData &currentWeather, const HourlyForecast hourlyForecast[]) {
-  // Draw location
-  display.setFont(&FreeMonoBold12pt7b);
-  display.setCursor(20, 70);
-  display.print(currentWeather.location);
-  
-  // Draw current weather icon (large)
-  drawWeatherIcon(80, 150, 100, currentWeather.iconCode);
-  
-  // Draw current temperature
-  display.setFont(&FreeMonoBold24pt7b);
-  display.setCursor(200, 150);
-  display.print(String(currentWeather.temperature, 1));
-  display.print(" C");
-  
-  // Draw current weather details
-  display.setFont(&FreeMonoBold9pt7b);
-  int yPos = 180;
-  display.setCursor(200, yPos);
-  display.print("Feels like: ");
-  display.print(String(currentWeather.feelsLike, 1));
-  display.print(" C");
-  
-  yPos += 25;
-  display.setCursor(200, yPos);
-  display.print("Humidity: ");
-  display.print(currentWeather.humidity);
-  display.print("%");
-  
-  yPos += 25;
-  display.setCursor(200, yPos);
-  display.print("Wind: ");
-  display.print(String(currentWeather.windSpeed, 1));
-  display.print(" m/s");
-  
-  // Draw hourly forecast
-  display.setFont(&FreeMonoBold12pt7b);
-  display.setCursor(20, 280);
-  display.print("Hourly Forecast");
-  
-  // Draw horizontal line
-  display.drawLine(20, 290, SPLIT_POSITION - 20, 290, GxEPD_BLACK);
-  
-  // Draw hourly forecast items
-  int hourWidth = (SPLIT_POSITION - 40) / 6; // Show 6 hours
-  for (int i = 0; i < 6; i++) {
-    int x = 20 + i * hourWidth;
-    
-    // Draw time
-    char timeStr[6];
-    time_t forecastTime = hourlyForecast[i].timestamp;
-    struct tm *timeinfo = localtime(&forecastTime);
-    sprintf(timeStr, "%02d:00", timeinfo->tm_hour);
-    
-    display.setFont(&FreeMonoBold9pt7b);
-    display.setCursor(x, 320);
-    display.print(timeStr);
-    
-    // Draw icon
-    drawWeatherIcon(x + hourWidth/2 - 15, 350, 30, hourlyForecast[i].iconCode);
-    
-    // Draw temperature
-    display.setCursor(x, 400);
-    display.print(String(hourlyForecast[i].temperature, 0));
-    display.print("C");
-    
-    // Draw precipitation chance
-    display.setCursor(x, 430);
-    display.print(String(hourlyForecast[i].precipitation));
-    display.print("%");
-  }
+// Only touches the raster, so the render pipeline runs it on its own task
+bool prepareWeatherPane(const HourlyForecast hourlyForecast[], time_t now) {
+  return Renderer<ActivePanel>::rasterizeForecast(forecastRaster, hourlyForecast, now);
+}
+
+// Draws the chart last prepared by prepareWeatherPane()
+void drawWeatherData(const WeatherData &currentWeather) {
+  Renderer<ActivePanel>::weatherData(*frameCanvas, currentWeather, forecastRaster);
 }
 
-// Draw calendar events on the right side of the screen
 void drawCalendarEvents(const CalendarEvents &events) {
-  // Get current time for highlighting today's events
-  time_t now = time(nullptr);
-  struct tm *timeinfo = localtime(&now);
-  int currentDay = timeinfo->tm_mday;
-  int currentMonth = timeinfo->tm_mon;
-  int currentYear = timeinfo->tm_year;
-  
-  // Draw current date
-  char dateStr[20];
-  strftime(dateStr, sizeof(dateStr), "%a, %b %d, %Y", timeinfo);
-  
-  display.setFont(&FreeMonoBold12pt7b);
-  display.setCursor(SPLIT_POSITION + 20, 70);
-  display.print(dateStr);
-  
-  // Draw events
-  int yPos = 100;
-  display.setFont(&FreeMonoBold9pt7b);
-  
-  if (events.events.empty()) {
-    display.setCursor(SPLIT_POSITION + 20, yPos);
-    display.print("No upcoming events");
-  } else {
-    for (const auto &event : events.events) {
-      // Format event time
-      char startTimeStr[20], endTimeStr[20];
-      struct tm *startTime = localtime(&event.startTime);
-      struct tm *endTime = localtime(&event.endTime);
-      
-      if (event.isAllDay) {
-        strcpy(startTimeStr, "All day");
-      } else {
-        strftime(startTimeStr, sizeof(startTimeStr), "%H:%M", startTime);
-        strftime(endTimeStr, sizeof(endTimeStr), "%H:%M", endTime);
-      }
-      
-      // Check if event is today
-      bool isToday = (startTime->tm_mday == currentDay && 
-                      startTime->tm_mon == currentMonth && 
-                      startTime->tm_year == currentYear);
-      
-      // Draw event time
-      display.setCursor(SPLIT_POSITION + 20, yPos);
-      if (event.isAllDay) {
-        display.print(startTimeStr);
-      } else {
-        display.print(startTimeStr);
-        display.print(" - ");
-        display.print(endTimeStr);
-      }
-      
-      // Draw event title
-      yPos += 25;
-      display.setCursor(SPLIT_POSITION + 30, yPos);
-      
-      // Highlight today's events
-      if (isToday) {
-        display.setTextColor(GxEPD_BLACK);
-        display.fillRect(SPLIT_POSITION + 25, yPos - 15, DISPLAY_WIDTH - SPLIT_POSITION - 45, 20, GxEPD_BLACK);
-        display.setTextColor(GxEPD_WHITE);
-      }
-      
-      // Truncate title if too long
-      String title = event.title;
-      if (title.length() > 25) {
-        title = title.substring(0, 22) + "...";
-      }
-      display.print(title);
-      
-      // Reset text color
-      if (isToday) {
-        display.setTextColor(GxEPD_BLACK);
-      }
-      
-      // Draw event location if available
-      if (!event.location.isEmpty()) {
-        yPos += 20;
-        display.setCursor(SPLIT_POSITION + 30, yPos);
-        
-        // Truncate location if too long
-        String location = event.location;
-        if (location.length() > 25) {
-          location = location.substring(0, 22) + "...";
-        }
-        display.print(location);
-      }
-      
-      // Add separator line
-      yPos += 15;
-      display.drawLine(SPLIT_POSITION + 20, yPos, DISPLAY_WIDTH - 20, yPos, GxEPD_BLACK);
-      yPos += 20;
-      
-      // Check if we've reached the bottom of the display
-      if (yPos > DISPLAY_HEIGHT - 30) {
-        display.setCursor(SPLIT_POSITION + 20, yPos);
-        display.print("+ more events");
-        break;
-      }
-    }
-  }
+  Renderer<ActivePanel>::calendarEvents(*frameCanvas, events);
 }
 
-// Draw weather icon based on icon code
 void drawWeatherIcon(int x, int y, int size, const String &iconCode) {
-  // This is a simplified implementation
-  // In a real application, you would load bitmap icons based on the icon code
-  
-  // For now, just draw a placeholder rectangle
-  display.drawRect(x, y, size, size, GxEPD_BLACK);
-  
-  // Draw icon code in the center for debugging
-  display.setFont(&FreeMonoBold9pt7b);
-  display.setCursor(x + size/4, y + size/2);
-  display.print(iconCode);
+  Renderer<ActivePanel>::weatherIcon(*frameCanvas, x, y, size, iconCode);
 }
 
-// Draw battery status indicator
 void drawBatteryStatus(int x, int y) {
-  // Read battery voltage (simplified)
-  float batteryVoltage = 3.7; // Example value
-  int batteryPercentage = 75; // Example value
-  
-  // Draw battery icon
-  display.drawRect(x, y - 10, 30, 15, GxEPD_BLACK);
-  display.fillRect(x + 30, y - 5, 3, 5, GxEPD_BLACK);
-  
-  // Fill battery based on percentage
-  int fillWidth = (batteryPercentage * 26) / 100;
-  display.fillRect(x + 2, y - 8, fillWidth, 11, GxEPD_BLACK);
-  
-  // Draw percentage text
-  display.setFont(&FreeMonoBold9pt7b);
-  display.setCursor(x - 40, y);
-  display.print(String(batteryPercentage) + "%");
+  Renderer<ActivePanel>::batteryStatus(*frameCanvas, x, y, batteryGaugePercent());
+}
+
+void drawStaleMarkers(time_t now, time_t weatherAsOf, time_t calendarAsOf) {
+  Renderer<ActivePanel>::staleMarkers(*frameCanvas, now, weatherAsOf, calendarAsOf, currentPowerPolicy().calendarIntervalS);
+}
+
+void drawClockWidget(time_t now, const WidgetModel &model) {
+  Renderer<ActivePanel>::clockWidget(*frameCanvas, now, model);
+}
+
+void refreshClockWidget(time_t now, const WidgetModel &model) {
+  ensurePanel();
+  Renderer<ActivePanel>::refreshClockWidget(display, now, model);
+  if (shownRegions.magic == SHOWN_REGIONS_MAGIC) {
+    shownRegions.keys.keys[LAYOUT_CLOCK] = Renderer<ActivePanel>::clockKey(now, model);
+  }
+}
+
+RegionKeys contentKeys(const WeatherData &currentWeather, const HourlyForecast hourlyForecast[], const CalendarEvents &events,
+                       const WidgetModel &model, time_t now, time_t weatherAsOf, time_t calendarAsOf) {
+  return Renderer<ActivePanel>::contentKeys(currentWeather, hourlyForecast, events, model, now, weatherAsOf, calendarAsOf,
+                                            batteryGaugePercent(), currentPowerPolicy().calendarIntervalS);
+}
+
+// Bounding box of the regions whose content differs from what the panel
+// shows; false if nothing changed. After power-on everything has changed.
+bool changedWindow(const RegionKeys &keys, Rect &window) {
+  bool known = shownRegions.magic == SHOWN_REGIONS_MAGIC && esp_reset_reason() == ESP_RST_DEEPSLEEP;
+  window = Rect{0, 0, 0, 0};
+  for (int i = 0; i < LAYOUT_REGION_COUNT; i++) {
+    if (!known || keys.keys[i] != shownRegions.keys.keys[i]) {
+      window = unionRect(window, ActiveLayout::region((LayoutRegion)i));
+    }
+  }
+  return !window.empty();
+}
+
+void markRegionsShown(const RegionKeys &keys) {
+  shownRegions.magic = SHOWN_REGIONS_MAGIC;
+  shownRegions.keys = keys;
+  shownFrameEtag = 0;
+}
+
+// Something other than the layout was drawn; the next update redraws it all
+void forgetShownRegions() {
+  shownRegions.magic = 0;
+}
+
+// The panel now shows the frame server's frame with this ETag
+void markFrameShown(uint32_t etag) {
+  shownFrameEtag = etag;
+}
+
+uint32_t shownFrame() {
+  return shownFrameEtag;
+}
+
+
+// Bands are written by a task on the other core, so the caller prepares the
+// next band while this one is clocked out. GxEPD2 owns the controller
+// protocol and drives SPI through the Arduino SPIClass, so the transfer is
+// taken off the caller's core instead of being handed to the DMA engine.
+class DisplayBus : public PanelBus {
+public:
+  DisplayBus() : _task(nullptr), _done(nullptr), _started(false), _previousImage(false) {}
+
+  // Only switched between frames, with no band in flight
+  void setPreviousImage(bool previousImage) { _previousImage = previousImage; }
+
+  void write(const uint8_t *rows, int16_t y, int16_t count) override {
+    ensurePanel();
+    forgetShownRegions();
+    if (!_started) {
+      start();
+    }
+    _rows = rows;
+    _y = y;
+    _count = count;
+    if (_task == nullptr) {
+      writeRows();
+      return;
+    }
+    xTaskNotifyGive(_task);
+  }
+
+  void wait() override {
+    if (_task != nullptr) {
+      xSemaphoreTake(_done, portMAX_DELAY);
+    }
+  }
+
+private:
+  // Without a writer task, bands are written on the caller's core
+  void start() {
+    _started = true;
+    _done = xSemaphoreCreateBinary();
+    BaseType_t core = portNUM_PROCESSORS > 1 ? 1 - xPortGetCoreID() : 0;
+    if (_done == nullptr ||
+        xTaskCreatePinnedToCore(writer, "panelBus", PANEL_BUS_STACK, this, PANEL_BUS_PRIORITY, &_task, core) != pdPASS) {
+      _task = nullptr;
+    }
+  }
+
+  static void writer(void *arg) {
+    DisplayBus *bus = (DisplayBus *)arg;
+    for (;;) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      bus->writeRows();
+      xSemaphoreGive(bus->_done);
+    }
+  }
+
+  void writeRows() {
+    if (_previousImage) {
+      Renderer<ActivePanel>::writeFrameRowsAgain(display, _rows, _y, _count);
+    } else {
+      Renderer<ActivePanel>::writeFrameRows(display, _rows, _y, _count);
+    }
+  }
+
+  TaskHandle_t _task;
+  SemaphoreHandle_t _done;
+  bool _started;
+  bool _previousImage;
+  const uint8_t *_rows;
+  int16_t _y;
+  int16_t _count;
+};
+
+// previousImage sends the bands to the controller's previous-image RAM
+// instead of the image to show (see writeFrameRowsAgain())
+PanelBus &panelBus(bool previousImage) {
+  static DisplayBus bus;
+  bus.setPreviousImage(previousImage);
+  return bus;
+}
+
+void refreshFrameRows(RefreshMode mode, int16_t y, int16_t count) {
+  ensurePanel();
+  Renderer<ActivePanel>::refreshFrameRows(display, mode, y, count);
+}
+
+// One band of a locally rendered frame. Drawing keeps frame coordinates and
+// is clipped to the band's rows. As in the frame server's canvas, white is
+// the only color that sets bits, so the buffer is in the layout
+// writeFrameRows() takes: row-major, MSB first, 1 = white.
+class BandCanvas : public GFXcanvas1 {
+public:
+  BandCanvas() : GFXcanvas1(DISPLAY_WIDTH, RENDER_BAND_ROWS), _top(0) {}
+
+  void setTop(int16_t top) { _top = top; }
+
+  void drawPixel(int16_t x, int16_t y, uint16_t color) override {
+    GFXcanvas1::drawPixel(x, y - _top, color == GxEPD_WHITE ? 1 : 0);
+  }
+  void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) override {
+    GFXcanvas1::drawFastHLine(x, y - _top, w, color == GxEPD_WHITE ? 1 : 0);
+  }
+  void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) override {
+    GFXcanvas1::drawFastVLine(x, y - _top, h, color == GxEPD_WHITE ? 1 : 0);
+  }
+  void fillScreen(uint16_t color) override {
+    GFXcanvas1::fillScreen(color == GxEPD_WHITE ? 1 : 0);
+  }
+
+private:
+  int16_t _top;
+};
+
+// The two band canvases, allocated on the first banded frame
+static BandCanvas *bandCanvases() {
+  static BandCanvas canvases[2];
+  return canvases;
+}
+
+// Banded frame in progress, nullptr while drawing pages of the display
+static BandPipeline *bandPipeline;
+static RefreshMode bandMode;
+static int16_t bandFirst;  // first row of the frame
+static int16_t bandEnd;    // one past its last row
+static int16_t bandTop;    // first row of the band being drawn
+static bool bandsAgain;    // drawing the frame a second time, for the previous image
+
+// Point the drawing functions at the canvas the pipeline fills next
+static void drawNextBand() {
+  BandCanvas *canvases = bandCanvases();
+  BandCanvas &canvas = bandPipeline->band() == canvases[0].getBuffer() ? canvases[0] : canvases[1];
+  canvas.setTop(bandTop);
+  frameCanvas = &canvas;
+}
+
+// Set up drawing for an update in the given mode. A partial refresh is
+// limited to the window, normally the regions whose content changed.
+// Black/white frames are drawn a band at a time, each band going out to the
+// controller while the next one is drawn. Three-color panels, whose red
+// plane the band format has no room for, and a failed band allocation fall
+// back to GxEPD2's paged drawing.
+void beginFrame(RefreshMode mode, const Rect &window) {
+  ensurePanel();
+  frameCanvas = &display;
+  BandCanvas *canvases = bandCanvases();
+  if (ActivePanel::COLOR_PLANES > 1 || canvases[0].getBuffer() == nullptr || canvases[1].getBuffer() == nullptr) {
+    Renderer<ActivePanel>::beginFrame(display, mode, window);
+    return;
+  }
+
+  bandPipeline = new BandPipeline(panelBus(), canvases[0].getBuffer(), canvases[1].getBuffer());
+  bandsAgain = false;
+  bandMode = mode;
+  bandFirst = mode == REFRESH_PARTIAL ? window.y : 0;
+  bandEnd = mode == REFRESH_PARTIAL ? window.bottom() : DISPLAY_HEIGHT;
+  bandTop = bandFirst;
+  drawNextBand();
+}
+
+// Counterpart of GxEPD2's nextPage(): hand the band just drawn to the panel
+// and return true while there is another one to draw. After the last band
+// the frame is refreshed, then drawn once more into the previous-image RAM,
+// as nextPage() does; only two bands are kept, so that takes a second pass.
+bool nextFrameBand() {
+  if (bandPipeline == nullptr) {
+    return display.nextPage();
+  }
+
+  int16_t rows = min<int16_t>(RENDER_BAND_ROWS, bandEnd - bandTop);
+  bandPipeline->send(bandTop, rows);
+  bandTop += rows;
+  if (bandTop < bandEnd) {
+    drawNextBand();
+    return true;
+  }
+
+  bandPipeline->finish();
+  if (!bandsAgain) {
+    LOG(FRAME_WRITTEN, bandEnd - bandFirst, bandPipeline->stallUs() / 1000);
+  }
+  delete bandPipeline;
+  bandPipeline = nullptr;
+  frameCanvas = &display;
+  if (bandsAgain) {
+    return false;
+  }
+
+  refreshFrameRows(bandMode, bandFirst, bandEnd - bandFirst);
+  if (!ActivePanel::PARTIAL_REFRESH) {
+    return false;
+  }
+  BandCanvas *canvases = bandCanvases();
+  bandPipeline = new BandPipeline(panelBus(true), canvases[0].getBuffer(), canvases[1].getBuffer());
+  bandsAgain = true;
+  bandTop = bandFirst;
+  drawNextBand();
+  return true;
 }
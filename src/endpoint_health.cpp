@@ -0,0 +1,80 @@
+#include "endpoint_health.h"
+#include "binlog.h"
+
+#define ENDPOINT_HEALTH_MAGIC 0x484c5431
+
+static const char *ENDPOINT_NAMES[ENDPOINT_COUNT] = {"weather", "calendar", "frame server"};
+static const char *STATE_NAMES[] = {"closed", "open", "half-open"};
+
+// Failure history kept across deep sleep
+struct EndpointHealth {
+  uint8_t failures;
+  time_t retryAt;
+};
+
+struct EndpointHealthState {
+  uint32_t magic;
+  EndpointHealth endpoints[ENDPOINT_COUNT];
+};
+
+RTC_DATA_ATTR static EndpointHealthState healthState;
+
+// A reset (power-on, crash, portal restart) gives every endpoint a clean slate
+static void ensureState() {
+  if (esp_reset_reason() != ESP_RST_DEEPSLEEP || healthState.magic != ENDPOINT_HEALTH_MAGIC) {
+    memset(&healthState, 0, sizeof(healthState));
+    healthState.magic = ENDPOINT_HEALTH_MAGIC;
+  }
+}
+
+BreakerState endpointState(Endpoint endpoint, time_t now) {
+  ensureState();
+  const EndpointHealth &health = healthState.endpoints[endpoint];
+  if (health.failures < HEALTH_BREAKER_THRESHOLD) {
+    return BREAKER_CLOSED;
+  }
+  return now >= health.retryAt ? BREAKER_HALF_OPEN : BREAKER_OPEN;
+}
+
+// Whether a request to the endpoint is worth the radio time on this wake
+bool endpointAllowed(Endpoint endpoint, time_t now) {
+  ensureState();
+  const EndpointHealth &health = healthState.endpoints[endpoint];
+  if (health.failures == 0 || now >= health.retryAt) {
+    return true;
+  }
+  LOG(ENDPOINT_SKIPPED, ENDPOINT_NAMES[endpoint], STATE_NAMES[endpointState(endpoint, now)], health.failures,
+      (long)(health.retryAt - now));
+  return false;
+}
+
+void recordEndpointResult(Endpoint endpoint, bool ok, time_t now) {
+  ensureState();
+  EndpointHealth &health = healthState.endpoints[endpoint];
+  if (ok) {
+    if (health.failures >= HEALTH_BREAKER_THRESHOLD) {
+      LOG(ENDPOINT_RECOVERED, ENDPOINT_NAMES[endpoint]);
+    }
+    health.failures = 0;
+    health.retryAt = 0;
+    return;
+  }
+
+  if (health.failures < UINT8_MAX) {
+    health.failures++;
+  }
+
+  // Exponential backoff while closed; once open, a longer cooldown that keeps
+  // doubling for as long as the half-open probes fail
+  uint32_t delay;
+  if (health.failures < HEALTH_BREAKER_THRESHOLD) {
+    delay = HEALTH_BACKOFF_BASE_S << (health.failures - 1);
+  } else {
+    uint8_t probes = min<uint8_t>(health.failures - HEALTH_BREAKER_THRESHOLD, 8);
+    delay = HEALTH_BREAKER_COOLDOWN_S << probes;
+  }
+  delay = min<uint32_t>(delay, HEALTH_BACKOFF_MAX_S);
+  health.retryAt = now + delay;
+
+  LOG(ENDPOINT_FAILED, ENDPOINT_NAMES[endpoint], health.failures, STATE_NAMES[endpointState(endpoint, now)], delay);
+}
@@ -0,0 +1,258 @@
+#include "frame_client.h"
+#include "config.h"
+#include "display.h"
+#include "frame_codec.h"
+#include "http_stream.h"
+#include "net_session.h"
+#include "binlog.h"
+#include <HTTPClient.h>
+#include <LittleFS.h>
+
+// The last frame from the server is kept in flash, so the next one can be
+// sent as a delta against it
+#define FRAME_STORE_PATH "/frame.bin"
+#define FRAME_STORE_MAGIC 0x31424645 // "EFB1"
+
+struct FrameStoreHeader {
+  uint32_t magic;
+  uint32_t etag;
+  uint16_t width;
+  uint16_t height;
+};
+
+// Rows of the stored frame, patched in place by the delta decoder
+class FrameFileStore : public FrameRowStore {
+public:
+  bool open();
+  uint32_t etag() const { return _header.etag; }
+  bool reset();
+  bool setEtag(uint32_t etag);
+  bool readRow(uint16_t row, uint8_t *data) override;
+  bool writeRow(uint16_t row, const uint8_t *data) override;
+  bool writeToPanel(int16_t y, int16_t count, bool previousImage = false);
+  void close() { _file.close(); }
+
+private:
+  size_t rowOffset(uint16_t row) const { return sizeof(FrameStoreHeader) + (size_t)row * FRAME_STRIDE; }
+
+  File _file;
+  FrameStoreHeader _header;
+};
+
+// Identifier the frame server knows this device by (as in the setup AP name)
+String deviceId() {
+  return String((uint32_t)ESP.getEfuseMac(), HEX);
+}
+
+// Open the stored frame; etag() is 0 if there is none usable for this panel
+bool FrameFileStore::open() {
+  _header = {FRAME_STORE_MAGIC, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT};
+  if (!LittleFS.begin(true)) {
+    LOG(FRAME_STORE_MOUNT_FAILED);
+    return false;
+  }
+
+  _file = LittleFS.open(FRAME_STORE_PATH, LittleFS.exists(FRAME_STORE_PATH) ? "r+" : "w+");
+  if (!_file) {
+    return false;
+  }
+  FrameStoreHeader stored;
+  bool valid = _file.read((uint8_t *)&stored, sizeof(stored)) == sizeof(stored) &&
+               stored.magic == FRAME_STORE_MAGIC && stored.width == DISPLAY_WIDTH &&
+               stored.height == DISPLAY_HEIGHT && _file.size() == rowOffset(DISPLAY_HEIGHT);
+  if (valid) {
+    _header.etag = stored.etag;
+  }
+  return true;
+}
+
+// Start over from an all-white frame (the base of a keyframe)
+bool FrameFileStore::reset() {
+  uint8_t white[FRAME_STRIDE];
+  memset(white, 0xFF, sizeof(white));
+  _header.etag = 0;
+  if (!_file.seek(0) || _file.write((const uint8_t *)&_header, sizeof(_header)) != sizeof(_header)) {
+    return false;
+  }
+  for (int16_t row = 0; row < DISPLAY_HEIGHT; row++) {
+    if (_file.write(white, sizeof(white)) != sizeof(white)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool FrameFileStore::setEtag(uint32_t etag) {
+  _header.etag = etag;
+  return _file.seek(0) && _file.write((const uint8_t *)&_header, sizeof(_header)) == sizeof(_header);
+}
+
+bool FrameFileStore::readRow(uint16_t row, uint8_t *data) {
+  return _file.seek(rowOffset(row)) && _file.read(data, FRAME_STRIDE) == FRAME_STRIDE;
+}
+
+bool FrameFileStore::writeRow(uint16_t row, const uint8_t *data) {
+  return _file.seek(rowOffset(row)) && _file.write(data, FRAME_STRIDE) == FRAME_STRIDE;
+}
+
+// Copy rows of the stored frame into the controller RAM in bands. The next
+// band is read from flash while the last one goes out over SPI. previousImage
+// writes them into the RAM the next partial refresh is diffed against.
+bool FrameFileStore::writeToPanel(int16_t y, int16_t count, bool previousImage) {
+  static uint8_t bands[2][FRAME_STRIDE * FRAME_BAND_ROWS];
+  if (!_file.seek(rowOffset(y))) {
+    return false;
+  }
+  BandPipeline pipeline(panelBus(previousImage), bands[0], bands[1]);
+  bool complete = true;
+  for (int16_t done = 0; done < count; done += FRAME_BAND_ROWS) {
+    int16_t rows = min<int16_t>(FRAME_BAND_ROWS, count - done);
+    size_t length = rows * FRAME_STRIDE;
+    if (_file.read(pipeline.band(), length) != length) {
+      complete = false;
+      break;
+    }
+    pipeline.send(y + done, rows);
+  }
+  pipeline.finish();
+  if (!previousImage) {
+    LOG(FRAME_WRITTEN, count, pipeline.stallUs() / 1000);
+  }
+  return complete;
+}
+
+// Push rows of the stored frame to the panel and refresh them. The rows are
+// then streamed from flash a second time into the previous-image RAM, as
+// GxEPD2's nextPage() does, so the next delta's partial refresh is diffed
+// against what the panel shows.
+static bool showStoredFrame(FrameFileStore &store, RefreshMode mode, int16_t firstRow, int16_t lastRow) {
+  int16_t count = lastRow - firstRow + 1;
+  if (!store.writeToPanel(firstRow, count)) {
+    store.close();
+    return false;
+  }
+
+  refreshFrameRows(mode, firstRow, count);
+  bool written = !ActivePanel::PARTIAL_REFRESH || store.writeToPanel(firstRow, count, true);
+  uint32_t etag = store.etag();
+  store.close();
+  recordRefresh(REGION_SCREEN, mode);
+  hibernateDisplay();
+  // Without a previous image to diff against, the next update redraws it all
+  if (written) {
+    markFrameShown(etag);
+  }
+  return true;
+}
+
+// End a request that produced no frame. The stored frame is only dropped
+// when invalidate is set: it no longer matches what the server thinks we
+// have, or was left half patched. Otherwise it is still a valid base.
+static bool frameFailed(HTTPClient &http, FrameFileStore &store, bool invalidate = false) {
+  http.end();
+  if (invalidate) {
+    store.setEtag(0);
+  }
+  store.close();
+  return false;
+}
+
+// Thin-client update: fetch the frame as a delta against the one stored in
+// flash, patch the store row by row as the delta streams in, then push only
+// the dirty rows to the panel for a partial refresh (or everything when the
+// refresh policy asks for a full one). When the panel shows something else
+// (after power-on, the splash or setup screen, or a local render) the whole
+// stored frame is written with a full refresh, even if the server reports no
+// change. Returns false if the server could not supply a usable frame, so
+// the caller can fall back to local rendering.
+bool updateFromFrameServer() {
+  static const char *headerKeys[] = {"Content-Type"};
+
+  FrameFileStore store;
+  if (!store.open()) {
+    return false;
+  }
+  bool panelCurrent = store.etag() != 0 && shownFrame() == store.etag();
+
+  String url = String(config.frameServerUrl) + "/frame/" + deviceId();
+  HTTPClient &http = beginRequest(url);
+  applyRequestDeadline(http);
+  http.collectHeaders(headerKeys, 1);
+  http.addHeader("Accept", FRAME_DELTA_CONTENT_TYPE);
+  if (store.etag() != 0) {
+    char etag[16];
+    snprintf(etag, sizeof(etag), "\"%08x\"", store.etag());
+    http.addHeader("If-None-Match", etag);
+  }
+
+  int httpCode = http.GET();
+  if (httpCode == HTTP_CODE_NOT_MODIFIED) {
+    LOG(FRAME_UNCHANGED);
+    keepConnection(http);
+    http.end();
+    if (!panelCurrent) {
+      return showStoredFrame(store, REFRESH_FULL, 0, DISPLAY_HEIGHT - 1);
+    }
+    store.close();
+    return true;
+  }
+  if (httpCode != HTTP_CODE_OK) {
+    LOG(FRAME_HTTP_FAILED, httpCode);
+    return frameFailed(http, store);
+  }
+  if (!http.header("Content-Type").startsWith(FRAME_DELTA_CONTENT_TYPE)) {
+    LOG(FRAME_NO_DELTAS);
+    return frameFailed(http, store);
+  }
+
+  DeadlineStream body(http.getStream(), http.getSize());
+  FrameDeltaDecoder decoder(body);
+  FrameDeltaHeader header;
+  if (!decoder.readHeader(header)) {
+    LOG(FRAME_TRUNCATED);
+    return frameFailed(http, store);
+  }
+  if (header.width != DISPLAY_WIDTH || header.height != DISPLAY_HEIGHT) {
+    LOG(FRAME_SIZE_MISMATCH);
+    return frameFailed(http, store, true);
+  }
+  bool keyframe = header.baseEtag == 0;
+  if (!keyframe && header.baseEtag != store.etag()) {
+    LOG(FRAME_WRONG_BASE);
+    return frameFailed(http, store, true);
+  }
+
+  // Invalidate the store while it is being patched
+  bool stored = keyframe ? store.reset() : store.setEtag(0);
+  if (!stored || !decoder.applyRows(header, store)) {
+    LOG(FRAME_APPLY_FAILED);
+    return frameFailed(http, store, true);
+  }
+  if (body.finish()) {
+    keepConnection(http);
+  }
+  http.end();
+  store.setEtag(header.etag);
+
+  int16_t firstRow = DISPLAY_HEIGHT;
+  int16_t lastRow = -1;
+  for (uint16_t i = 0; i < header.rangeCount; i++) {
+    firstRow = min<int16_t>(firstRow, header.ranges[i].firstRow);
+    lastRow = max<int16_t>(lastRow, header.ranges[i].firstRow + header.ranges[i].rowCount - 1);
+  }
+  LOG(FRAME_DELTA, header.rangeCount, firstRow, lastRow);
+  if (lastRow < 0 && panelCurrent) {
+    store.close();
+    markFrameShown(header.etag);
+    return true;
+  }
+
+  // A keyframe, or a panel that shows something else, needs everything
+  // redrawn; only dirty rows over the frame already shown can be partial
+  RefreshMode mode = keyframe || !panelCurrent ? REFRESH_FULL : chooseRefresh(REGION_SCREEN, time(nullptr));
+  if (mode != REFRESH_PARTIAL) {
+    firstRow = 0;
+    lastRow = DISPLAY_HEIGHT - 1;
+  }
+  return showStoredFrame(store, mode, firstRow, lastRow);
+}
@@ -0,0 +1,196 @@
+#include "frame_codec.h"
+#include "binlog.h"
+
+static void putU16(std::vector<uint8_t> &out, uint16_t value) {
+  out.push_back(value & 0xff);
+  out.push_back(value >> 8);
+}
+
+static void putU32(std::vector<uint8_t> &out, uint32_t value) {
+  putU16(out, value & 0xffff);
+  putU16(out, value >> 16);
+}
+
+static uint16_t getU16(const uint8_t *data) {
+  return data[0] | (data[1] << 8);
+}
+
+static uint32_t getU32(const uint8_t *data) {
+  return getU16(data) | ((uint32_t)getU16(data + 2) << 16);
+}
+
+static uint8_t baseByte(const uint8_t *base, size_t offset) {
+  return base != nullptr ? base[offset] : 0xff;
+}
+
+// Code one row: zero runs of two or more become run tokens, everything else
+// (including isolated zero bytes) goes into literal runs
+static void encodeRow(const uint8_t *base, const uint8_t *frame, size_t offset, size_t stride, std::vector<uint8_t> &out) {
+  size_t i = 0;
+  while (i < stride) {
+    size_t zeros = 0;
+    while (i + zeros < stride && zeros < 128 && (frame[offset + i + zeros] ^ baseByte(base, offset + i + zeros)) == 0) {
+      zeros++;
+    }
+    if (zeros >= 2 || (zeros == 1 && i + 1 == stride)) {
+      out.push_back(zeros - 1);
+      i += zeros;
+      continue;
+    }
+
+    // Literal run up to the next pair of zero bytes
+    size_t start = i;
+    size_t length = 0;
+    while (i + length < stride && length < 128) {
+      bool zeroPair = i + length + 1 < stride &&
+                      (frame[offset + i + length] ^ baseByte(base, offset + i + length)) == 0 &&
+                      (frame[offset + i + length + 1] ^ baseByte(base, offset + i + length + 1)) == 0;
+      if (zeroPair) {
+        break;
+      }
+      length++;
+    }
+    out.push_back(0x80 + length - 1);
+    for (size_t j = 0; j < length; j++) {
+      out.push_back(frame[offset + start + j] ^ baseByte(base, offset + start + j));
+    }
+    i += length;
+  }
+}
+
+// Build a delta from base to frame. base == nullptr produces a keyframe.
+void encodeFrameDelta(const uint8_t *base, const uint8_t *frame, uint16_t width, uint16_t height,
+                      uint32_t baseEtag, uint32_t etag, std::vector<uint8_t> &out) {
+  size_t stride = (width + 7) / 8;
+
+  // Collect dirty row ranges, bridging gaps of up to two clean rows (a clean
+  // row costs one token, less than a new range entry)
+  std::vector<FrameRowRange> ranges;
+  for (uint16_t row = 0; row < height; row++) {
+    bool dirty = false;
+    for (size_t b = 0; b < stride && !dirty; b++) {
+      dirty = frame[row * stride + b] != baseByte(base, row * stride + b);
+    }
+    if (!dirty) {
+      continue;
+    }
+    if (!ranges.empty() && row - (ranges.back().firstRow + ranges.back().rowCount) <= 2) {
+      ranges.back().rowCount = row - ranges.back().firstRow + 1;
+    } else {
+      ranges.push_back({row, 1});
+    }
+  }
+
+  // Too many ranges: merge across the smallest gaps until they fit
+  while (ranges.size() > FRAME_DELTA_MAX_RANGES) {
+    size_t best = 0;
+    int bestGap = INT32_MAX;
+    for (size_t i = 0; i + 1 < ranges.size(); i++) {
+      int gap = ranges[i + 1].firstRow - (ranges[i].firstRow + ranges[i].rowCount);
+      if (gap < bestGap) {
+        bestGap = gap;
+        best = i;
+      }
+    }
+    ranges[best].rowCount = ranges[best + 1].firstRow + ranges[best + 1].rowCount - ranges[best].firstRow;
+    ranges.erase(ranges.begin() + best + 1);
+  }
+
+  out.clear();
+  out.insert(out.end(), FRAME_DELTA_MAGIC, FRAME_DELTA_MAGIC + 4);
+  putU16(out, width);
+  putU16(out, height);
+  putU32(out, baseEtag);
+  putU32(out, etag);
+  putU16(out, ranges.size());
+  for (const FrameRowRange &range : ranges) {
+    putU16(out, range.firstRow);
+    putU16(out, range.rowCount);
+  }
+  for (const FrameRowRange &range : ranges) {
+    for (uint16_t row = range.firstRow; row < range.firstRow + range.rowCount; row++) {
+      encodeRow(base, frame, row * stride, stride, out);
+    }
+  }
+}
+
+bool FrameDeltaDecoder::readExact(uint8_t *data, size_t length) {
+  return _source.readBytes(data, length) == length;
+}
+
+bool FrameDeltaDecoder::readHeader(FrameDeltaHeader &header) {
+  uint8_t raw[FRAME_DELTA_HEADER_SIZE];
+  if (!readExact(raw, sizeof(raw)) || memcmp(raw, FRAME_DELTA_MAGIC, 4) != 0) {
+    LOG(FRAME_DELTA_INVALID);
+    return false;
+  }
+
+  header.width = getU16(raw + 4);
+  header.height = getU16(raw + 6);
+  header.baseEtag = getU32(raw + 8);
+  header.etag = getU32(raw + 12);
+  header.rangeCount = getU16(raw + 16);
+  if (header.rangeCount > FRAME_DELTA_MAX_RANGES) {
+    LOG(FRAME_DELTA_RANGES, (unsigned)header.rangeCount);
+    return false;
+  }
+
+  for (uint16_t i = 0; i < header.rangeCount; i++) {
+    uint8_t range[4];
+    if (!readExact(range, sizeof(range))) {
+      return false;
+    }
+    header.ranges[i].firstRow = getU16(range);
+    header.ranges[i].rowCount = getU16(range + 2);
+    if (header.ranges[i].firstRow + header.ranges[i].rowCount > header.height) {
+      LOG(FRAME_DELTA_RANGE_BOUNDS);
+      return false;
+    }
+  }
+  return true;
+}
+
+// XOR one coded row into the row buffer
+bool FrameDeltaDecoder::decodeRow(uint8_t *row, size_t stride) {
+  size_t i = 0;
+  while (i < stride) {
+    uint8_t token;
+    if (!readExact(&token, 1)) {
+      return false;
+    }
+    size_t length = (token & 0x7f) + 1;
+    if (i + length > stride) {
+      LOG(FRAME_DELTA_ROW_OVERFLOW);
+      return false;
+    }
+    if (token & 0x80) {
+      uint8_t literal[128];
+      if (!readExact(literal, length)) {
+        return false;
+      }
+      for (size_t j = 0; j < length; j++) {
+        row[i + j] ^= literal[j];
+      }
+    }
+    i += length;
+  }
+  return true;
+}
+
+bool FrameDeltaDecoder::applyRows(const FrameDeltaHeader &header, FrameRowStore &store) {
+  size_t stride = (header.width + 7) / 8;
+  uint8_t *row = (uint8_t *)malloc(stride);
+  if (row == nullptr) {
+    return false;
+  }
+
+  bool ok = true;
+  for (uint16_t i = 0; i < header.rangeCount && ok; i++) {
+    const FrameRowRange &range = header.ranges[i];
+    for (uint16_t r = range.firstRow; r < range.firstRow + range.rowCount && ok; r++) {
+      ok = store.readRow(r, row) && decodeRow(row, stride) && store.writeRow(r, row);
+    }
+  }
+  free(row);
+  return ok;
+}
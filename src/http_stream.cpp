@@ -0,0 +1,337 @@
+#include "http_stream.h"
+#include "wake_budget.h"
+#include "net_session.h"
+#include "binlog.h"
+#if CONFIG_IDF_TARGET_ESP32
+#include "esp32/rom/miniz.h"
+#else
+#include "rom/miniz.h"
+#endif
+
+// gzip header flag bits (RFC 1952)
+#define GZIP_FLAG_HCRC 0x02
+#define GZIP_FLAG_EXTRA 0x04
+#define GZIP_FLAG_NAME 0x08
+#define GZIP_FLAG_COMMENT 0x10
+
+// Unread tail of a body that is skipped to keep its connection; anything
+// longer closes the connection instead
+#define RESPONSE_DRAIN_BYTES 512
+
+InflateStream::InflateStream(Stream &source, ContentEncoding encoding)
+  : _source(source),
+    _encoding(encoding),
+    _state(STATE_HEADER),
+    _decompressor(nullptr),
+    _window(nullptr),
+    _inputPos(0),
+    _inputLen(0),
+    _inputEnded(false),
+    _windowOfs(0),
+    _outPos(0),
+    _outEnd(0),
+    _compressedBytes(0),
+    _inflatedBytes(0) {
+  _decompressor = malloc(sizeof(tinfl_decompressor));
+  _window = (uint8_t *)malloc(TINFL_LZ_DICT_SIZE);
+  if (_decompressor == nullptr || _window == nullptr) {
+    LOG(INFLATE_NO_MEMORY);
+    _state = STATE_ERROR;
+    return;
+  }
+  tinfl_init((tinfl_decompressor *)_decompressor);
+}
+
+InflateStream::~InflateStream() {
+  free(_decompressor);
+  free(_window);
+}
+
+int InflateStream::available() {
+  if (_outPos == _outEnd && !fill()) {
+    return 0;
+  }
+  return _outEnd - _outPos;
+}
+
+int InflateStream::read() {
+  if (_outPos == _outEnd && !fill()) {
+    return -1;
+  }
+  _inflatedBytes++;
+  return _window[_outPos++];
+}
+
+int InflateStream::peek() {
+  if (_outPos == _outEnd && !fill()) {
+    return -1;
+  }
+  return _window[_outPos];
+}
+
+// Move unread input to the front of the buffer and top it up from the source
+bool InflateStream::refillInput() {
+  if (_inputPos > 0) {
+    memmove(_input, _input + _inputPos, _inputLen - _inputPos);
+    _inputLen -= _inputPos;
+    _inputPos = 0;
+  }
+  if (_inputEnded || _inputLen == sizeof(_input)) {
+    return _inputLen > 0;
+  }
+
+  // readBytes() honours the client timeout, so a stalled server ends the body
+  size_t n = _source.readBytes(_input + _inputLen, sizeof(_input) - _inputLen);
+  if (n == 0) {
+    _inputEnded = true;
+  }
+  _inputLen += n;
+  _compressedBytes += n;
+  return _inputLen > 0;
+}
+
+int InflateStream::readInputByte() {
+  if (_inputPos == _inputLen && !refillInput()) {
+    return -1;
+  }
+  return _input[_inputPos++];
+}
+
+// Skip the gzip member header so tinfl sees the raw deflate stream
+bool InflateStream::skipGzipHeader() {
+  uint8_t header[10];
+  for (int i = 0; i < 10; i++) {
+    int c = readInputByte();
+    if (c < 0) {
+      return false;
+    }
+    header[i] = c;
+  }
+  if (header[0] != 0x1f || header[1] != 0x8b || header[2] != 8) {
+    LOG(INFLATE_BAD_GZIP);
+    return false;
+  }
+
+  uint8_t flags = header[3];
+  if (flags & GZIP_FLAG_EXTRA) {
+    int lo = readInputByte();
+    int hi = readInputByte();
+    if (lo < 0 || hi < 0) {
+      return false;
+    }
+    for (int len = lo | (hi << 8); len > 0; len--) {
+      if (readInputByte() < 0) {
+        return false;
+      }
+    }
+  }
+  if (flags & GZIP_FLAG_NAME) {
+    int c;
+    while ((c = readInputByte()) > 0) {}
+    if (c < 0) {
+      return false;
+    }
+  }
+  if (flags & GZIP_FLAG_COMMENT) {
+    int c;
+    while ((c = readInputByte()) > 0) {}
+    if (c < 0) {
+      return false;
+    }
+  }
+  if (flags & GZIP_FLAG_HCRC) {
+    if (readInputByte() < 0 || readInputByte() < 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// "deflate" is supposed to be zlib-wrapped, but some servers send raw
+// deflate. Consume the zlib header only when it checks out.
+bool InflateStream::skipZlibHeader() {
+  while (_inputLen - _inputPos < 2) {
+    size_t before = _inputLen - _inputPos;
+    if (!refillInput() || _inputLen - _inputPos == before) {
+      return false;
+    }
+  }
+  uint8_t cmf = _input[_inputPos];
+  uint8_t flg = _input[_inputPos + 1];
+  if ((cmf & 0x0f) == 8 && ((cmf << 8) | flg) % 31 == 0 && !(flg & 0x20)) {
+    _inputPos += 2;
+  }
+  return true;
+}
+
+// Decompress the next run of output into the window
+bool InflateStream::fill() {
+  if (_state == STATE_HEADER) {
+    bool headerOk = (_encoding == ENCODING_GZIP) ? skipGzipHeader() : skipZlibHeader();
+    _state = headerOk ? STATE_BODY : STATE_ERROR;
+  }
+  if (_state != STATE_BODY) {
+    return false;
+  }
+
+  // The previous run has been consumed; advance the circular window past it
+  _windowOfs = _outEnd & (TINFL_LZ_DICT_SIZE - 1);
+  _outPos = _outEnd = _windowOfs;
+
+  tinfl_decompressor *decompressor = (tinfl_decompressor *)_decompressor;
+  while (true) {
+    if (_inputPos == _inputLen) {
+      refillInput();
+    }
+
+    size_t inSize = _inputLen - _inputPos;
+    size_t outSize = TINFL_LZ_DICT_SIZE - _windowOfs;
+    mz_uint32 flags = _inputEnded ? 0 : TINFL_FLAG_HAS_MORE_INPUT;
+    tinfl_status status = tinfl_decompress(decompressor, _input + _inputPos, &inSize,
+                                           _window, _window + _windowOfs, &outSize, flags);
+    _inputPos += inSize;
+
+    if (status < TINFL_STATUS_DONE) {
+      LOG(INFLATE_FAILED, (int)status);
+      _state = STATE_ERROR;
+      return false;
+    }
+    if (status == TINFL_STATUS_DONE) {
+      _state = STATE_DONE;
+    }
+    if (outSize > 0) {
+      _outEnd = _windowOfs + outSize;
+      return true;
+    }
+    if (_state == STATE_DONE || (status == TINFL_STATUS_NEEDS_MORE_INPUT && _inputEnded)) {
+      _state = STATE_DONE;
+      return false;
+    }
+  }
+}
+
+bool DeadlineStream::checkDeadline() {
+  if (!_expired && budgetExpired()) {
+    LOG(RESPONSE_CUT_OFF);
+    _expired = true;
+  }
+  return !_expired;
+}
+
+int DeadlineStream::available() {
+  if (_remaining == 0 || !checkDeadline()) {
+    return 0;
+  }
+  int available = _source.available();
+  return _remaining < 0 ? available : min<int32_t>(available, _remaining);
+}
+
+int DeadlineStream::read() {
+  if (_remaining == 0 || !checkDeadline()) {
+    return -1;
+  }
+  int c = _source.read();
+  if (c >= 0 && _remaining > 0) {
+    _remaining--;
+  }
+  return c;
+}
+
+int DeadlineStream::peek() {
+  return _remaining != 0 && checkDeadline() ? _source.peek() : -1;
+}
+
+size_t DeadlineStream::readBytes(char *buffer, size_t length) {
+  if (_remaining == 0 || !checkDeadline()) {
+    return 0;
+  }
+  if (_remaining > 0) {
+    length = min<size_t>(length, _remaining);
+  }
+  _source.setTimeout(budgetRemainingMs());
+  size_t n = _source.readBytes(buffer, length);
+  if (_remaining > 0) {
+    _remaining -= n;
+  }
+  return n;
+}
+
+// Skip a short unread tail (a trailing newline, the gzip trailer). True if
+// the body was read to its end, so its connection can carry another request.
+bool DeadlineStream::finish() {
+  char scrap[64];
+  while (_remaining > 0 && _remaining <= RESPONSE_DRAIN_BYTES) {
+    if (readBytes(scrap, min<int32_t>(_remaining, sizeof(scrap))) == 0) {
+      break;
+    }
+  }
+  return _remaining == 0;
+}
+
+// Advertise compressed encodings and ask HTTPClient to keep the header we
+// need to pick the decoder. beginRequest() has already put the request in
+// HTTP/1.0, which avoids chunked framing and the default identity-only
+// Accept-Encoding that HTTPClient sends in 1.1 mode.
+void prepareCompressedRequest(HTTPClient &http) {
+  static const char *headerKeys[] = {"Content-Encoding"};
+  http.addHeader("Accept-Encoding", "gzip, deflate");
+  http.collectHeaders(headerKeys, 1);
+}
+
+// Bound the connect and the header/body reads by what is left of the stage
+void applyRequestDeadline(HTTPClient &http) {
+  uint32_t remaining = max<uint32_t>(budgetRemainingMs(), 1);
+  http.setConnectTimeout(remaining);
+  http.setTimeout(min<uint32_t>(remaining, UINT16_MAX));
+}
+
+ContentEncoding responseEncoding(HTTPClient &http) {
+  String encoding = http.header("Content-Encoding");
+  encoding.trim();
+  if (encoding.equalsIgnoreCase("gzip")) {
+    return ENCODING_GZIP;
+  }
+  if (encoding.equalsIgnoreCase("deflate")) {
+    return ENCODING_DEFLATE;
+  }
+  return ENCODING_IDENTITY;
+}
+
+template <typename... Options>
+static DeserializationError deserializeBody(DeadlineStream &body, ContentEncoding encoding, JsonDocument &doc,
+                                            Options... options) {
+  if (encoding == ENCODING_IDENTITY) {
+    return deserializeJson(doc, body, options...);
+  }
+
+  InflateStream inflater(body, encoding);
+  if (!inflater.ok()) {
+    return DeserializationError::NoMemory;
+  }
+  DeserializationError error = deserializeJson(doc, inflater, options...);
+  LOG(INFLATED, inflater.compressedBytes(), inflater.inflatedBytes());
+  return error;
+}
+
+// Parse the response body straight off the socket, inflating if needed. A
+// body cut off by the wake budget comes back as IncompleteInput. A body read
+// to its end leaves the connection open for the next request to the host.
+DeserializationError deserializeResponse(HTTPClient &http, JsonDocument &doc) {
+  DeadlineStream body(http.getStream(), http.getSize());
+  DeserializationError error = deserializeBody(body, responseEncoding(http), doc);
+  if (body.finish()) {
+    keepConnection(http);
+  }
+  return error;
+}
+
+// The same, keeping only the fields the filter marks; the rest of the body
+// is skipped as it streams past
+DeserializationError deserializeResponse(HTTPClient &http, JsonDocument &doc, DeserializationOption::Filter filter) {
+  DeadlineStream body(http.getStream(), http.getSize());
+  DeserializationError error = deserializeBody(body, responseEncoding(http), doc, filter);
+  if (body.finish()) {
+    keepConnection(http);
+  }
+  return error;
+}
@@ -4,137 +4,385 @@
 #include <ArduinoJson.h>
 #include <HTTPClient.h>
 #include <TimeLib.h>
-#include "GxEPD2_BW.h"
-#include "GxEPD2_3C.h"
-#include "epd_driver.h"
 #include "weather.h"
 #include "calendar.h"
 #include "display.h"
 #include "config.h"
+#include "metrics.h"
+#include "model_cache.h"
+#include "scheduler.h"
+#include "frame_client.h"
+#include "endpoint_health.h"
+#include "wake_budget.h"
+#include "net_session.h"
+#include "binlog.h"
+#include "civil_time.h"
+#include "clock_sync.h"
+#include "asset_bundle.h"
+#include "battery.h"
+#include "render_pipeline.h"
 
-// Display instance for Waveshare 7.5inch E-Paper HAT (H)
-// Using GxEPD2_BW class for black and white display
-GxEPD2_BW<GxEPD2_750_T7, GxEPD2_750_T7::HEIGHT> display(GxEPD2_750_T7(/*CS=*/ 15, /*DC=*/ 27, /*RST=*/ 26, /*BUSY=*/ 25));
-
-// Global variables
-WeatherData currentWeather;
-HourlyForecast hourlyForecast[24];
-CalendarEvents calendarEvents;
-Config config;
+// Setup portal timeout on a cold boot (seconds)
+#define WIFI_PORTAL_TIMEOUT_S 180
 
 // Function declarations
-void setupWiFi();
-void updateWeatherData();
-void updateCalendarData();
+bool setupWiFi(bool coldBoot);
+bool connectSavedWiFi();
+void updateTimeZone();
+void updateWeatherData(bool due);
+void updateCalendarData(bool due);
 void updateDisplay();
-bool saveConfig();
+void runClockTick();
+void goToSleep();
+void sleepUntilReplaced();
 
 void setup() {
+  // Deep sleep comes back through here as well. Only power-on and reset
+  // take the cold path with the splash screen and setup portal.
+  bool coldBoot = esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_UNDEFINED;
   Serial.begin(115200);
-  Serial.println("E-Ink Weather and Calendar Display");
+  logBegin();
+  clockBegin();
+  timeZoneBegin();
+  assetsBegin();
+
+  // Measured before the radio loads the cell. The level sets this wake's
+  // intervals and refresh budgets, and an empty battery ends it here.
+  const PowerPolicy &power = batteryCheck(time(nullptr));
+  if (power.replaceBattery) {
+    sleepUntilReplaced();
+  }
+
+  // Minute ticks redraw the clock widget from RTC memory with the radio off.
+  // If the widget has used up its ghosting budget the tick becomes a data
+  // wake, since only a full-screen redraw can clean it.
+  WakeKind wakeKind = scheduleWake();
+  if (wakeKind == WAKE_TICK && chooseRefresh(REGION_CLOCK, time(nullptr)) != REFRESH_PARTIAL) {
+    wakeKind = WAKE_DATA;
+  }
+  metricsBeginWake(wakeKind, coldBoot);
+  budgetBeginWake(wakeKind == WAKE_TICK ? BUDGET_TICK_WAKE_MS : BUDGET_DATA_WAKE_MS);
+  if (wakeKind == WAKE_TICK) {
+    runClockTick();
+    goToSleep();
+  }
+
+  LOG(BOOT);
 
-  // Initialize display
-  initDisplay();
+  // Load configuration (served from RTC memory after deep sleep)
+  loadConfig();
+
+  // The panel comes up when something is drawn; a warm wake whose content
+  // has not changed never touches it
+  initDisplay(coldBoot);
+  if (coldBoot) {
+    displayStartupScreen();
+    recordRefresh(REGION_SCREEN, REFRESH_FULL);
+  }
   
-  // Show startup screen
-  displayStartupScreen();
+  // Endpoints that keep failing are skipped and drawn from the last good
+  // data, and weather is only refetched once its cached forecast runs low
+  // or gets old. If nothing is due, the radio stays off for this wake.
+  time_t now = time(nullptr);
+  bool frameDue = config.frameServerUrl[0] != '\0' && endpointAllowed(ENDPOINT_FRAME_SERVER, now);
+  bool weatherDue = weatherRefreshDue(now) && endpointAllowed(ENDPOINT_WEATHER, now);
+  bool calendarDue = calendarRefreshDue(now, power.calendarIntervalS) && endpointAllowed(ENDPOINT_CALENDAR, now);
+  if (frameDue || weatherDue || calendarDue) {
+    // Initialize WiFi; the captive portal only opens on a cold boot
+    metricsStart(PHASE_WIFI);
+    bool connected = setupWiFi(coldBoot);
+    metricsStop(PHASE_WIFI);
+
+    // The portal waits on the user, so the wake clock starts after it
+    if (coldBoot) {
+      budgetBeginWake(BUDGET_DATA_WAKE_MS);
+    }
+
+    if (connected) {
+      // NTP only when the drift model no longer vouches for the clock; it
+      // answers in the background while the fetches run
+      if (clockSyncDue()) {
+        clockStartSync();
+      }
+      if (config.timeZone[0] == '\0') {
+        updateTimeZone();
+      }
+      // Certificate checks and the calendar window need the date, so an
+      // unset clock is waited for
+      clockWaitKnown();
+    } else {
+      frameDue = weatherDue = calendarDue = false;
+    }
+  } else {
+    LOG(OFFLINE_WAKE);
+  }
   
-  // Initialize WiFi with captive portal
-  setupWiFi();
+  // Local time for quiet hours and rendering; the table is rebuilt once a year
+  timeZoneConfigure(config.timeZone, time(nullptr));
   
-  // Get time from NTP server
-  configTime(0, 0, "pool.ntp.org", "time.nist.gov");
+  // Thin-client mode: the frame server does the fetching and rendering
+  if (frameDue && budgetStart(STAGE_FRAME)) {
+    metricsStart(PHASE_FETCH);
+    bool updated = updateFromFrameServer();
+    metricsStop(PHASE_FETCH);
+    budgetStop(STAGE_FRAME);
+    recordEndpointResult(ENDPOINT_FRAME_SERVER, updated, time(nullptr));
+    if (updated) {
+      markDataFetched(time(nullptr), false);
+      return;
+    }
+  }
   
-  // Initial data fetch
-  updateWeatherData();
-  updateCalendarData();
+  // Data fetch, falling back to the cached models. The weather pane is
+  // rendered while the calendar is fetched.
+  metricsStart(PHASE_FETCH);
+  updateWeatherData(weatherDue);
+  updateCalendarData(calendarDue);
+  metricsStop(PHASE_FETCH);
+  markDataFetched(time(nullptr));
   
   // Update display with fetched data
   updateDisplay();
 }
 
 void loop() {
-  // Check if it's time to update data (every 30 minutes)
-  static unsigned long lastUpdateTime = 0;
-  if (millis() - lastUpdateTime > 30 * 60 * 1000 || lastUpdateTime == 0) {
-    Serial.println("Updating data...");
-    updateWeatherData();
-    updateCalendarData();
-    updateDisplay();
-    lastUpdateTime = millis();
+  goToSleep();
+}
+
+// Redraw only the clock/countdown region; WiFi is never started on this path
+void runClockTick() {
+  WidgetModel model;
+  if (!loadWidgetModel(model)) {
+    model.eventCount = 0;
   }
-  
-  // Deep sleep to save power (wake up every 30 minutes)
-  Serial.println("Going to deep sleep...");
-  esp_sleep_enable_timer_wakeup(30 * 60 * 1000000); // 30 minutes in microseconds
+
+  metricsStart(PHASE_REFRESH);
+  budgetStart(STAGE_DRAW);
+  initDisplay(false);
+  refreshClockWidget(time(nullptr), model);
+  recordRefresh(REGION_CLOCK, REFRESH_PARTIAL);
+  hibernateDisplay();
+  budgetStop(STAGE_DRAW);
+  metricsStop(PHASE_REFRESH);
+}
+
+void goToSleep() {
+  clockFinishSync();
+  closeConnections();
+  budgetEndWake();
+  metricsReport();
+  uint64_t sleepUs = nextSleepDurationUs();
+  LOG(SLEEP, (unsigned)(sleepUs / 1000000ULL));
+#if LOG_ECHO_SERIAL
+  Serial.flush();
+#endif
+  esp_sleep_enable_timer_wakeup(sleepUs);
+  esp_deep_sleep_start();
+}
+
+// Leave the replace-battery screen up and sleep without a wake timer; only
+// a reset (after charging) starts the device again
+void sleepUntilReplaced() {
+  initDisplay(true);
+  displayReplaceBattery();
+  hibernateDisplay();
+  LOG(BATTERY_EMPTY_SLEEP);
+  metricsReport();
+#if LOG_ECHO_SERIAL
+  Serial.flush();
+#endif
   esp_deep_sleep_start();
 }
 
-void setupWiFi() {
+static void onPortalStarted(WiFiManager *) {
+  LOG(WIFI_PORTAL);
+  displayWiFiSetupScreen();
+}
+
+// Warm wakes join the saved network directly, without WiFiManager, and give
+// up within the connect budget
+bool connectSavedWiFi() {
+  budgetStart(STAGE_CONNECT);
+  WiFi.mode(WIFI_STA);
+  WiFi.begin();
+  bool connected = WiFi.waitForConnectResult(max<uint32_t>(budgetRemainingMs(), 1)) == WL_CONNECTED;
+  budgetStop(STAGE_CONNECT);
+  if (!connected) {
+    LOG(WIFI_CONNECT_FAILED);
+    return false;
+  }
+  IPAddress ip = WiFi.localIP();
+  LOG(WIFI_CONNECTED, ip[0], ip[1], ip[2], ip[3]);
+  return true;
+}
+
+// Returns false if WiFi is unavailable; the wake then runs from cached data
+bool setupWiFi(bool coldBoot) {
+  if (!coldBoot) {
+    return connectSavedWiFi();
+  }
+
   WiFiManager wifiManager;
   
   // Set custom parameters for the captive portal
   WiFiManagerParameter custom_location("location", "Location (optional)", "", 40);
   wifiManager.addParameter(&custom_location);
-  
-  // Set timeout for captive portal
-  wifiManager.setConfigPortalTimeout(180);
+  WiFiManagerParameter custom_frame_server("frame_server", "Frame server URL (optional)", config.frameServerUrl, sizeof(config.frameServerUrl) - 1);
+  wifiManager.addParameter(&custom_frame_server);
+  WiFiManagerParameter custom_time_zone("time_zone", "Time zone, POSIX TZ rule (optional)", config.timeZone, sizeof(config.timeZone) - 1);
+  wifiManager.addParameter(&custom_time_zone);
   
   // Set custom AP name
   String apName = "EinkWeather_" + String((uint32_t)ESP.getEfuseMac(), HEX);
   
-  // Start the captive portal
-  Serial.println("Starting WiFi setup portal...");
-  displayWiFiSetupScreen();
+  // Set timeout for captive portal; its instructions are only drawn if the
+  // saved credentials fail and the portal actually opens
+  wifiManager.setConfigPortalTimeout(WIFI_PORTAL_TIMEOUT_S);
+  wifiManager.setAPCallback(onPortalStarted);
   
-  if (!wifiManager.autoConnect(apName.c_str())) {
-    Serial.println("Failed to connect and hit timeout");
-    ESP.restart();
-    delay(1000);
+  bool connected = wifiManager.autoConnect(apName.c_str());
+  // Nobody configured it in time, or the router is still down after a power
+  // cut: draw the cached data and sleep, and the next wake joins the saved
+  // network directly
+  if (!connected) {
+    LOG(WIFI_PORTAL_TIMEOUT);
+    return false;
   }
   
-  Serial.println("WiFi connected");
-  Serial.print("IP address: ");
-  Serial.println(WiFi.localIP());
+  IPAddress ip = WiFi.localIP();
+  LOG(WIFI_CONNECTED, ip[0], ip[1], ip[2], ip[3]);
   
-  // Save custom parameters
-  config.location = String(custom_location.getValue());
+  // Save custom parameters; the portal field is empty unless the user filled it in
+  const char *location = custom_location.getValue();
+  bool changed = location[0] != '\0' && setConfigField(config.location, location);
+  changed |= setConfigField(config.frameServerUrl, custom_frame_server.getValue());
+  // A rule that does not parse would leave the display on UTC; keep the old one
+  const char *rule = custom_time_zone.getValue();
+  TimeZone zone;
+  if (rule[0] == '\0' || buildTimeZone(rule, time(nullptr), zone)) {
+    changed |= setConfigField(config.timeZone, rule);
+  } else {
+    LOG(TIMEZONE_RULE_INVALID, rule);
+  }
+  if (changed) {
+    saveConfig();
+  }
+  return true;
+}
+
+// Look up the time zone once from the IP address and keep it in the config.
+// Zones missing from the built-in table become their current fixed offset.
+void updateTimeZone() {
+  String ianaName;
+  int32_t utcOffset;
+  if (!getTimeZoneFromIP(ianaName, utcOffset)) {
+    LOG(TIMEZONE_FAILED);
+    return;
+  }
+  posixTimeZoneFor(ianaName.c_str(), utcOffset, config.timeZone, sizeof(config.timeZone));
+  LOG(TIMEZONE_DETECTED, ianaName, config.timeZone);
   saveConfig();
 }
 
-void updateWeatherData() {
-  if (getWeatherData(currentWeather, hourlyForecast)) {
-    Serial.println("Weather data updated successfully");
-  } else {
-    Serial.println("Failed to update weather data");
+// Publishes the weather snapshot, fresh or from the cache; a response that
+// fails halfway is never seen, as it only ever touched the back copy
+void updateWeatherData(bool due) {
+  WeatherSnapshot &weather = beginWeatherSnapshot();
+  if (due && budgetStart(STAGE_WEATHER)) {
+    bool ok = getWeatherData(weather.current, weather.hourly);
+    budgetStop(STAGE_WEATHER);
+    time_t now = time(nullptr);
+    recordEndpointResult(ENDPOINT_WEATHER, ok, now);
+    if (ok) {
+      LOG(WEATHER_UPDATED);
+      cacheWeatherModel(weather.current, weather.hourly, now);
+      weather.fetchedAt = now;
+      weather.valid = true;
+      publishWeatherSnapshot();
+      return;
+    }
+    LOG(WEATHER_FAILED);
   }
+  weather.fetchedAt = loadWeatherModel(weather.current, weather.hourly, time(nullptr));
+  weather.valid = weather.fetchedAt != 0;
+  publishWeatherSnapshot();
 }
 
-void updateCalendarData() {
-  if (getCalendarEvents(calendarEvents)) {
-    Serial.println("Calendar data updated successfully");
-  } else {
-    Serial.println("Failed to update calendar data");
+// Publishes the calendar snapshot, fresh or from the cache
+void updateCalendarData(bool due) {
+  CalendarEvents &events = beginCalendarSnapshot();
+  if (due && budgetStart(STAGE_CALENDAR)) {
+    bool ok = getCalendarEvents(events);
+    budgetStop(STAGE_CALENDAR);
+    recordEndpointResult(ENDPOINT_CALENDAR, ok, time(nullptr));
+    if (ok) {
+      LOG(CALENDAR_UPDATED);
+      // Shown from the cached fields, as later wakes will show it
+      cacheWidgetModel(events, time(nullptr));
+      loadCachedEvents(events);
+      publishCalendarSnapshot();
+      return;
+    }
+    LOG(CALENDAR_FAILED);
   }
+  loadCachedEvents(events);
+  publishCalendarSnapshot();
 }
 
+// Composite the published snapshots into one frame and push it to the panel
 void updateDisplay() {
-  // Clear display
-  display.firstPage();
+  // A background NTP sync has usually answered by now. The zone table is
+  // only rebuilt once the pane stages, which read it, are done.
+  time_t now = time(nullptr);
+  waitForPanes();
+  bool zoneChanged = timeZoneConfigure(config.timeZone, now);
+  finishPanes(now, zoneChanged);
+
+  const WeatherSnapshot &weather = weatherSnapshot();
+  const CalendarEvents &events = calendarSnapshot();
+  time_t weatherAsOf = weather.valid ? weather.fetchedAt : 0;
+  time_t calendarAsOf = events.lastUpdated;
+  WidgetModel model;
+  if (!loadWidgetModel(model)) {
+    model.eventCount = 0;
+  }
+  RefreshMode mode = chooseRefresh(REGION_SCREEN, now);
+
+  // A partial refresh only covers the layout regions whose content changed,
+  // and is skipped when none did
+  RegionKeys keys = contentKeys(weather.current, weather.hourly, events, model, now, weatherAsOf, calendarAsOf);
+  Rect window;
+  bool changed = changedWindow(keys, window);
+  if (mode == REFRESH_PARTIAL && !changed) {
+    LOG(DISPLAY_UNCHANGED);
+    return;
+  }
+  if (mode == REFRESH_PARTIAL) {
+    LOG(DISPLAY_WINDOW, window.x, window.y, window.w, window.h);
+  }
+
+  // Clear display; drawing always goes ahead, an overrun is only reported
+  metricsStart(PHASE_REFRESH);
+  budgetStart(STAGE_DRAW);
+  beginFrame(mode, window);
   do {
     // Draw split screen layout
     drawSplitScreenLayout();
     
     // Draw weather on left side
-    drawWeatherData(currentWeather, hourlyForecast);
+    if (weatherAsOf != 0) {
+      drawWeatherData(weather.current);
+    }
     
     // Draw calendar on right side
-    drawCalendarEvents(calendarEvents);
+    drawCalendarEvents(events);
+    drawClockWidget(now, model);
+    drawStaleMarkers(now, weatherAsOf, calendarAsOf);
     
-  } while (display.nextPage());
-}
-
-void saveConfig() {
-  // Save configuration to SPIFFS or preferences
-  Serial.println("Saving configuration...");
+  } while (nextFrameBand());
+  recordRefresh(REGION_SCREEN, mode);
+  markRegionsShown(keys);
+  hibernateDisplay();
+  budgetStop(STAGE_DRAW);
+  metricsStop(PHASE_REFRESH);
 }
@@ -0,0 +1,140 @@
+#include "metrics.h"
+#include "binlog.h"
+
+static const char *WAKE_KIND_NAMES[WAKE_KIND_COUNT] = {"data", "tick"};
+
+// Running totals per wake kind, kept across deep sleep
+struct WakeTotals {
+  uint32_t wakes;
+  uint32_t awakeMs;
+  float energyMas;
+  uint32_t overrunWakes;
+};
+
+RTC_DATA_ATTR static WakeTotals wakeTotals[WAKE_KIND_COUNT];
+
+static WakeKind currentKind = WAKE_DATA;
+static bool currentColdBoot;
+static int64_t phaseStartUs[PHASE_COUNT];
+static int64_t phaseTotalUs[PHASE_COUNT];
+static uint32_t overrunCount;
+static uint32_t overrunMs;
+
+// Connection setup this wake
+struct NetCounters {
+  uint16_t requests;
+  uint16_t reused;
+  uint16_t dnsCached;
+  uint16_t dnsLookups;
+  uint16_t handshakes;
+  uint16_t resumed;
+  uint32_t handshakeMs;
+  uint32_t savedMs;
+};
+
+static NetCounters netCounters;
+
+void metricsBeginWake(WakeKind kind, bool coldBoot) {
+  // RTC memory only survives deep sleep; start the totals over on any other reset
+  if (esp_reset_reason() != ESP_RST_DEEPSLEEP) {
+    memset(wakeTotals, 0, sizeof(wakeTotals));
+  }
+  currentKind = kind;
+  currentColdBoot = coldBoot;
+  memset(phaseStartUs, 0, sizeof(phaseStartUs));
+  memset(phaseTotalUs, 0, sizeof(phaseTotalUs));
+  overrunCount = 0;
+  overrunMs = 0;
+  memset(&netCounters, 0, sizeof(netCounters));
+}
+
+void metricsStart(WakePhase phase) {
+  phaseStartUs[phase] = esp_timer_get_time();
+}
+
+void metricsStop(WakePhase phase) {
+  if (phaseStartUs[phase] != 0) {
+    phaseTotalUs[phase] += esp_timer_get_time() - phaseStartUs[phase];
+    phaseStartUs[phase] = 0;
+  }
+}
+
+// A stage (or the whole wake) ran past its budget
+void metricsOverrun(uint32_t overMs) {
+  overrunCount++;
+  overrunMs += overMs;
+}
+
+// An HTTP request; reused if it went out on a connection kept alive
+void metricsRequest(bool reused) {
+  netCounters.requests++;
+  if (reused) {
+    netCounters.reused++;
+  }
+}
+
+void metricsDnsLookup(bool cached) {
+  if (cached) {
+    netCounters.dnsCached++;
+  } else {
+    netCounters.dnsLookups++;
+  }
+}
+
+// A TLS handshake; savedMs is the estimate of what resumption saved
+void metricsHandshake(bool resumed, uint32_t ms, uint32_t savedMs) {
+  netCounters.handshakes++;
+  netCounters.handshakeMs += ms;
+  if (resumed) {
+    netCounters.resumed++;
+    netCounters.savedMs += savedMs;
+  }
+}
+
+uint32_t metricsPhaseMs(WakePhase phase) {
+  return phaseTotalUs[phase] / 1000;
+}
+
+// Estimated charge drawn so far this wake, in mA*s.
+// esp_timer starts at reset, so it also covers the time before setup().
+float metricsWakeEnergyMas() {
+  float awakeS = esp_timer_get_time() / 1e6f;
+  float wifiS = phaseTotalUs[PHASE_WIFI] / 1e6f + phaseTotalUs[PHASE_FETCH] / 1e6f;
+  float refreshS = phaseTotalUs[PHASE_REFRESH] / 1e6f;
+  return awakeS * CURRENT_CPU_ACTIVE_MA + wifiS * CURRENT_WIFI_EXTRA_MA + refreshS * CURRENT_PANEL_REFRESH_EXTRA_MA;
+}
+
+// Log this wake's phase breakdown and energy, then fold it into the totals
+void metricsReport() {
+  uint32_t awakeMs = esp_timer_get_time() / 1000;
+  float energyMas = metricsWakeEnergyMas();
+
+  WakeTotals &totals = wakeTotals[currentKind];
+  totals.wakes++;
+  totals.awakeMs += awakeMs;
+  totals.energyMas += energyMas;
+  if (overrunCount > 0) {
+    totals.overrunWakes++;
+  }
+
+  LOG(WAKE_METRICS, WAKE_KIND_NAMES[currentKind], currentColdBoot ? "cold boot" : "warm", (unsigned)awakeMs,
+      energyMas, energyMas / 3.6f);
+  LOG(WAKE_PHASES, (unsigned)metricsPhaseMs(PHASE_BOOT), (unsigned)metricsPhaseMs(PHASE_WIFI),
+      (unsigned)metricsPhaseMs(PHASE_FETCH), (unsigned)metricsPhaseMs(PHASE_RENDER),
+      (unsigned)metricsPhaseMs(PHASE_REFRESH));
+  if (overrunCount > 0) {
+    LOG(WAKE_OVERRUNS, (unsigned)overrunCount, (unsigned)overrunMs);
+  }
+  if (netCounters.requests > 0) {
+    LOG(WAKE_HTTP, (unsigned)netCounters.requests, (unsigned)netCounters.reused);
+  }
+  if (netCounters.dnsCached + netCounters.dnsLookups > 0) {
+    LOG(WAKE_DNS, (unsigned)netCounters.dnsCached, (unsigned)netCounters.dnsLookups);
+  }
+  if (netCounters.handshakes > 0) {
+    LOG(WAKE_TLS, (unsigned)netCounters.handshakes, (unsigned)netCounters.resumed, (unsigned)netCounters.handshakeMs,
+        (unsigned)netCounters.savedMs);
+  }
+  LOG(WAKE_AVERAGE, WAKE_KIND_NAMES[currentKind], (unsigned)(totals.awakeMs / totals.wakes),
+      totals.energyMas / totals.wakes, (unsigned)totals.wakes, (unsigned)totals.overrunWakes);
+}
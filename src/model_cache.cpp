@@ -0,0 +1,293 @@
+#include "model_cache.h"
+#include "binlog.h"
+#include <Preferences.h>
+
+#define MODEL_CACHE_MAGIC 0x4d4f4432
+
+// NVS location and layout version of the weather model
+#define WEATHER_NAMESPACE "eink-weather"
+#define WEATHER_BLOB_KEY "weather"
+#define WEATHER_MODEL_VERSION 1
+
+#define SECONDS_PER_HOUR 3600
+
+// On-flash layout: header followed by the raw WeatherModel struct
+struct WeatherBlobHeader {
+  uint16_t version;
+  uint16_t size;
+};
+
+// Last good widget model kept across deep sleep
+RTC_DATA_ATTR static uint32_t widgetMagic;
+RTC_DATA_ATTR static WidgetModel widgetModel;
+
+// Weather model as last read from / written to flash during this wake
+static WeatherModel weatherModel;
+static bool weatherModelRead = false;
+static bool weatherModelValid = false;
+
+// OpenWeatherMap's description for each icon number
+struct IconDescription {
+  uint8_t number;
+  const char *description;
+};
+
+static const IconDescription ICON_DESCRIPTIONS[] = {
+  {1, "clear sky"}, {2, "few clouds"}, {3, "scattered clouds"}, {4, "broken clouds"},
+  {9, "shower rain"}, {10, "rain"}, {11, "thunderstorm"}, {13, "snow"}, {50, "mist"},
+};
+
+// Cut on a character boundary so a long title never ends in half a UTF-8 sequence
+static void copyString(char *dest, size_t size, const String &value) {
+  size_t length = value.length();
+  if (length > size - 1) {
+    length = size - 1;
+    while (length > 0 && ((uint8_t)value[length] & 0xc0) == 0x80) {
+      length--;
+    }
+  }
+  memcpy(dest, value.c_str(), length);
+  dest[length] = '\0';
+}
+
+// Keep the next few unfinished events (already sorted by start time)
+void buildWidgetModel(const CalendarEvents &events, time_t now, WidgetModel &model) {
+  model.fetchedAt = now;
+  model.eventCount = 0;
+
+  for (const auto &event : events.events) {
+    if (model.eventCount == CACHED_EVENT_COUNT) {
+      break;
+    }
+    if (event.endTime <= now) {
+      continue;
+    }
+
+    CachedEvent &cached = model.events[model.eventCount++];
+    cached.startTime = event.startTime;
+    cached.endTime = event.endTime;
+    cached.isAllDay = event.isAllDay;
+    copyString(cached.title, sizeof(cached.title), event.title);
+    copyString(cached.location, sizeof(cached.location), event.location);
+  }
+}
+
+void cacheWidgetModel(const CalendarEvents &events, time_t now) {
+  buildWidgetModel(events, now, widgetModel);
+  widgetMagic = MODEL_CACHE_MAGIC;
+}
+
+bool loadWidgetModel(WidgetModel &model) {
+  if (widgetMagic != MODEL_CACHE_MAGIC) {
+    return false;
+  }
+  model = widgetModel;
+  return true;
+}
+
+// Rebuild the event list from the widget model. Returns when it was fetched,
+// or 0 if nothing is cached. Fresh events are shown through this as well, so
+// a pane drawn from cache matches the one drawn after the fetch.
+time_t loadCachedEvents(CalendarEvents &events) {
+  events.events.clear();
+  events.lastUpdated = 0;
+  if (widgetMagic != MODEL_CACHE_MAGIC) {
+    return 0;
+  }
+
+  for (uint8_t i = 0; i < widgetModel.eventCount; i++) {
+    const CachedEvent &cached = widgetModel.events[i];
+    CalendarEvent event;
+    event.title = cached.title;
+    event.location = cached.location;
+    event.startTime = cached.startTime;
+    event.endTime = cached.endTime;
+    event.isAllDay = cached.isAllDay;
+    events.events.push_back(event);
+  }
+  events.lastUpdated = widgetModel.fetchedAt;
+  return widgetModel.fetchedAt;
+}
+
+// "10n" -> 21; 0 if the code is missing or malformed
+static uint8_t packIcon(const String &iconCode) {
+  int number = iconCode.toInt();
+  if (number <= 0 || number > 99) {
+    return 0;
+  }
+  return number * 2 + (iconCode.endsWith("n") ? 1 : 0);
+}
+
+static String unpackIcon(uint8_t icon) {
+  if (icon == 0) {
+    return String();
+  }
+  char code[4];
+  snprintf(code, sizeof(code), "%02u%c", icon / 2, icon & 1 ? 'n' : 'd');
+  return String(code);
+}
+
+static const char *iconDescription(uint8_t icon) {
+  for (const IconDescription &entry : ICON_DESCRIPTIONS) {
+    if (entry.number == icon / 2) {
+      return entry.description;
+    }
+  }
+  return nullptr;
+}
+
+static bool readWeatherModel() {
+  if (weatherModelRead) {
+    return weatherModelValid;
+  }
+  weatherModelRead = true;
+
+  Preferences preferences;
+  if (!preferences.begin(WEATHER_NAMESPACE, true)) {
+    return false;
+  }
+  uint8_t buffer[sizeof(WeatherBlobHeader) + sizeof(WeatherModel)];
+  size_t length = preferences.getBytes(WEATHER_BLOB_KEY, buffer, sizeof(buffer));
+  preferences.end();
+
+  WeatherBlobHeader header;
+  memcpy(&header, buffer, sizeof(header));
+  weatherModelValid = length == sizeof(buffer) && header.version == WEATHER_MODEL_VERSION &&
+                      header.size == sizeof(WeatherModel);
+  if (weatherModelValid) {
+    memcpy(&weatherModel, buffer + sizeof(header), sizeof(weatherModel));
+  }
+  return weatherModelValid;
+}
+
+static bool writeWeatherModel() {
+  uint8_t buffer[sizeof(WeatherBlobHeader) + sizeof(WeatherModel)];
+  WeatherBlobHeader header = {WEATHER_MODEL_VERSION, sizeof(WeatherModel)};
+  memcpy(buffer, &header, sizeof(header));
+  memcpy(buffer + sizeof(header), &weatherModel, sizeof(weatherModel));
+
+  Preferences preferences;
+  if (!preferences.begin(WEATHER_NAMESPACE, false)) {
+    return false;
+  }
+  size_t written = preferences.putBytes(WEATHER_BLOB_KEY, buffer, sizeof(buffer));
+  preferences.end();
+  return written == sizeof(buffer);
+}
+
+// Persist the full hourly series, packed. Stops at the first gap, since
+// entries are stored as consecutive hours from firstHour.
+void cacheWeatherModel(const WeatherData &currentWeather, const HourlyForecast hourlyForecast[], time_t now) {
+  WeatherModel &model = weatherModel;
+  memset(&model, 0, sizeof(model));
+  model.fetchedAt = now;
+  model.timestamp = currentWeather.timestamp;
+  copyString(model.location, sizeof(model.location), currentWeather.location);
+  copyString(model.description, sizeof(model.description), currentWeather.description);
+  copyString(model.iconCode, sizeof(model.iconCode), currentWeather.iconCode);
+  copyString(model.windDirection, sizeof(model.windDirection), currentWeather.windDirection);
+  model.temperature = currentWeather.temperature;
+  model.feelsLike = currentWeather.feelsLike;
+  model.windSpeed = currentWeather.windSpeed;
+  model.humidity = currentWeather.humidity;
+  model.pressure = currentWeather.pressure;
+  model.uvIndex = currentWeather.uvIndex;
+
+  model.firstHour = hourlyForecast[0].timestamp;
+  for (int i = 0; i < HOURLY_FORECAST_COUNT; i++) {
+    const HourlyForecast &forecast = hourlyForecast[i];
+    if (forecast.timestamp == 0 || forecast.timestamp != model.firstHour + (time_t)i * SECONDS_PER_HOUR) {
+      break;
+    }
+    PackedHour &hour = model.hourly[model.hourCount++];
+    hour.temperature = (int16_t)lroundf(max(-300.0f, min(forecast.temperature, 300.0f)) * 10);
+    hour.precipitation = max(0, min(forecast.precipitation, 100));
+    hour.icon = packIcon(forecast.iconCode);
+  }
+
+  weatherModelRead = true;
+  weatherModelValid = true;
+  if (!writeWeatherModel()) {
+    LOG(WEATHER_MODEL_WRITE_FAILED);
+  }
+}
+
+// Restore the last good weather. Returns when it was fetched, or 0 if
+// nothing is cached. Once the hour the current conditions were observed in
+// has passed, temperature and sky come from the forecast for this hour.
+time_t loadWeatherModel(WeatherData &currentWeather, HourlyForecast hourlyForecast[], time_t now) {
+  if (!readWeatherModel()) {
+    return 0;
+  }
+
+  const WeatherModel &model = weatherModel;
+  currentWeather.location = model.location;
+  currentWeather.description = model.description;
+  currentWeather.iconCode = model.iconCode;
+  currentWeather.windDirection = model.windDirection;
+  currentWeather.temperature = model.temperature;
+  currentWeather.feelsLike = model.feelsLike;
+  currentWeather.windSpeed = model.windSpeed;
+  currentWeather.humidity = model.humidity;
+  currentWeather.pressure = model.pressure;
+  currentWeather.uvIndex = model.uvIndex;
+  currentWeather.timestamp = model.timestamp;
+
+  for (int i = 0; i < HOURLY_FORECAST_COUNT; i++) {
+    HourlyForecast &forecast = hourlyForecast[i];
+    if (i >= model.hourCount) {
+      forecast.timestamp = 0;
+      continue;
+    }
+    const PackedHour &hour = model.hourly[i];
+    forecast.timestamp = model.firstHour + (time_t)i * SECONDS_PER_HOUR;
+    forecast.temperature = hour.temperature / 10.0f;
+    forecast.precipitation = hour.precipitation;
+    forecast.iconCode = unpackIcon(hour.icon);
+  }
+
+  int current = forecastHourAt(hourlyForecast, now);
+  if (current >= 0 && hourlyForecast[current].timestamp <= now && hourlyForecast[current].timestamp > model.timestamp) {
+    const HourlyForecast &forecast = hourlyForecast[current];
+    currentWeather.feelsLike += forecast.temperature - currentWeather.temperature;
+    currentWeather.temperature = forecast.temperature;
+    currentWeather.timestamp = forecast.timestamp;
+    const char *description = iconDescription(model.hourly[current].icon);
+    if (description != nullptr) {
+      currentWeather.iconCode = forecast.iconCode;
+      currentWeather.description = description;
+    }
+  }
+  return model.fetchedAt;
+}
+
+// True if the cached weather is too old or too short to keep rendering from
+bool weatherRefreshDue(time_t now) {
+  if (now < MIN_VALID_EPOCH || !readWeatherModel()) {
+    return true;
+  }
+  const WeatherModel &model = weatherModel;
+  time_t horizon = model.firstHour + (time_t)model.hourCount * SECONDS_PER_HOUR;
+  return now - model.fetchedAt >= WEATHER_MAX_AGE_S || horizon - now < FORECAST_MIN_HORIZON_S;
+}
+
+// Calendar fetches are spaced out by interval while the battery runs low. A
+// wake up to a minute early still counts, so timer jitter does not push the
+// fetch to the wake after.
+bool calendarRefreshDue(time_t now, uint32_t interval) {
+  if (now < MIN_VALID_EPOCH || widgetMagic != MODEL_CACHE_MAGIC || now < widgetModel.fetchedAt) {
+    return true;
+  }
+  return now - widgetModel.fetchedAt + 60 >= (time_t)interval;
+}
+
+// Index of the first forecast hour that has not ended by now, or -1 if the
+// series has run out
+int forecastHourAt(const HourlyForecast hourlyForecast[], time_t now) {
+  for (int i = 0; i < HOURLY_FORECAST_COUNT && hourlyForecast[i].timestamp != 0; i++) {
+    if (now < hourlyForecast[i].timestamp + SECONDS_PER_HOUR) {
+      return i;
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,609 @@
+#include "net_session.h"
+#include "metrics.h"
+#include "wake_budget.h"
+#include "binlog.h"
+#include "civil_time.h"
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <WiFiClientSecure.h>
+#include "ssl_client.h"
+#include "lwip/sockets.h"
+
+#define NET_CACHE_MAGIC 0x4e435331
+
+#define DNS_PORT 53
+#define DNS_HEADER_SIZE 12
+#define DNS_PACKET_SIZE 512
+#define DNS_TYPE_A 1
+#define DNS_TYPE_CNAME 5
+#define DNS_CLASS_IN 1
+
+// The IDF's built-in root certificate bundle. Declared here because the
+// WiFiClientSecure library ships a header of the same name for its own.
+extern "C" esp_err_t esp_crt_bundle_attach(void *conf);
+
+struct DnsEntry {
+  char host[NET_HOST_LENGTH];
+  uint32_t address;
+  uint32_t expiresAt;
+};
+
+struct TlsSessionSlot {
+  char host[NET_HOST_LENGTH];
+  uint32_t savedAt;
+  uint16_t length;
+  uint8_t data[TLS_SESSION_BYTES];
+};
+
+struct NetCache {
+  uint32_t magic;
+  DnsEntry dns[DNS_CACHE_HOSTS];
+  TlsSessionSlot sessions[TLS_SESSION_SLOTS];
+  // Running average of full handshakes, to estimate what resumption saves
+  uint16_t fullHandshakeMs;
+};
+
+RTC_DATA_ATTR static NetCache netCache;
+
+static void ensureCache() {
+  if (netCache.magic != NET_CACHE_MAGIC) {
+    memset(&netCache, 0, sizeof(netCache));
+    netCache.magic = NET_CACHE_MAGIC;
+  }
+}
+
+// Cache times are wall-clock; before NTP has ever answered nothing is cached
+static bool clockValid() {
+  return time(nullptr) >= MIN_VALID_EPOCH;
+}
+
+static bool cacheableHost(const char *host) {
+  return strlen(host) < NET_HOST_LENGTH;
+}
+
+// Slot for a host: its own, else an empty one, else the one expiring first
+template <typename Slot, size_t N, typename Age>
+static Slot &slotFor(Slot (&slots)[N], const char *host, Age age) {
+  Slot *chosen = &slots[0];
+  for (size_t i = 0; i < N; i++) {
+    if (strcmp(slots[i].host, host) == 0) {
+      return slots[i];
+    }
+    if (slots[i].host[0] == '\0') {
+      chosen = &slots[i];
+    } else if (chosen->host[0] != '\0' && age(slots[i]) < age(*chosen)) {
+      chosen = &slots[i];
+    }
+  }
+  return *chosen;
+}
+
+static uint32_t dnsExpiry(const DnsEntry &entry) {
+  return entry.expiresAt;
+}
+
+static uint32_t sessionAge(const TlsSessionSlot &slot) {
+  return slot.savedAt;
+}
+
+static DnsEntry *findDns(const char *host) {
+  for (int i = 0; i < DNS_CACHE_HOSTS; i++) {
+    if (strcmp(netCache.dns[i].host, host) == 0) {
+      return &netCache.dns[i];
+    }
+  }
+  return nullptr;
+}
+
+static TlsSessionSlot *findSession(const char *host) {
+  for (int i = 0; i < TLS_SESSION_SLOTS; i++) {
+    if (strcmp(netCache.sessions[i].host, host) == 0 && netCache.sessions[i].length > 0) {
+      return &netCache.sessions[i];
+    }
+  }
+  return nullptr;
+}
+
+// Drop everything cached for a host after it failed to connect with it
+static void forgetHost(const char *host) {
+  DnsEntry *entry = findDns(host);
+  if (entry != nullptr) {
+    memset(entry, 0, sizeof(*entry));
+  }
+  TlsSessionSlot *slot = findSession(host);
+  if (slot != nullptr) {
+    memset(slot, 0, sizeof(*slot));
+  }
+}
+
+// Length of the (possibly compressed) name at offset, or 0 if malformed
+static size_t skipDnsName(const uint8_t *packet, size_t length, size_t offset) {
+  size_t start = offset;
+  while (offset < length) {
+    uint8_t label = packet[offset];
+    if ((label & 0xC0) == 0xC0) {
+      return offset + 2 <= length ? offset + 2 - start : 0;
+    }
+    if (label == 0) {
+      return offset + 1 - start;
+    }
+    offset += label + 1;
+  }
+  return 0;
+}
+
+static uint16_t getU16(const uint8_t *data) {
+  return (data[0] << 8) | data[1];
+}
+
+static uint32_t getU32(const uint8_t *data) {
+  return ((uint32_t)getU16(data) << 16) | getU16(data + 2);
+}
+
+// One A query to the network's DNS server. lwIP's resolver does not report
+// record TTLs, so the query is made here; the TTL of a CNAME chain is the
+// shortest one in it.
+static bool queryDns(const char *host, IPAddress &address, uint32_t &ttl) {
+  uint8_t packet[DNS_PACKET_SIZE];
+  uint16_t id = esp_random();
+  memset(packet, 0, DNS_HEADER_SIZE);
+  packet[0] = id >> 8;
+  packet[1] = id & 0xff;
+  packet[2] = 0x01; // recursion desired
+  packet[5] = 1;    // one question
+
+  size_t length = DNS_HEADER_SIZE;
+  for (const char *label = host; *label != '\0';) {
+    const char *dot = strchr(label, '.');
+    size_t labelLength = dot != nullptr ? dot - label : strlen(label);
+    if (labelLength == 0 || labelLength > 63 || length + labelLength + 6 > sizeof(packet)) {
+      return false;
+    }
+    packet[length++] = labelLength;
+    memcpy(packet + length, label, labelLength);
+    length += labelLength;
+    label += labelLength + (dot != nullptr ? 1 : 0);
+  }
+  packet[length++] = 0;
+  packet[length++] = 0;
+  packet[length++] = DNS_TYPE_A;
+  packet[length++] = 0;
+  packet[length++] = DNS_CLASS_IN;
+
+  WiFiUDP udp;
+  if (!udp.beginPacket(WiFi.dnsIP(), DNS_PORT) || udp.write(packet, length) != length || !udp.endPacket()) {
+    return false;
+  }
+
+  uint32_t timeoutMs = min<uint32_t>(DNS_QUERY_TIMEOUT_MS, budgetRemainingMs());
+  uint32_t start = millis();
+  int received = 0;
+  while ((received = udp.parsePacket()) <= 0) {
+    if (millis() - start >= timeoutMs) {
+      udp.stop();
+      return false;
+    }
+    delay(5);
+  }
+  length = udp.read(packet, sizeof(packet));
+  udp.stop();
+
+  // Our ID, a response, no error, not truncated
+  if (length < DNS_HEADER_SIZE || getU16(packet) != id || !(packet[2] & 0x80) || (packet[2] & 0x02) || (packet[3] & 0x0F) != 0) {
+    return false;
+  }
+  size_t offset = DNS_HEADER_SIZE;
+  for (uint16_t i = getU16(packet + 4); i > 0; i--) {
+    size_t nameLength = skipDnsName(packet, length, offset);
+    if (nameLength == 0) {
+      return false;
+    }
+    offset += nameLength + 4;
+  }
+
+  bool found = false;
+  ttl = DNS_MAX_TTL_S;
+  for (uint16_t i = getU16(packet + 6); i > 0 && !found; i--) {
+    size_t nameLength = skipDnsName(packet, length, offset);
+    if (nameLength == 0 || offset + nameLength + 10 > length) {
+      return false;
+    }
+    offset += nameLength;
+    uint16_t type = getU16(packet + offset);
+    uint16_t recordClass = getU16(packet + offset + 2);
+    uint32_t recordTtl = getU32(packet + offset + 4);
+    uint16_t dataLength = getU16(packet + offset + 8);
+    offset += 10;
+    if (offset + dataLength > length) {
+      return false;
+    }
+    if (recordClass == DNS_CLASS_IN && (type == DNS_TYPE_A || type == DNS_TYPE_CNAME)) {
+      ttl = min(ttl, recordTtl);
+    }
+    if (recordClass == DNS_CLASS_IN && type == DNS_TYPE_A && dataLength == 4) {
+      address = IPAddress(packet[offset], packet[offset + 1], packet[offset + 2], packet[offset + 3]);
+      found = true;
+    }
+    offset += dataLength;
+  }
+  return found;
+}
+
+// Resolve from the cache while the record's TTL lasts, else look it up
+static bool resolveHost(const char *host, IPAddress &address) {
+  ensureCache();
+  uint32_t now = time(nullptr);
+  bool cacheable = cacheableHost(host) && clockValid();
+  DnsEntry *entry = cacheable ? findDns(host) : nullptr;
+  if (entry != nullptr && now < entry->expiresAt) {
+    address = IPAddress(entry->address);
+    metricsDnsLookup(true);
+    return true;
+  }
+
+  uint32_t ttl;
+  if (!queryDns(host, address, ttl)) {
+    if (!WiFi.hostByName(host, address)) {
+      LOG(DNS_FAILED, host);
+      return false;
+    }
+    ttl = DNS_DEFAULT_TTL_S;
+  }
+  metricsDnsLookup(false);
+  LOG(DNS_RESOLVED, host, (unsigned)ttl);
+
+  if (cacheable && ttl > 0) {
+    DnsEntry &slot = slotFor(netCache.dns, host, dnsExpiry);
+    strcpy(slot.host, host);
+    slot.address = (uint32_t)address;
+    slot.expiresAt = now + ttl;
+  }
+  return true;
+}
+
+// The cached session for a host, if there is a fresh one
+static bool loadSession(const char *host, mbedtls_ssl_session &session) {
+  TlsSessionSlot *slot = clockValid() ? findSession(host) : nullptr;
+  if (slot == nullptr || (uint32_t)time(nullptr) - slot->savedAt >= TLS_SESSION_MAX_AGE_S) {
+    return false;
+  }
+  if (mbedtls_ssl_session_load(&session, slot->data, slot->length) != 0) {
+    memset(slot, 0, sizeof(*slot));
+    return false;
+  }
+  return true;
+}
+
+// Keep the session just negotiated (or renewed) for the next wake
+static void storeSession(const char *host, const mbedtls_ssl_context &context) {
+  if (!cacheableHost(host) || !clockValid()) {
+    return;
+  }
+  mbedtls_ssl_session session;
+  mbedtls_ssl_session_init(&session);
+  if (mbedtls_ssl_get_session(&context, &session) != 0) {
+    mbedtls_ssl_session_free(&session);
+    return;
+  }
+#if defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
+  // An abbreviated handshake never looks at the peer certificate, and it
+  // would not fit in RTC memory
+  if (session.peer_cert != nullptr) {
+    mbedtls_x509_crt_free(session.peer_cert);
+    mbedtls_free(session.peer_cert);
+    session.peer_cert = nullptr;
+  }
+#endif
+
+  TlsSessionSlot &slot = slotFor(netCache.sessions, host, sessionAge);
+  size_t length = 0;
+  if (mbedtls_ssl_session_save(&session, slot.data, sizeof(slot.data), &length) == 0) {
+    strcpy(slot.host, host);
+    slot.savedAt = time(nullptr);
+    slot.length = length;
+  } else {
+    LOG(TLS_SESSION_TOO_LARGE, host);
+    memset(&slot, 0, sizeof(slot));
+  }
+  mbedtls_ssl_session_free(&session);
+}
+
+// TCP connect with a timeout, leaving the socket non-blocking with read and
+// write timeouts like the core does
+static int connectSocket(IPAddress address, uint16_t port, uint32_t timeoutMs, uint32_t ioTimeoutMs) {
+  int fd = lwip_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (fd < 0) {
+    return -1;
+  }
+  struct sockaddr_in server;
+  memset(&server, 0, sizeof(server));
+  server.sin_family = AF_INET;
+  server.sin_addr.s_addr = (uint32_t)address;
+  server.sin_port = htons(port);
+
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  int result = lwip_connect(fd, (struct sockaddr *)&server, sizeof(server));
+  if (result < 0 && errno != EINPROGRESS) {
+    lwip_close(fd);
+    return -1;
+  }
+
+  fd_set writable;
+  FD_ZERO(&writable);
+  FD_SET(fd, &writable);
+  struct timeval timeout = {(time_t)(timeoutMs / 1000), (suseconds_t)((timeoutMs % 1000) * 1000)};
+  int error = 0;
+  socklen_t errorLength = sizeof(error);
+  if (lwip_select(fd + 1, nullptr, &writable, nullptr, &timeout) <= 0 ||
+      lwip_getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &errorLength) < 0 || error != 0) {
+    lwip_close(fd);
+    return -1;
+  }
+
+  struct timeval ioTimeout = {(time_t)(ioTimeoutMs / 1000), (suseconds_t)((ioTimeoutMs % 1000) * 1000)};
+  int enable = 1;
+  lwip_setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &ioTimeout, sizeof(ioTimeout));
+  lwip_setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &ioTimeout, sizeof(ioTimeout));
+  lwip_setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+  lwip_setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &enable, sizeof(enable));
+  return fd;
+}
+
+// Plain HTTP client that connects through the DNS cache
+class CachedDnsClient : public WiFiClient {
+public:
+  using WiFiClient::connect;
+
+  int connect(const char *host, uint16_t port) override {
+    return connect(host, port, budgetRemainingMs());
+  }
+
+  int connect(const char *host, uint16_t port, int32_t timeout) override {
+    IPAddress address;
+    if (resolveHost(host, address) && WiFiClient::connect(address, port, timeout)) {
+      return 1;
+    }
+    forgetHost(host);
+    return WiFiClient::connect(host, port, timeout);
+  }
+};
+
+// HTTPS client that connects through the DNS cache and resumes the host's
+// last TLS session. The handshake mirrors start_ssl_client() in the core,
+// with the session offered before it starts; reading, writing and stop()
+// are the core's, working on the same context.
+class ResumableTlsClient : public WiFiClientSecure {
+public:
+  using WiFiClientSecure::connect;
+
+  int connect(const char *host, uint16_t port) override {
+    return connect(host, port, budgetRemainingMs());
+  }
+
+  int connect(const char *host, uint16_t port, int32_t timeout) override {
+    stop();
+    if (handshake(host, port, timeout, true)) {
+      return 1;
+    }
+    // Cached address or session did not work out: the full way, once
+    stop();
+    forgetHost(host);
+    if (handshake(host, port, timeout, false)) {
+      return 1;
+    }
+    stop();
+    return 0;
+  }
+
+private:
+  bool handshake(const char *host, uint16_t port, uint32_t timeoutMs, bool useCache) {
+    ensureCache();
+    uint32_t start = millis();
+    // Fresh contexts, as the WiFiClientSecure constructor sets them up
+    ssl_init(sslclient);
+    sslclient->socket = -1;
+    sslclient->handshake_timeout = timeoutMs;
+
+    IPAddress address;
+    if (useCache ? !resolveHost(host, address) : !WiFi.hostByName(host, address)) {
+      return false;
+    }
+    timeoutMs = min<uint32_t>(timeoutMs, budgetRemainingMs());
+    sslclient->socket = connectSocket(address, port, timeoutMs, _timeout);
+    if (sslclient->socket < 0) {
+      LOG(TLS_CONNECT_FAILED, host);
+      return false;
+    }
+
+    mbedtls_entropy_init(&sslclient->entropy_ctx);
+    static const char *PERSONALIZATION = "esp32-tls";
+    if (mbedtls_ctr_drbg_seed(&sslclient->drbg_ctx, mbedtls_entropy_func, &sslclient->entropy_ctx,
+                              (const unsigned char *)PERSONALIZATION, strlen(PERSONALIZATION)) != 0 ||
+        mbedtls_ssl_config_defaults(&sslclient->ssl_conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                    MBEDTLS_SSL_PRESET_DEFAULT) != 0) {
+      return false;
+    }
+
+    // Same certificate choices as the core: insecure, a given CA, or the bundle
+    if (_use_insecure) {
+      mbedtls_ssl_conf_authmode(&sslclient->ssl_conf, MBEDTLS_SSL_VERIFY_NONE);
+    } else if (_CA_cert != nullptr) {
+      mbedtls_x509_crt_init(&sslclient->ca_cert);
+      if (mbedtls_x509_crt_parse(&sslclient->ca_cert, (const unsigned char *)_CA_cert, strlen(_CA_cert) + 1) != 0) {
+        return false;
+      }
+      mbedtls_ssl_conf_ca_chain(&sslclient->ssl_conf, &sslclient->ca_cert, nullptr);
+      mbedtls_ssl_conf_authmode(&sslclient->ssl_conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    } else {
+      if (esp_crt_bundle_attach(&sslclient->ssl_conf) != ESP_OK) {
+        return false;
+      }
+      mbedtls_ssl_conf_authmode(&sslclient->ssl_conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    }
+    mbedtls_ssl_conf_rng(&sslclient->ssl_conf, mbedtls_ctr_drbg_random, &sslclient->drbg_ctx);
+    if (mbedtls_ssl_setup(&sslclient->ssl_ctx, &sslclient->ssl_conf) != 0 ||
+        mbedtls_ssl_set_hostname(&sslclient->ssl_ctx, host) != 0) {
+      return false;
+    }
+
+    // Offer the cached session; the server either resumes it or starts over
+    uint8_t offeredMaster[sizeof(((mbedtls_ssl_session *)nullptr)->master)];
+    bool offered = false;
+    mbedtls_ssl_session cached;
+    mbedtls_ssl_session_init(&cached);
+    if (useCache && loadSession(host, cached) && mbedtls_ssl_set_session(&sslclient->ssl_ctx, &cached) == 0) {
+      memcpy(offeredMaster, cached.master, sizeof(offeredMaster));
+      offered = true;
+    }
+    mbedtls_ssl_session_free(&cached);
+    mbedtls_ssl_set_bio(&sslclient->ssl_ctx, &sslclient->socket, mbedtls_net_send, mbedtls_net_recv, nullptr);
+
+    int result;
+    while ((result = mbedtls_ssl_handshake(&sslclient->ssl_ctx)) != 0) {
+      if ((result != MBEDTLS_ERR_SSL_WANT_READ && result != MBEDTLS_ERR_SSL_WANT_WRITE) || millis() - start > timeoutMs) {
+        LOG(TLS_HANDSHAKE_FAILED, host, result);
+        return false;
+      }
+      delay(2);
+    }
+    if (mbedtls_ssl_get_verify_result(&sslclient->ssl_ctx) != 0 && !_use_insecure) {
+      LOG(TLS_HANDSHAKE_FAILED, host, MBEDTLS_ERR_X509_CERT_VERIFY_FAILED);
+      return false;
+    }
+
+    // A resumed session, from its ID or a ticket, keeps its master secret
+    const mbedtls_ssl_session *current = mbedtls_ssl_get_session_pointer(&sslclient->ssl_ctx);
+    bool resumed = offered && memcmp(current->master, offeredMaster, sizeof(offeredMaster)) == 0;
+    uint32_t elapsedMs = millis() - start;
+    uint32_t savedMs = 0;
+    if (resumed) {
+      savedMs = netCache.fullHandshakeMs > elapsedMs ? netCache.fullHandshakeMs - elapsedMs : 0;
+    } else {
+      netCache.fullHandshakeMs = netCache.fullHandshakeMs == 0 ? elapsedMs : (netCache.fullHandshakeMs * 3 + elapsedMs) / 4;
+    }
+    metricsHandshake(resumed, elapsedMs, savedMs);
+    LOG(TLS_HANDSHAKE, host, resumed ? "resumed" : "full", (unsigned)elapsedMs);
+
+    storeSession(host, sslclient->ssl_ctx);
+    _connected = true;
+    return true;
+  }
+};
+
+// An open connection to one host, with the HTTPClient that drives it. The
+// HTTPClient is pooled too, as it stops its client when destroyed.
+struct PooledConnection {
+  String host;
+  uint16_t port;
+  bool secure;
+  // The last response was read to its end, so the next request can follow
+  bool reusable;
+  uint32_t lastUsed;
+  WiFiClient *client;
+  HTTPClient *http;
+};
+
+static PooledConnection pool[NET_POOL_CONNECTIONS];
+
+static void closeConnection(PooledConnection &connection) {
+  // The HTTPClient goes first; its destructor still uses the client
+  delete connection.http;
+  if (connection.client != nullptr) {
+    connection.client->stop();
+  }
+  delete connection.client;
+  connection.host = String();
+  connection.reusable = false;
+  connection.client = nullptr;
+  connection.http = nullptr;
+}
+
+// Scheme, host and port of a URL
+static void parseOrigin(const String &url, bool &secure, String &host, uint16_t &port) {
+  secure = url.startsWith("https:");
+  int start = url.indexOf("://");
+  start = start < 0 ? 0 : start + 3;
+  int end = start;
+  while (end < (int)url.length() && url[end] != '/' && url[end] != ':' && url[end] != '?') {
+    end++;
+  }
+  host = url.substring(start, end);
+  port = secure ? 443 : 80;
+  if (end < (int)url.length() && url[end] == ':') {
+    port = url.substring(end + 1).toInt();
+  }
+}
+
+// The host's connection, else a free slot, else the least recently used one
+static PooledConnection &connectionFor(const String &host, uint16_t port, bool secure) {
+  PooledConnection *chosen = &pool[0];
+  for (int i = 0; i < NET_POOL_CONNECTIONS; i++) {
+    PooledConnection &connection = pool[i];
+    if (connection.client != nullptr && connection.secure == secure && connection.port == port && connection.host == host) {
+      return connection;
+    }
+    if (connection.client == nullptr) {
+      chosen = &connection;
+    } else if (chosen->client != nullptr && connection.lastUsed < chosen->lastUsed) {
+      chosen = &connection;
+    }
+  }
+
+  closeConnection(*chosen);
+  chosen->host = host;
+  chosen->port = port;
+  chosen->secure = secure;
+  chosen->client = secure ? (WiFiClient *)new ResumableTlsClient() : new CachedDnsClient();
+  chosen->http = new HTTPClient();
+  return *chosen;
+}
+
+// Start a request on the host's pooled connection. The caller ends it with
+// http.end(), after keepConnection() if it read the whole response.
+HTTPClient &beginRequest(const String &url) {
+  bool secure;
+  String host;
+  uint16_t port;
+  parseOrigin(url, secure, host, port);
+  PooledConnection &connection = connectionFor(host, port, secure);
+
+  bool reused = connection.reusable && connection.client->connected();
+  if (!reused) {
+    connection.client->stop();
+  }
+  connection.reusable = false;
+  connection.lastUsed = millis();
+  metricsRequest(reused);
+
+  // HTTP/1.0 keeps chunked framing off the body (and HTTPClient's
+  // identity-only Accept-Encoding out of the request); keep-alive is asked
+  // for explicitly and the server ends each body with its Content-Length.
+  HTTPClient &http = *connection.http;
+  http.useHTTP10(true);
+  http.setReuse(true);
+  http.begin(*connection.client, url);
+  return http;
+}
+
+// The response on this client was read to its end
+void keepConnection(HTTPClient &http) {
+  for (int i = 0; i < NET_POOL_CONNECTIONS; i++) {
+    if (pool[i].http == &http) {
+      pool[i].reusable = true;
+    }
+  }
+}
+
+// Close whatever is still open, before the radio goes off
+void closeConnections() {
+  unsigned open = 0;
+  for (int i = 0; i < NET_POOL_CONNECTIONS; i++) {
+    if (pool[i].client != nullptr && pool[i].client->connected()) {
+      open++;
+    }
+    closeConnection(pool[i]);
+  }
+  if (open > 0) {
+    LOG(CONNECTIONS_CLOSED, open);
+  }
+}
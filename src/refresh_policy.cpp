@@ -0,0 +1,114 @@
+#include "refresh_policy.h"
+#include "panel.h"
+#include "civil_time.h"
+#include "binlog.h"
+
+#define REFRESH_POLICY_MAGIC 0x52465031
+
+static const char *REGION_NAMES[REGION_COUNT] = {"screen", "clock"};
+static const char *MODE_NAMES[] = {"partial", "fast-full", "full"};
+
+// Ghosting debt kept across deep sleep
+struct RefreshPolicyState {
+  uint32_t magic;
+  uint16_t partials[REGION_COUNT];
+  uint8_t fastFulls;
+};
+
+RTC_DATA_ATTR static RefreshPolicyState policyState;
+
+static RefreshPolicyConfig policyConfig = DEFAULT_REFRESH_POLICY;
+
+// After power-on the panel state is unknown: demand a full refresh
+static void ensureState() {
+  if (policyState.magic != REFRESH_POLICY_MAGIC) {
+    policyState.magic = REFRESH_POLICY_MAGIC;
+    for (int i = 0; i < REGION_COUNT; i++) {
+      policyState.partials[i] = policyConfig.partialBudget;
+    }
+    policyState.fastFulls = policyConfig.fastFullBudget;
+  }
+}
+
+static bool inQuietHours(time_t now) {
+  struct tm timeinfo;
+  localTime(now, timeinfo);
+  if (policyConfig.quietStartHour <= policyConfig.quietEndHour) {
+    return timeinfo.tm_hour >= policyConfig.quietStartHour && timeinfo.tm_hour < policyConfig.quietEndHour;
+  }
+  return timeinfo.tm_hour >= policyConfig.quietStartHour || timeinfo.tm_hour < policyConfig.quietEndHour;
+}
+
+void setRefreshPolicyConfig(const RefreshPolicyConfig &newConfig) {
+  policyConfig = newConfig;
+}
+
+// Pick the cheapest refresh that keeps the region within its ghosting budget.
+// A screen update touches every region, so it is judged by the worst one.
+RefreshMode chooseRefresh(RefreshRegion region, time_t now) {
+  ensureState();
+
+  uint16_t debt = policyState.partials[region];
+  if (region == REGION_SCREEN) {
+    for (int i = 0; i < REGION_COUNT; i++) {
+      debt = max(debt, policyState.partials[i]);
+    }
+  }
+
+  RefreshMode mode;
+  const char *reason;
+  if (!ActivePanel::PARTIAL_REFRESH) {
+    mode = REFRESH_FULL;
+    reason = "panel has no partial refresh";
+  } else if (debt < policyConfig.partialBudget && !(region == REGION_SCREEN && debt > 0 && inQuietHours(now))) {
+    mode = REFRESH_PARTIAL;
+    reason = "within budget";
+  } else if (region != REGION_SCREEN) {
+    // Regions can only be cleaned by redrawing the whole screen
+    mode = REFRESH_FULL;
+    reason = "region budget exhausted";
+  } else if (inQuietHours(now) || !ActivePanel::FAST_FULL_REFRESH || policyState.fastFulls >= policyConfig.fastFullBudget) {
+    mode = REFRESH_FULL;
+    reason = inQuietHours(now) ? "quiet hours" : "fast-full budget exhausted";
+  } else {
+    mode = REFRESH_FAST_FULL;
+    reason = "partial budget exhausted";
+  }
+
+  LOG(REFRESH_CHOSEN, REGION_NAMES[region], MODE_NAMES[mode], reason, (unsigned)debt,
+      (unsigned)policyConfig.partialBudget, (unsigned)policyState.fastFulls, (unsigned)policyConfig.fastFullBudget);
+  return mode;
+}
+
+// Account for a refresh that was actually pushed to the panel
+void recordRefresh(RefreshRegion region, RefreshMode mode) {
+  ensureState();
+
+  if (region != REGION_SCREEN) {
+    policyState.partials[region]++;
+    return;
+  }
+
+  switch (mode) {
+    case REFRESH_PARTIAL:
+      for (int i = 0; i < REGION_COUNT; i++) {
+        policyState.partials[i]++;
+      }
+      break;
+    case REFRESH_FAST_FULL:
+      // Clears most ghosting but not all: halve the debt
+      for (int i = 0; i < REGION_COUNT; i++) {
+        policyState.partials[i] /= 2;
+      }
+      policyState.fastFulls++;
+      break;
+    case REFRESH_FULL:
+      memset(policyState.partials, 0, sizeof(policyState.partials));
+      policyState.fastFulls = 0;
+      break;
+  }
+}
+
+const char *refreshModeName(RefreshMode mode) {
+  return MODE_NAMES[mode];
+}
@@ -0,0 +1,102 @@
+#include "render_pipeline.h"
+#include "display.h"
+#include "metrics.h"
+#include "civil_time.h"
+#include "model_cache.h"
+#include "binlog.h"
+
+static SnapshotBuffer<WeatherSnapshot> weatherSnapshots;
+static SnapshotBuffer<CalendarEvents> calendarSnapshots;
+
+// Shown before anything is published
+static const WeatherSnapshot NO_WEATHER = {};
+static const CalendarEvents NO_EVENTS = {};
+
+// The weather pane stage in flight, if any. The task gives the semaphore
+// when the chart is done. The chart starts at the current hour, so the time
+// it was drawn for is checked against the composite's.
+static SemaphoreHandle_t weatherPaneDone;
+static bool weatherPaneRunning;
+static time_t weatherPaneTime;
+static bool weatherPaneReady;
+static uint32_t weatherPaneFinishedAt;
+
+static void renderWeatherPane() {
+  const WeatherSnapshot &weather = weatherSnapshot();
+  metricsStart(PHASE_RENDER);
+  weatherPaneReady = weather.valid && prepareWeatherPane(weather.hourly, weatherPaneTime);
+  metricsStop(PHASE_RENDER);
+  weatherPaneFinishedAt = millis();
+}
+
+static void weatherPaneTask(void *) {
+  renderWeatherPane();
+  xSemaphoreGive(weatherPaneDone);
+  vTaskDelete(nullptr);
+}
+
+WeatherSnapshot &beginWeatherSnapshot() {
+  return weatherSnapshots.back();
+}
+
+// Publish the weather and start rasterizing its pane. The chart needs the
+// local hour, so without a clock it waits for the composite instead.
+void publishWeatherSnapshot() {
+  weatherSnapshots.publish();
+  weatherPaneTime = time(nullptr);
+  weatherPaneReady = false;
+  if (weatherPaneTime < MIN_VALID_EPOCH) {
+    return;
+  }
+  if (weatherPaneDone == nullptr) {
+    weatherPaneDone = xSemaphoreCreateBinary();
+  }
+  if (weatherPaneDone == nullptr ||
+      xTaskCreate(weatherPaneTask, "weatherPane", PANE_TASK_STACK, nullptr, PANE_TASK_PRIORITY, nullptr) != pdPASS) {
+    renderWeatherPane();
+    return;
+  }
+  weatherPaneRunning = true;
+}
+
+CalendarEvents &beginCalendarSnapshot() {
+  return calendarSnapshots.back();
+}
+
+void publishCalendarSnapshot() {
+  calendarSnapshots.publish();
+}
+
+// Join the pane stages. A stage never blocks, so this waits at most for the
+// rest of its CPU work.
+void waitForPanes() {
+  if (weatherPaneRunning) {
+    uint32_t neededAt = millis();
+    xSemaphoreTake(weatherPaneDone, portMAX_DELAY);
+    weatherPaneRunning = false;
+    LOG(PANE_RENDERED, metricsPhaseMs(PHASE_RENDER), (int)(neededAt - weatherPaneFinishedAt));
+  }
+}
+
+// Render the panes that were not rendered ahead, or were rendered for an
+// earlier hour, here; redraw renders them all (the time zone changed)
+void finishPanes(time_t now, bool redraw) {
+  waitForPanes();
+  const WeatherSnapshot &weather = weatherSnapshot();
+  bool stale = redraw || !weatherPaneReady ||
+               forecastHourAt(weather.hourly, weatherPaneTime) != forecastHourAt(weather.hourly, now);
+  if (weather.valid && stale) {
+    weatherPaneTime = now;
+    renderWeatherPane();
+  }
+}
+
+const WeatherSnapshot &weatherSnapshot() {
+  const WeatherSnapshot *weather = weatherSnapshots.front();
+  return weather != nullptr ? *weather : NO_WEATHER;
+}
+
+const CalendarEvents &calendarSnapshot() {
+  const CalendarEvents *events = calendarSnapshots.front();
+  return events != nullptr ? *events : NO_EVENTS;
+}
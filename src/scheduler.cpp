@@ -0,0 +1,78 @@
+#include "scheduler.h"
+#include "display.h"
+#include "civil_time.h"
+#include "battery.h"
+#include <sys/time.h>
+
+// Scheduler state kept across deep sleep
+struct SchedulerState {
+  uint32_t magic;
+  time_t nextDataWake;
+  bool ticksAllowed;
+};
+
+#define SCHEDULER_MAGIC 0x53434831
+
+RTC_DATA_ATTR static SchedulerState schedulerState;
+
+// Minute ticks need a panel with fast partial refresh
+static constexpr bool TICKS_ENABLED = ActivePanel::PARTIAL_REFRESH;
+
+// Decide what this wake is for. Only data wakes bring up the radio; a tick
+// wake just redraws the clock widget from the cached model.
+WakeKind scheduleWake() {
+  return scheduleWakeAt(time(nullptr), esp_reset_reason() == ESP_RST_DEEPSLEEP);
+}
+
+// The decision on a given clock, for the simulator (sim/)
+WakeKind scheduleWakeAt(time_t now, bool fromDeepSleep) {
+  if (!fromDeepSleep || schedulerState.magic != SCHEDULER_MAGIC) {
+    schedulerState.magic = SCHEDULER_MAGIC;
+    schedulerState.nextDataWake = 0;
+    return WAKE_DATA;
+  }
+
+  if (!TICKS_ENABLED || !schedulerState.ticksAllowed || now < MIN_VALID_EPOCH || now >= schedulerState.nextDataWake) {
+    return WAKE_DATA;
+  }
+  return WAKE_TICK;
+}
+
+// allowTicks is false when the widget has no local model to draw from
+// (thin-client mode, where the frame server renders the whole screen).
+// A low battery stretches the interval and stops the ticks.
+void markDataFetched(time_t now, bool allowTicks) {
+  const PowerPolicy &power = currentPowerPolicy();
+  schedulerState.nextDataWake = now + power.dataIntervalS;
+  schedulerState.ticksAllowed = allowTicks && power.ticksAllowed;
+}
+
+// Sleep until the next minute boundary (tick) or the next data wake,
+// whichever comes first
+uint64_t nextSleepDurationUs() {
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  return sleepDurationUs((int64_t)tv.tv_sec * 1000000LL + tv.tv_usec);
+}
+
+uint64_t sleepDurationUs(int64_t nowUs) {
+  time_t now = nowUs / 1000000LL;
+  if (now < MIN_VALID_EPOCH) {
+    return (uint64_t)currentPowerPolicy().dataIntervalS * 1000000ULL;
+  }
+
+  time_t wakeAt = schedulerState.nextDataWake;
+  if (TICKS_ENABLED && schedulerState.ticksAllowed) {
+    time_t nextTick = now - (now % TICK_INTERVAL_S) + TICK_INTERVAL_S;
+    if (nextTick < wakeAt) {
+      wakeAt = nextTick;
+    }
+  }
+  if (wakeAt <= now) {
+    wakeAt = now + 1;
+  }
+
+  // Wake just after the boundary so the rendered minute is already current
+  int64_t remainingUs = (int64_t)wakeAt * 1000000LL - nowUs;
+  return remainingUs + 50000;
+}
@@ -0,0 +1,72 @@
+#include "wake_budget.h"
+#include "metrics.h"
+#include "binlog.h"
+
+static const char *STAGE_NAMES[STAGE_COUNT] = {"connect", "weather", "calendar", "frame", "draw"};
+static const uint32_t STAGE_BUDGET_MS[STAGE_COUNT] = {
+  BUDGET_CONNECT_MS,
+  BUDGET_FETCH_MS,
+  BUDGET_FETCH_MS,
+  BUDGET_FETCH_MS,
+  BUDGET_DRAW_MS
+};
+
+static int64_t wakeStartUs;
+static int64_t wakeDeadlineUs;
+static int64_t stageStartUs;
+static int64_t stageDeadlineUs;
+static int activeStage = -1;
+
+static void checkOverrun(const char *name, int64_t startUs, int64_t deadlineUs) {
+  int64_t nowUs = esp_timer_get_time();
+  if (nowUs > deadlineUs) {
+    uint32_t overMs = (nowUs - deadlineUs) / 1000;
+    LOG(BUDGET_OVERRUN, name, (unsigned)((nowUs - startUs) / 1000), overMs);
+    metricsOverrun(overMs);
+  }
+}
+
+// Start (or restart) the wake clock
+void budgetBeginWake(uint32_t wakeMs) {
+  wakeStartUs = esp_timer_get_time();
+  wakeDeadlineUs = wakeStartUs + (int64_t)wakeMs * 1000;
+  activeStage = -1;
+}
+
+void budgetEndWake() {
+  checkOverrun("wake", wakeStartUs, wakeDeadlineUs);
+}
+
+// Enter a stage. Its deadline is its own budget, capped by the wake deadline.
+// Returns false if the wake budget is already spent, so the caller can skip
+// optional work.
+bool budgetStart(BudgetStage stage) {
+  int64_t nowUs = esp_timer_get_time();
+  if (nowUs >= wakeDeadlineUs) {
+    LOG(BUDGET_SPENT, STAGE_NAMES[stage]);
+    return false;
+  }
+  stageStartUs = nowUs;
+  stageDeadlineUs = min(nowUs + (int64_t)STAGE_BUDGET_MS[stage] * 1000, wakeDeadlineUs);
+  activeStage = stage;
+  return true;
+}
+
+void budgetStop(BudgetStage stage) {
+  if (activeStage != stage) {
+    return;
+  }
+  checkOverrun(STAGE_NAMES[stage], stageStartUs, stageStartUs + (int64_t)STAGE_BUDGET_MS[stage] * 1000);
+  activeStage = -1;
+}
+
+// Time left in the current stage, or in the wake outside of any stage
+uint32_t budgetRemainingMs() {
+  int64_t deadlineUs = activeStage >= 0 ? stageDeadlineUs : wakeDeadlineUs;
+  int64_t leftUs = deadlineUs - esp_timer_get_time();
+  return leftUs > 0 ? leftUs / 1000 : 0;
+}
+
+bool budgetExpired() {
+  return budgetRemainingMs() == 0;
+}
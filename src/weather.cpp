@@ -1,5 +1,8 @@
 #include "weather.h"
 #include "config.h"
+#include "http_stream.h"
+#include "net_session.h"
+#include "binlog.h"
 #include <HTTPClient.h>
 #include <ArduinoJson.h>
 #include <WiFi.h>
@@ -11,26 +14,24 @@ const char* IP_GEOLOCATION_API = "http://ip-api.com/json/";
 
 // Get location information based on IP address
 bool getLocationFromIP(String &city, String &country) {
-  HTTPClient http;
-  http.begin(IP_GEOLOCATION_API);
+  HTTPClient &http = beginRequest(IP_GEOLOCATION_API);
+  prepareCompressedRequest(http);
+  applyRequestDeadline(http);
   
   int httpCode = http.GET();
   if (httpCode != HTTP_CODE_OK) {
-    Serial.printf("IP Geolocation API failed, error: %d\n", httpCode);
+    LOG(GEOLOCATION_HTTP_FAILED, httpCode);
     http.end();
     return false;
   }
   
-  String payload = http.getString();
-  http.end();
-  
-  // Parse JSON response
+  // Parse JSON response directly from the connection
   DynamicJsonDocument doc(1024);
-  DeserializationError error = deserializeJson(doc, payload);
+  DeserializationError error = deserializeResponse(http, doc);
+  http.end();
   
   if (error) {
-    Serial.print("JSON parsing failed: ");
-    Serial.println(error.c_str());
+    LOG(GEOLOCATION_PARSE_FAILED, error.c_str());
     return false;
   }
   
@@ -38,28 +39,55 @@ bool getLocationFromIP(String &city, String &country) {
   if (doc["status"] == "success") {
     city = doc["city"].as<String>();
     country = doc["country"].as<String>();
-    Serial.printf("Location detected: %s, %s\n", city.c_str(), country.c_str());
+    LOG(LOCATION_DETECTED, city, country);
     return true;
   }
   
   return false;
 }
 
+// Get the IANA time zone name and current UTC offset (seconds) for the IP
+bool getTimeZoneFromIP(String &ianaName, int32_t &utcOffset) {
+  HTTPClient &http = beginRequest(String(IP_GEOLOCATION_API) + "?fields=status,timezone,offset");
+  prepareCompressedRequest(http);
+  applyRequestDeadline(http);
+  
+  int httpCode = http.GET();
+  if (httpCode != HTTP_CODE_OK) {
+    LOG(GEOLOCATION_HTTP_FAILED, httpCode);
+    http.end();
+    return false;
+  }
+  
+  StaticJsonDocument<256> doc;
+  DeserializationError error = deserializeResponse(http, doc);
+  http.end();
+  
+  if (error) {
+    LOG(GEOLOCATION_PARSE_FAILED, error.c_str());
+    return false;
+  }
+  if (doc["status"] != "success" || !doc["timezone"].is<const char *>()) {
+    return false;
+  }
+  
+  ianaName = doc["timezone"].as<String>();
+  utcOffset = doc["offset"].as<int32_t>();
+  return true;
+}
+
 // Get weather data from OpenWeatherMap API
 bool getWeatherData(WeatherData &currentWeather, HourlyForecast hourlyForecast[]) {
-  // Access the global config variable
-  extern Config config;
-  
   // Get location from IP if not set in config
   String city, country;
-  if (config.location.isEmpty()) {
+  if (config.location[0] == '\0') {
     if (!getLocationFromIP(city, country)) {
-      Serial.println("Failed to get location from IP");
+      LOG(LOCATION_FAILED);
       return false;
     }
     currentWeather.location = city + ", " + country;
   } else {
-    currentWeather.location = config.location;
+    currentWeather.location = String(config.location);
   }
   
   // Prepare API request
@@ -70,26 +98,24 @@ bool getWeatherData(WeatherData &currentWeather, HourlyForecast hourlyForecast[]
   url += "&units=metric";
   url += "&appid=YOUR_API_KEY"; // Replace with your OpenWeatherMap API key
   
-  HTTPClient http;
-  http.begin(url);
+  HTTPClient &http = beginRequest(url);
+  prepareCompressedRequest(http);
+  applyRequestDeadline(http);
   
   int httpCode = http.GET();
   if (httpCode != HTTP_CODE_OK) {
-    Serial.printf("Weather API request failed, error: %d\n", httpCode);
+    LOG(WEATHER_HTTP_FAILED, httpCode);
     http.end();
     return false;
   }
   
-  String payload = http.getString();
-  http.end();
-  
-  // Parse JSON response
+  // Parse JSON response as it arrives (gzip-inflated when the server compressed it)
   DynamicJsonDocument doc(16384); // Larger buffer for the complete weather data
-  DeserializationError error = deserializeJson(doc, payload);
+  DeserializationError error = deserializeResponse(http, doc);
+  http.end();
   
   if (error) {
-    Serial.print("Weather JSON parsing failed: ");
-    Serial.println(error.c_str());
+    LOG(WEATHER_PARSE_FAILED, error.c_str());
     return false;
   }
   
@@ -109,10 +135,13 @@ bool getWeatherData(WeatherData &currentWeather, HourlyForecast hourlyForecast[]
     currentWeather.iconCode = current["weather"][0]["icon"].as<String>();
   }
   
-  // Extract hourly forecast (next 24 hours)
+  // Extract hourly forecast (next 48 hours)
   JsonArray hourly = doc["hourly"];
-  int count = min((int)hourly.size(), 24);
+  int count = min((int)hourly.size(), HOURLY_FORECAST_COUNT);
   
+  for (int i = count; i < HOURLY_FORECAST_COUNT; i++) {
+    hourlyForecast[i].timestamp = 0;
+  }
   for (int i = 0; i < count; i++) {
     hourlyForecast[i].timestamp = hourly[i]["dt"].as<long>();
     hourlyForecast[i].temperature = hourly[i]["temp"].as<float>();
@@ -0,0 +1,203 @@
+#!/usr/bin/env python3
+"""
+Asset Bundle Builder for ESP32 E-Ink Weather and Calendar Display
+
+Packs weather icons and fonts into the bundle the firmware memory-maps from
+its "assets" flash partition (see include/asset_bundle.h for the layout).
+Icons are grouped into one atlas per size, named "icons<W>x<H>". Fonts are
+Adafruit GFX font headers (the Fonts/*.h files, or your own made with
+fontconvert) and keep their variable name, so a bundled "FreeMonoBold9pt7b"
+replaces the compiled-in font of that name. A character range trims a font
+to the glyphs you need.
+
+Usage:
+  python build_assets.py -o assets.bin --icons ../assets \\
+      --font FreeMonoBold9pt7b.h --font FreeMonoBold24pt7b.h:0x20-0x3A
+  python -m esptool write_flash 0x390000 assets.bin   # offset from partitions.csv
+
+Icons must be 1-bit BMP files named <code>_<W>x<H>.bmp, as written by
+generate_weather_icons.py, or <code>.bmp.
+
+Requirements:
+  - Python 3.6+
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+BUNDLE_MAGIC = 0x31424145  # "EAB1"
+BUNDLE_VERSION = 1
+NAME_LENGTH = 20
+PARTITION_SIZE = 0x60000
+
+ASSET_ICON_ATLAS = 1
+ASSET_GLYPH_SET = 2
+
+ICON_NAME_RE = re.compile(r"^(\d\d[dn])(?:_(\d+)x(\d+))?\.bmp$")
+COMMENT_RE = re.compile(r"//[^\n]*|/\*.*?\*/", re.S)
+BITMAPS_RE = re.compile(r"uint8_t\s+(\w+)Bitmaps\s*\[\s*\]\s*(?:PROGMEM)?\s*=\s*\{(.*?)\}\s*;", re.S)
+GLYPHS_RE = re.compile(r"GFXglyph\s+(\w+)Glyphs\s*\[\s*\]\s*(?:PROGMEM)?\s*=\s*\{(.*?)\}\s*;", re.S)
+GLYPH_RE = re.compile(r"\{\s*(-?\w+)\s*,\s*(-?\w+)\s*,\s*(-?\w+)\s*,\s*(-?\w+)\s*,\s*(-?\w+)\s*,\s*(-?\w+)\s*\}")
+FONT_RE = re.compile(r"GFXfont\s+(\w+)\s*(?:PROGMEM)?\s*=\s*\{(.*?)\}\s*;", re.S)
+
+
+def read_bmp(path):
+    """Return (width, height, rows) of a 1-bit BMP; rows are lists of 0/1, 1 = black."""
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:2] != b"BM":
+        raise ValueError(f"{path}: not a BMP file")
+    pixel_offset, = struct.unpack_from("<I", data, 10)
+    header_size, width, height, _, bits, compression = struct.unpack_from("<IiiHHI", data, 14)
+    if bits != 1 or compression != 0:
+        raise ValueError(f"{path}: expected an uncompressed 1-bit BMP")
+
+    # Palette entries are BGRx; whichever index is darker is black
+    palette = data[14 + header_size:14 + header_size + 8]
+    black_index = 0 if sum(palette[0:3]) < sum(palette[4:7]) else 1
+
+    row_bytes = (width + 31) // 32 * 4
+    rows = []
+    for y in range(abs(height)):
+        # Rows are stored bottom-up unless the height is negative
+        source_row = abs(height) - 1 - y if height > 0 else y
+        start = pixel_offset + source_row * row_bytes
+        row = []
+        for x in range(width):
+            bit = (data[start + x // 8] >> (7 - x % 8)) & 1
+            row.append(1 if bit == black_index else 0)
+        rows.append(row)
+    return width, abs(height), rows
+
+
+def pack_rows(rows, width):
+    """1 bpp, MSB first, each row padded to a byte (Adafruit_GFX::drawBitmap)."""
+    out = bytearray()
+    for row in rows:
+        for x in range(0, width, 8):
+            byte = 0
+            for bit, pixel in enumerate(row[x:x + 8]):
+                byte |= pixel << (7 - bit)
+            out.append(byte)
+    return bytes(out)
+
+
+def build_icon_atlases(directory):
+    """Return [(name, type, payload)], one atlas per icon size."""
+    sizes = {}
+    for filename in sorted(os.listdir(directory)):
+        match = ICON_NAME_RE.match(filename)
+        if not match:
+            continue
+        width, height, rows = read_bmp(os.path.join(directory, filename))
+        code = match.group(1)
+        sizes.setdefault((width, height), []).append((code, pack_rows(rows, width)))
+
+    atlases = []
+    for (width, height), icons in sorted(sizes.items()):
+        stride = (width + 7) // 8 * height
+        payload = struct.pack("<HHHH", width, height, len(icons), stride)
+        payload += b"".join(code.encode().ljust(4, b"\0") for code, _ in icons)
+        payload += b"".join(bitmap for _, bitmap in icons)
+        atlases.append((f"icons{width}x{height}", ASSET_ICON_ATLAS, payload))
+        print(f"  icons{width}x{height}: {len(icons)} icons, {len(payload)} bytes")
+    return atlases
+
+
+def parse_range(text):
+    first, last = text.split("-")
+    return int(first, 0), int(last, 0)
+
+
+def build_glyph_set(spec):
+    """Return (name, type, payload) for an Adafruit GFX font header."""
+    path, _, char_range = spec.partition(":")
+    with open(path) as f:
+        source = COMMENT_RE.sub("", f.read())
+
+    bitmaps_match = BITMAPS_RE.search(source)
+    glyphs_match = GLYPHS_RE.search(source)
+    font_match = FONT_RE.search(source)
+    if not (bitmaps_match and glyphs_match and font_match):
+        raise ValueError(f"{path}: not an Adafruit GFX font header")
+
+    bitmaps = bytes(int(value, 0) for value in bitmaps_match.group(2).replace(",", " ").split())
+    glyphs = [tuple(int(value, 0) for value in glyph) for glyph in GLYPH_RE.findall(glyphs_match.group(2))]
+    name = font_match.group(1)
+    fields = [field.strip() for field in font_match.group(2).split(",")]
+    first, last, y_advance = (int(field, 0) for field in fields[2:5])
+    if len(glyphs) != last - first + 1:
+        raise ValueError(f"{path}: expected {last - first + 1} glyphs, found {len(glyphs)}")
+    if len(name) >= NAME_LENGTH:
+        raise ValueError(f"{path}: font name {name} is too long")
+
+    # Keep only the requested characters, rebasing the bitmap offsets
+    subset_first, subset_last = parse_range(char_range) if char_range else (first, last)
+    if subset_first < first or subset_last > last or subset_first > subset_last:
+        raise ValueError(f"{path}: range {char_range} is outside {first:#x}-{last:#x}")
+    records = bytearray()
+    glyph_bitmaps = bytearray()
+    for offset, width, height, x_advance, x_offset, y_offset in glyphs[subset_first - first:subset_last - first + 1]:
+        size = (width * height + 7) // 8
+        records += struct.pack("<HBBBbbx", len(glyph_bitmaps), width, height, x_advance, x_offset, y_offset)
+        glyph_bitmaps += bitmaps[offset:offset + size]
+    if len(glyph_bitmaps) > 0xFFFF:
+        raise ValueError(f"{path}: glyph bitmaps exceed 64 KB")
+
+    payload = struct.pack("<HHBxxx", subset_first, subset_last, y_advance) + bytes(records) + bytes(glyph_bitmaps)
+    print(f"  {name}: {subset_last - subset_first + 1} glyphs, {len(payload)} bytes")
+    return name, ASSET_GLYPH_SET, payload
+
+
+def pack_bundle(assets):
+    """Header, directory and 4-byte aligned entries."""
+    directory_size = 12 + 32 * len(assets)
+    offset = (directory_size + 3) & ~3
+    directory = bytearray()
+    body = bytearray(offset - directory_size)
+    for name, asset_type, payload in assets:
+        directory += struct.pack("<20sBxxxII", name.encode(), asset_type, offset, len(payload))
+        padding = (-len(payload)) % 4
+        body += payload + bytes(padding)
+        offset += len(payload) + padding
+    header = struct.pack("<IHHI", BUNDLE_MAGIC, BUNDLE_VERSION, len(assets), offset)
+    return header + bytes(directory) + bytes(body)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Build the asset bundle for the assets partition")
+    parser.add_argument("-o", "--output", default="assets.bin", help="bundle file to write")
+    parser.add_argument("--icons", help="directory of 1-bit BMP weather icons")
+    parser.add_argument("--font", action="append", default=[],
+                        help="GFX font header, optionally with a character range (font.h:0x20-0x7E)")
+    args = parser.parse_args()
+
+    assets = []
+    try:
+        if args.icons:
+            assets += build_icon_atlases(args.icons)
+        assets += [build_glyph_set(spec) for spec in args.font]
+    except (OSError, ValueError) as error:
+        print(f"Error: {error}", file=sys.stderr)
+        return 1
+
+    names = [name for name, _, _ in assets]
+    if len(set(names)) != len(names):
+        print("Error: duplicate asset names", file=sys.stderr)
+        return 1
+
+    bundle = pack_bundle(assets)
+    if len(bundle) > PARTITION_SIZE:
+        print(f"Error: bundle is {len(bundle)} bytes, the partition holds {PARTITION_SIZE}", file=sys.stderr)
+        return 1
+    with open(args.output, "wb") as f:
+        f.write(bundle)
+    print(f"Wrote {args.output}: {len(assets)} assets, {len(bundle)} bytes")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,161 @@
+#!/usr/bin/env python3
+"""
+Binary Log Decoder for ESP32 E-Ink Weather and Calendar Display
+
+The firmware logs into a binary ring in RTC memory (src/binlog.cpp) instead
+of printing text. After a crash or watchdog reset the ring is dumped over the
+serial port between "BINLOG <first> <head>" and "BINLOG END" lines; calling
+logDump() prints the same block on demand. This script finds the dump in a
+serial capture and turns it back into text using the message table in
+include/log_messages.h.
+
+Usage:
+  python decode_log.py capture.txt
+  pio device monitor | tee capture.txt    # to capture the serial output
+  python decode_log.py - < capture.txt    # read from stdin
+
+Requirements:
+  - Python 3.6+
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+RECORD_MARK = 0xA5
+LEVEL_NAMES = ("DEBUG", "INFO", "WARN", "ERROR")
+DEFAULT_MESSAGES = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                "..", "include", "log_messages.h")
+
+MESSAGE_RE = re.compile(r'^\s*LOG_MESSAGE\((\w+),\s*(\w+),\s*"((?:[^"\\]|\\.)*)"\)')
+SPEC_RE = re.compile(r"%%|%[-+ #0]*\d*(?:\.\d+)?([diuxXcfs])")
+
+
+def load_messages(path):
+    """Return [(name, level, format)] indexed by message ID."""
+    messages = []
+    with open(path) as f:
+        for line in f:
+            match = MESSAGE_RE.match(line)
+            if match:
+                name, level, fmt = match.groups()
+                fmt = fmt.encode().decode("unicode_escape")
+                messages.append((name, level, fmt))
+    return messages
+
+
+def read_dump(lines):
+    """Return the words of the last complete dump in the capture."""
+    words = None
+    dump = None
+    for line in lines:
+        line = line.strip()
+        if line.startswith("BINLOG END"):
+            if words is not None:
+                dump = words
+            words = None
+        elif line.startswith("BINLOG "):
+            words = []
+        elif words is not None:
+            try:
+                words.extend(int(token, 16) for token in line.split())
+            except ValueError:
+                pass  # other output interleaved with the dump
+    return dump
+
+
+def to_signed(word):
+    return word - (1 << 32) if word & 0x80000000 else word
+
+
+def format_message(fmt, payload):
+    """Substitute the payload words into fmt. Returns (text, words used)."""
+    pos = 0
+    out = []
+    last = 0
+    for match in SPEC_RE.finditer(fmt):
+        out.append(fmt[last:match.start()])
+        last = match.end()
+        spec = match.group(0)
+        conversion = match.group(1)
+        if spec == "%%":
+            out.append("%")
+            continue
+        if pos >= len(payload):
+            raise ValueError("record too short")
+        word = payload[pos]
+        pos += 1
+        if conversion == "s":
+            length = word
+            count = (length + 3) // 4
+            if length > 255 or pos + count > len(payload):
+                raise ValueError("bad string")
+            raw = b"".join(struct.pack("<I", w) for w in payload[pos:pos + count])
+            pos += count
+            out.append(spec % raw[:length].decode("utf-8", "replace"))
+        elif conversion == "f":
+            out.append(spec % struct.unpack("<f", struct.pack("<I", word))[0])
+        elif conversion == "c":
+            out.append(spec % chr(word & 0xFF))
+        elif conversion in "di":
+            out.append(spec % to_signed(word))
+        else:
+            out.append(spec % word)
+    out.append(fmt[last:])
+    return "".join(out), pos
+
+
+def decode(words, messages):
+    """Yield (millis, level, text) for every intact record, oldest first.
+
+    The oldest record may have been partly overwritten, and a record whose
+    writer crashed has no header; both are skipped by resyncing on the next
+    header word.
+    """
+    i = 0
+    while i < len(words):
+        header = words[i]
+        message_id = header & 0xFFFF
+        payload_words = (header >> 16) & 0xFF
+        end = i + 2 + payload_words
+        if header >> 24 != RECORD_MARK or message_id >= len(messages) or end > len(words):
+            i += 1
+            continue
+        name, level, fmt = messages[message_id]
+        try:
+            text, used = format_message(fmt, words[i + 2:end])
+        except (ValueError, TypeError):
+            i += 1
+            continue
+        if used != payload_words:
+            i += 1
+            continue
+        yield words[i + 1], level, text
+        i = end
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode a dumped binary log ring")
+    parser.add_argument("capture", help="serial capture containing a BINLOG dump, or - for stdin")
+    parser.add_argument("--messages", default=DEFAULT_MESSAGES, help="path to log_messages.h")
+    args = parser.parse_args()
+
+    messages = load_messages(args.messages)
+    if args.capture == "-":
+        words = read_dump(sys.stdin)
+    else:
+        with open(args.capture, errors="replace") as f:
+            words = read_dump(f)
+    if words is None:
+        print("No complete BINLOG dump found", file=sys.stderr)
+        return 1
+
+    for millis, level, text in decode(words, messages):
+        print("%10u ms  %-5s %s" % (millis, level, text))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())